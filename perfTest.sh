@@ -0,0 +1,25 @@
+#!/bin/sh
+# Performance regression gate: runs a fixed-seed sampleGraphMaker workload
+# through smartifier2 and compares throughput and peak RSS with the stored
+# baseline perf/baseline.csv. Use `./perfTest.sh --update` to rewrite the
+# baseline on the reference machine. The tolerances can be set with
+# PERF_MAX_SLOWDOWN and PERF_MAX_RSS_GROWTH (fractions, defaults 0.25 and 0.2).
+
+# To be able to run in `build`:
+if [ ! -d perf ] ; then
+    cd ..
+fi
+BIN=${BIN:-build}
+
+WORKLOAD="--vertices 100000 --edges 200000 --collections 2 --types csv,jsonl
+          --threads 1,2 --memory 4096,4 --repeat 3 --seed 7 --format csv"
+
+if [ "$1" = "--update" ] ; then
+    exec $BIN/graphutils_bench --dir $BIN/perf $WORKLOAD \
+        --output perf/baseline.csv
+fi
+
+exec $BIN/graphutils_bench --dir $BIN/perf $WORKLOAD \
+    --output $BIN/perf/results.csv --compare perf/baseline.csv \
+    --max-slowdown ${PERF_MAX_SLOWDOWN:-0.25} \
+    --max-rss-growth ${PERF_MAX_RSS_GROWTH:-0.2}
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Training workload for the profile-guided build: generates CSV and JSONL
+# graphs with sampleGraphMaker and runs them through the vertices and the
+# edges mode of smartifier2, with one and several threads and with a memory
+# limit which needs several passes. The instrumented binaries in $BIN write
+# their profiles when they exit.
+
+# To be able to run in `build`:
+if [ ! -f pgoTrain.sh ] ; then
+    cd ..
+fi
+BIN=${BIN:-build}
+
+rm -rf $BIN/pgo-train
+$BIN/graphutils_bench --dir $BIN/pgo-train --vertices 100000 --edges 200000 \
+    --collections 2 --types csv,jsonl --threads 1,4 --memory 4096,4 \
+    --repeat 1 --output $BIN/pgo-train/results.csv || exit 1
+rm -rf $BIN/pgo-train
@@ -0,0 +1,473 @@
+// AsyncIO.cpp - read ahead and write behind with io_uring, set up with the
+// raw system calls since liburing is not a dependency
+
+#include "AsyncIO.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "BlockIO.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define GRAPHUTILS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// A minimal io_uring: one submission per system call, completions are
+// taken one at a time. Only used by one thread.
+class Uring {
+public:
+  explicit Uring(unsigned entries);
+  ~Uring();
+  Uring(Uring const &) = delete;
+  Uring &operator=(Uring const &) = delete;
+
+  bool ok() const { return _fd >= 0; }
+
+  // Registers `n` buffers of `size` bytes for fixed reads and writes.
+  // Returns false if the kernel refuses, for example because of
+  // RLIMIT_MEMLOCK, then the buffers are used unregistered.
+  bool registerBuffers(char *const *bufs, size_t n, size_t size);
+
+  // Submits one read or write, `bufIndex` is the registered buffer or -1.
+  // Returns false on errors, errno tells why.
+  bool submit(bool write, int fd, char const *buf, size_t size,
+              uint64_t offset, int bufIndex, uint64_t userData);
+
+  // Waits for the next completion, `result` is what read(2) or write(2)
+  // would return, or -errno. Returns false on errors, errno tells why.
+  bool wait(uint64_t &userData, int &result);
+
+private:
+  int _fd = -1;
+#ifdef GRAPHUTILS_IO_URING
+  void *_sqRing = MAP_FAILED;
+  void *_cqRing = MAP_FAILED;
+  size_t _sqRingSize = 0;
+  size_t _cqRingSize = 0;
+  void *_sqes = MAP_FAILED;
+  size_t _sqesSize = 0;
+  unsigned *_sqTail = nullptr;
+  unsigned *_sqMask = nullptr;
+  unsigned *_sqArray = nullptr;
+  unsigned *_cqHead = nullptr;
+  unsigned *_cqTail = nullptr;
+  unsigned *_cqMask = nullptr;
+  io_uring_cqe *_cqes = nullptr;
+#endif
+};
+
+#ifdef GRAPHUTILS_IO_URING
+
+Uring::Uring(unsigned entries) {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+  if (fd < 0) {
+    return;
+  }
+  _sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  _cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMmap) {
+    _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+  }
+  _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (_sqRing != MAP_FAILED) {
+    _cqRing = singleMmap ? _sqRing
+                         : mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+  }
+  if (_cqRing != MAP_FAILED) {
+    _sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    _sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  }
+  if (_sqes == MAP_FAILED) {
+    if (_cqRing != MAP_FAILED && _cqRing != _sqRing) {
+      munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != MAP_FAILED) {
+      munmap(_sqRing, _sqRingSize);
+    }
+    _sqRing = _cqRing = MAP_FAILED;
+    close(fd);
+    return;
+  }
+  char *sq = static_cast<char *>(_sqRing);
+  char *cq = static_cast<char *>(_cqRing);
+  _sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  _sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  _sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+  _cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+  _cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+  _cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+  _cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+  _fd = fd;
+}
+
+Uring::~Uring() {
+  if (_fd < 0) {
+    return;
+  }
+  munmap(_sqes, _sqesSize);
+  if (_cqRing != _sqRing) {
+    munmap(_cqRing, _cqRingSize);
+  }
+  munmap(_sqRing, _sqRingSize);
+  close(_fd);
+}
+
+bool Uring::registerBuffers(char *const *bufs, size_t n, size_t size) {
+  std::vector<iovec> iov(n);
+  for (size_t i = 0; i < n; ++i) {
+    iov[i].iov_base = bufs[i];
+    iov[i].iov_len = size;
+  }
+  return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS,
+                 iov.data(), static_cast<unsigned>(n)) == 0;
+}
+
+bool Uring::submit(bool write, int fd, char const *buf, size_t size,
+                   uint64_t offset, int bufIndex, uint64_t userData) {
+  // Only this thread moves the tail, the kernel moves the head:
+  unsigned tail = *_sqTail;
+  unsigned index = tail & *_sqMask;
+  io_uring_sqe *sqe = static_cast<io_uring_sqe *>(_sqes) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  if (bufIndex >= 0) {
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = static_cast<uint16_t>(bufIndex);
+  } else {
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = static_cast<uint32_t>(size);
+  sqe->off = offset;
+  sqe->user_data = userData;
+  _sqArray[index] = index;
+  __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+  while (true) {
+    long r = syscall(__NR_io_uring_enter, _fd, 1, 0, 0, nullptr, 0);
+    if (r >= 0) {
+      return true;
+    }
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool Uring::wait(uint64_t &userData, int &result) {
+  while (true) {
+    // Only this thread moves the head, the kernel moves the tail:
+    unsigned head = *_cqHead;
+    if (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe const &cqe = _cqes[head & *_cqMask];
+      userData = cqe.user_data;
+      result = cqe.res;
+      __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    long r = syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     nullptr, 0);
+    if (r < 0 && errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+#else
+
+Uring::Uring(unsigned) {}
+Uring::~Uring() {}
+bool Uring::registerBuffers(char *const *, size_t, size_t) { return false; }
+bool Uring::submit(bool, int, char const *, size_t, uint64_t, int, uint64_t) {
+  errno = ENOSYS;
+  return false;
+}
+bool Uring::wait(uint64_t &, int &) {
+  errno = ENOSYS;
+  return false;
+}
+
+#endif
+
+bool ioUringAvailable() {
+  static bool const available = Uring(1).ok();
+  return available;
+}
+
+namespace {
+
+char *allocBuffer(size_t size) {
+  char *buf = static_cast<char *>(malloc(size));
+  if (buf == nullptr) {
+    throw std::bad_alloc();
+  }
+  return buf;
+}
+
+// Collects the buffers of `slots` for Uring::registerBuffers:
+template <typename S> std::vector<char *> buffersOf(std::vector<S> &slots) {
+  std::vector<char *> bufs;
+  for (auto &s : slots) {
+    bufs.push_back(s.buf);
+  }
+  return bufs;
+}
+
+} // namespace
+
+ReadAhead::ReadAhead(int fd, uint64_t offset, size_t blockSize, size_t depth)
+    : _fd(fd), _blockSize(blockSize), _nextOffset(offset) {
+  if (depth == 0 || !ioUringAvailable()) {
+    return; // pread
+  }
+  auto ring = std::make_unique<Uring>(static_cast<unsigned>(depth));
+  if (!ring->ok()) {
+    return;
+  }
+  _slots.resize(depth);
+  for (auto &s : _slots) {
+    s.buf = allocBuffer(_blockSize);
+  }
+  _fixed = ring->registerBuffers(buffersOf(_slots).data(), depth, _blockSize);
+  _ring = std::move(ring);
+  for (size_t i = 0; i < _slots.size(); ++i) {
+    submit(i);
+  }
+}
+
+ReadAhead::~ReadAhead() {
+  // The kernel may still write into the buffers:
+  while (std::any_of(_slots.begin(), _slots.end(),
+                     [](Slot const &s) { return s.pending; }) &&
+         reap()) {
+  }
+  _ring.reset();
+  for (auto &s : _slots) {
+    free(s.buf);
+  }
+}
+
+void ReadAhead::submit(size_t slot) {
+  Slot &s = _slots[slot];
+  s.offset = _nextOffset;
+  s.size = s.pos = 0;
+  s.error = 0;
+  _nextOffset += _blockSize;
+  s.pending = _ring->submit(false, _fd, s.buf, _blockSize, s.offset,
+                            _fixed ? static_cast<int>(slot) : -1, slot);
+  if (!s.pending) {
+    s.error = errno;
+  }
+}
+
+bool ReadAhead::reap() {
+  uint64_t slot;
+  int result;
+  if (!_ring->wait(slot, result)) {
+    return false;
+  }
+  Slot &s = _slots[slot];
+  s.pending = false;
+  if (result < 0) {
+    s.error = -result;
+    return true;
+  }
+  s.size = static_cast<size_t>(result);
+  // A short read which is not at the end of the file is completed here,
+  // so that the blocks stay contiguous:
+  while (s.size > 0 && s.size < _blockSize) {
+    ssize_t n = ::pread(_fd, s.buf + s.size, _blockSize - s.size,
+                        static_cast<off_t>(s.offset + s.size));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      s.error = errno;
+    }
+    if (n <= 0) {
+      break;
+    }
+    s.size += n;
+  }
+  return true;
+}
+
+ssize_t ReadAhead::read(char *buf, size_t size) {
+  if (_ring == nullptr) {
+    while (true) {
+      ssize_t n = ::pread(_fd, buf, size, static_cast<off_t>(_nextOffset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n > 0) {
+        _nextOffset += n;
+      }
+      return n;
+    }
+  }
+  Slot &s = _slots[_current];
+  while (s.pending) {
+    if (!reap()) {
+      return -1;
+    }
+  }
+  if (s.error != 0) {
+    errno = s.error;
+    return -1;
+  }
+  if (s.size == 0) {
+    return 0; // end of the file, the following slots are empty, too
+  }
+  size_t n = std::min(size, s.size - s.pos);
+  memcpy(buf, s.buf + s.pos, n);
+  s.pos += n;
+  if (s.pos == s.size) {
+    if (s.size == _blockSize) {
+      submit(_current);
+    } else {
+      s.size = s.pos = 0; // the file ends behind this block
+      return static_cast<ssize_t>(n);
+    }
+    _current = (_current + 1) % _slots.size();
+  }
+  return static_cast<ssize_t>(n);
+}
+
+void ReadAhead::restart(uint64_t offset) {
+  _nextOffset = offset;
+  if (_ring == nullptr) {
+    return;
+  }
+  while (std::any_of(_slots.begin(), _slots.end(),
+                     [](Slot const &s) { return s.pending; })) {
+    if (!reap()) {
+      return;
+    }
+  }
+  _current = 0;
+  for (size_t i = 0; i < _slots.size(); ++i) {
+    submit(i);
+  }
+}
+
+WriteBehind::WriteBehind(int fd, uint64_t offset, size_t blockSize,
+                         size_t depth)
+    : _fd(fd), _blockSize(blockSize), _offset(offset) {
+  if (depth == 0 || !ioUringAvailable()) {
+    return; // pwrite
+  }
+  auto ring = std::make_unique<Uring>(static_cast<unsigned>(depth));
+  if (!ring->ok()) {
+    return;
+  }
+  _slots.resize(depth);
+  for (size_t i = 0; i < depth; ++i) {
+    _slots[i].buf = allocBuffer(_blockSize);
+    _free.push_back(i);
+  }
+  _fixed = ring->registerBuffers(buffersOf(_slots).data(), depth, _blockSize);
+  _ring = std::move(ring);
+}
+
+WriteBehind::~WriteBehind() {
+  finish();
+  _ring.reset();
+  for (auto &s : _slots) {
+    free(s.buf);
+  }
+}
+
+bool WriteBehind::reap() {
+  uint64_t slot;
+  int result;
+  if (!_ring->wait(slot, result)) {
+    _failed = true;
+    _errno = errno;
+    return false;
+  }
+  Slot &s = _slots[slot];
+  s.pending = false;
+  _free.push_back(slot);
+  if (result < 0) {
+    if (!_failed) {
+      _failed = true;
+      _errno = -result;
+    }
+  } else if (static_cast<size_t>(result) < s.size) {
+    // Short write, the rest goes out right away:
+    if (!writeAll(_fd, s.buf + result, s.size - result,
+                  static_cast<long long>(s.offset + result)) &&
+        !_failed) {
+      _failed = true;
+      _errno = errno;
+    }
+  }
+  return true;
+}
+
+bool WriteBehind::write(char const *data, size_t size) {
+  if (!_failed && _ring == nullptr) {
+    if (writeAll(_fd, data, size, static_cast<long long>(_offset))) {
+      _offset += size;
+    } else {
+      _failed = true;
+      _errno = errno;
+    }
+  }
+  while (!_failed && size > 0 && _ring != nullptr) {
+    if (_free.empty()) {
+      if (!reap()) {
+        break;
+      }
+      continue;
+    }
+    size_t i = _free.back();
+    _free.pop_back();
+    Slot &s = _slots[i];
+    s.size = std::min(size, _blockSize);
+    s.offset = _offset;
+    memcpy(s.buf, data, s.size);
+    s.pending = _ring->submit(true, _fd, s.buf, s.size, s.offset,
+                              _fixed ? static_cast<int>(i) : -1, i);
+    if (!s.pending) {
+      _free.push_back(i);
+      _failed = true;
+      _errno = errno;
+      break;
+    }
+    _offset += s.size;
+    data += s.size;
+    size -= s.size;
+  }
+  if (_failed) {
+    errno = _errno;
+  }
+  return !_failed;
+}
+
+bool WriteBehind::finish() {
+  while (_free.size() < _slots.size()) {
+    if (!reap()) {
+      break;
+    }
+  }
+  if (_failed) {
+    errno = _errno;
+  }
+  return !_failed;
+}
@@ -0,0 +1,101 @@
+// AsyncIO.h - reading ahead and writing behind with several large requests
+// in flight per file, with io_uring if the kernel offers it and with pread
+// and pwrite otherwise
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+class Uring;
+
+// True if io_uring can be used, it can be missing in the kernel or
+// forbidden by seccomp. Checked once.
+bool ioUringAvailable();
+
+// Reads a regular file sequentially from `offset` in blocks of `blockSize`,
+// with `depth` reads in flight, into buffers registered with the kernel.
+// Without io_uring every read() is a pread().
+class ReadAhead {
+public:
+  ReadAhead(int fd, uint64_t offset, size_t blockSize, size_t depth);
+  ~ReadAhead();
+  ReadAhead(ReadAhead const &) = delete;
+  ReadAhead &operator=(ReadAhead const &) = delete;
+
+  // Like read(2), copies up to `size` bytes into `buf`. Returns the number
+  // of bytes, 0 at the end of the file and -1 on errors, errno tells why.
+  ssize_t read(char *buf, size_t size);
+
+  // Drops what was read ahead and continues at `offset`:
+  void restart(uint64_t offset);
+
+  bool usesIoUring() const { return _ring != nullptr; }
+
+private:
+  struct Slot {
+    char *buf = nullptr;
+    size_t size = 0; // bytes read into buf
+    size_t pos = 0;  // bytes already returned by read()
+    uint64_t offset = 0;
+    bool pending = false;
+    int error = 0;
+  };
+
+  void submit(size_t slot);
+  // Waits for one completion, returns false on errors of io_uring itself:
+  bool reap();
+
+  int _fd;
+  size_t _blockSize;
+  uint64_t _nextOffset; // where the next submitted read starts
+  size_t _current = 0;  // slot read() takes data from
+  std::vector<Slot> _slots;
+  bool _fixed = false; // buffers registered
+  std::unique_ptr<Uring> _ring;
+};
+
+// Writes a file sequentially from `offset` with up to `depth` writes of at
+// most `blockSize` bytes in flight. write() copies the data and returns
+// before it is written. Without io_uring every write() is a pwrite().
+class WriteBehind {
+public:
+  WriteBehind(int fd, uint64_t offset, size_t blockSize, size_t depth);
+  ~WriteBehind();
+  WriteBehind(WriteBehind const &) = delete;
+  WriteBehind &operator=(WriteBehind const &) = delete;
+
+  // Returns false if this or an earlier write failed, errno tells why.
+  bool write(char const *data, size_t size);
+
+  // Waits until everything is written. Returns false on errors, errno
+  // tells why.
+  bool finish();
+
+  bool usesIoUring() const { return _ring != nullptr; }
+
+private:
+  struct Slot {
+    char *buf = nullptr;
+    size_t size = 0;
+    uint64_t offset = 0;
+    bool pending = false;
+  };
+
+  // Waits for one completion and frees its slot, returns false on errors
+  // of io_uring itself:
+  bool reap();
+
+  int _fd;
+  size_t _blockSize;
+  uint64_t _offset; // where the next write goes
+  std::vector<Slot> _slots;
+  std::vector<size_t> _free; // slots without a pending write
+  bool _fixed = false; // buffers registered
+  bool _failed = false;
+  int _errno = 0;
+  std::unique_ptr<Uring> _ring;
+};
@@ -0,0 +1,479 @@
+// BlockIO.cpp - input and output in large blocks
+
+#include "BlockIO.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "AsyncIO.h"
+#include "Compression.h"
+#include "Kernels.h"
+
+BlockWriter::BlockWriter() : _fd(-1), _capacity(1 << 16) {
+  _buf = static_cast<char *>(malloc(_capacity));
+  if (_buf == nullptr) {
+    throw std::bad_alloc();
+  }
+}
+
+BlockWriter::BlockWriter(int fd, size_t capacity)
+    : _fd(fd), _capacity(capacity) {
+  _buf = static_cast<char *>(malloc(_capacity));
+  if (_buf == nullptr) {
+    throw std::bad_alloc();
+  }
+}
+
+BlockWriter::~BlockWriter() { free(_buf); }
+
+void BlockWriter::makeRoom(size_t n) {
+  if (_fd >= 0) {
+    flush();
+    if (n <= _capacity) {
+      return;
+    }
+  }
+  size_t capacity = _capacity;
+  while (_size + n > capacity) {
+    capacity *= 2;
+  }
+  char *buf = static_cast<char *>(realloc(_buf, capacity));
+  if (buf == nullptr) {
+    throw std::bad_alloc();
+  }
+  _buf = buf;
+  _capacity = capacity;
+}
+
+bool BlockWriter::flush() {
+  if (_fd >= 0 && _size > 0) {
+    if (_digest != nullptr) {
+      _digest->update(_buf, _size);
+    }
+    if (!_failed) {
+      bool ok = _compressor != nullptr    ? _compressor->write(_buf, _size)
+                : _writeBehind != nullptr ? _writeBehind->write(_buf, _size)
+                                          : writeAll(_fd, _buf, _size);
+      if (!ok) {
+        _failed = true;
+        _errno = errno;
+      }
+    }
+    _size = 0;
+  }
+  if (_failed) {
+    errno = _errno;
+  }
+  return !_failed;
+}
+
+bool writeAll(int fd, char const *data, size_t size, long long offset) {
+  while (size > 0) {
+    ssize_t n = offset < 0 ? ::write(fd, data, size)
+                           : ::pwrite(fd, data, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return false;
+    }
+    data += n;
+    size -= n;
+    if (offset >= 0) {
+      offset += n;
+    }
+  }
+  return true;
+}
+
+OrderedWriter::OrderedWriter(int fd, uint64_t offset, uint64_t sizeHint)
+    : _fd(fd), _end(offset), _allocated(offset) {
+  if (sizeHint > 0) {
+    if (fallocate(_fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                  static_cast<off_t>(sizeHint)) == 0) {
+      _allocated = offset + sizeHint;
+    } else {
+      _preallocate = false; // not supported by the file system
+    }
+  }
+}
+
+OrderedWriter::OrderedWriter(BlockWriter &stream)
+    : _stream(&stream), _end(0), _allocated(0), _preallocate(false) {}
+
+void OrderedWriter::fail(int error) {
+  int expected = 0;
+  _errno.compare_exchange_strong(expected, error);
+  _failed.store(true);
+}
+
+uint64_t OrderedWriter::place(std::string_view data) {
+  uint64_t offset = _end;
+  _end += data.size();
+  if (_stream != nullptr) {
+    _stream->append(data);
+  } else if (_preallocate && _end > _allocated) {
+    // Stay well ahead, so that the file system can allocate large extents:
+    uint64_t upTo = std::max(_end, _allocated + (uint64_t(64) << 20));
+    if (fallocate(_fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(_allocated),
+                  static_cast<off_t>(upTo - _allocated)) == 0) {
+      _allocated = upTo;
+    } else {
+      _preallocate = false;
+    }
+  }
+  _turn.store(_turn.load() + 1);
+  return offset;
+}
+
+bool OrderedWriter::write(uint64_t seq, std::string_view data) {
+  uint64_t offset = 0;
+  bool placed = false;
+  // Chunks which were waiting for this one, with their offsets:
+  std::vector<std::pair<uint64_t, std::string>> ready;
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (seq != _turn.load()) {
+      _waiting.emplace(seq, std::string(data));
+    } else {
+      offset = place(data);
+      placed = true;
+      for (auto it = _waiting.begin();
+           it != _waiting.end() && it->first == _turn.load();
+           it = _waiting.erase(it)) {
+        uint64_t o = place(it->second);
+        ready.emplace_back(o, std::move(it->second));
+      }
+    }
+  }
+  if (_stream == nullptr && placed) {
+    if (!_failed.load() && !writeAll(_fd, data.data(), data.size(),
+                                     static_cast<long long>(offset))) {
+      fail(errno);
+    }
+    for (auto const &r : ready) {
+      if (!_failed.load() &&
+          !writeAll(_fd, r.second.data(), r.second.size(),
+                    static_cast<long long>(r.first))) {
+        fail(errno);
+      }
+    }
+  }
+  if (_failed.load()) {
+    errno = _errno.load();
+    return false;
+  }
+  return true;
+}
+
+bool OrderedWriter::finish() {
+  if (_stream == nullptr && _allocated > _end && !_failed.load() &&
+      ftruncate(_fd, static_cast<off_t>(_end)) != 0) {
+    fail(errno);
+  }
+  if (_failed.load()) {
+    errno = _errno.load();
+    return false;
+  }
+  return true;
+}
+
+BlockReader::BlockReader(int fd, size_t capacity)
+    : _fd(fd), _capacity(capacity) {
+  _buf = static_cast<char *>(malloc(_capacity));
+  if (_buf == nullptr) {
+    throw std::bad_alloc();
+  }
+}
+
+BlockReader::~BlockReader() {
+  free(_buf);
+  free(_raw);
+}
+
+ssize_t BlockReader::readRaw(char *buf, size_t size) {
+  while (true) {
+    ssize_t n = _readAhead != nullptr ? _readAhead->read(buf, size)
+                                      : ::read(_fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      _failed = true;
+      _error = strerror(errno);
+      return -1;
+    }
+    _rawOffset += n;
+    return n;
+  }
+}
+
+bool BlockReader::fill() {
+  _offset += _end;
+  _pos = _end = 0;
+  if (!_started) {
+    // Look at the magic bytes of the input:
+    _started = true;
+    struct stat st;
+    if (_readAheadDepth > 0 && fstat(_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      off_t start = std::max<off_t>(::lseek(_fd, 0, SEEK_CUR), 0);
+      // A block-indexed file which is decompressed on several threads is
+      // read by the ParallelDecompressor, so no reads are put in flight
+      // for it:
+      char magic[18];
+      ssize_t m = ::pread(_fd, magic, sizeof(magic), start);
+      _codec = detectCodec(magic, m > 0 ? m : 0);
+      if (_codec == Codec::Zstd && hasSeekTable(_fd)) {
+        _codec = Codec::ZstdSeekable;
+      }
+      if (_threads == 0 || !codecIndexed(_codec) || !loadIndex()) {
+        _readAhead = std::make_unique<ReadAhead>(
+            _fd, start, readAheadBlockSize, _readAheadDepth);
+      }
+    }
+    size_t n = 0;
+    while (n < 18) { // enough to recognize BGZF
+      ssize_t r = readRaw(_buf + n, _capacity - n);
+      if (r < 0) {
+        return false;
+      }
+      if (r == 0) {
+        break;
+      }
+      n += r;
+    }
+    Codec codec = detectCodec(_buf, n);
+    if (codec == Codec::Zstd && hasSeekTable(_fd)) {
+      codec = Codec::ZstdSeekable;
+    }
+    _codec = codec;
+    if (codec == Codec::None) {
+      _end = n;
+      return n > 0;
+    }
+    if (!codecSupported(codec)) {
+      _failed = true;
+      _error = std::string("input is compressed with ") + codecName(codec) +
+               ", which is not supported by this build";
+      return false;
+    }
+    if (_threads > 0 && codecIndexed(codec) && loadIndex()) {
+      // The parallel decompression reads the file by itself:
+      _parallel = std::make_unique<ParallelDecompressor>(_fd, codec, *_index,
+                                                         0, _threads);
+      _rawOffset = 0;
+    } else {
+      _decompressor = Decompressor::create(codec);
+      _raw = static_cast<char *>(malloc(_capacity));
+      if (_raw == nullptr) {
+        throw std::bad_alloc();
+      }
+      memcpy(_raw, _buf, n);
+      _rawEnd = n;
+    }
+  }
+  if (_parallel != nullptr) {
+    return fillParallel();
+  }
+  if (_decompressor == nullptr) {
+    ssize_t n = readRaw(_buf, _capacity);
+    _end = n > 0 ? n : 0;
+    return n > 0;
+  }
+  while (_end == 0) {
+    if (_rawPos == _rawEnd) {
+      if (_rawEof) {
+        if (!_decompressor->atBoundary()) {
+          _failed = true;
+          _error = "compressed input is truncated";
+        }
+        return false;
+      }
+      ssize_t n = readRaw(_raw, _capacity);
+      if (n < 0) {
+        return false;
+      }
+      _rawPos = 0;
+      _rawEnd = n;
+      _rawEof = n == 0;
+      continue;
+    }
+    char const *in = _raw + _rawPos;
+    size_t inSize = _rawEnd - _rawPos;
+    char *out = _buf;
+    size_t outSize = _capacity;
+    std::string error = _decompressor->decompress(in, inSize, out, outSize);
+    if (!error.empty()) {
+      _failed = true;
+      _error = error;
+      return false;
+    }
+    _rawPos = in - _raw;
+    _end = out - _buf;
+  }
+  return true;
+}
+
+bool BlockReader::getLine(std::string &line) {
+  line.clear();
+  bool any = false;
+  while (true) {
+    if (_pos == _end && !fill()) {
+      return any;
+    }
+    any = true;
+    char const *start = _buf + _pos;
+    char const *nl =
+        static_cast<char const *>(memchr(start, '\n', _end - _pos));
+    if (nl != nullptr) {
+      line.append(start, nl - start);
+      _pos = nl - _buf + 1;
+      return true;
+    }
+    line.append(start, _end - _pos);
+    _pos = _end;
+  }
+}
+
+bool BlockReader::fillParallel() {
+  std::string data;
+  uint64_t fileOffset;
+  while (data.empty()) { // empty blocks are skipped
+    if (!_parallel->next(data, fileOffset)) {
+      if (!_parallel->error().empty()) {
+        _failed = true;
+        _error = _parallel->error();
+      }
+      return false;
+    }
+  }
+  if (data.size() > _capacity) {
+    char *buf = static_cast<char *>(realloc(_buf, data.size()));
+    if (buf == nullptr) {
+      throw std::bad_alloc();
+    }
+    _buf = buf;
+    _capacity = data.size();
+  }
+  memcpy(_buf, data.data(), data.size());
+  _end = data.size();
+  _rawOffset = fileOffset;
+  return true;
+}
+
+bool BlockReader::loadIndex() {
+  if (!_indexLoaded) {
+    _indexLoaded = true;
+    auto index = std::make_unique<BlockIndex>();
+    if (readBlockIndex(_fd, _codec, *index).empty()) {
+      _index = std::move(index);
+    }
+  }
+  return _index != nullptr;
+}
+
+Codec BlockReader::codec() {
+  if (!_started) {
+    fill();
+  }
+  return _codec;
+}
+
+bool BlockReader::seek(uint64_t offset) {
+  if (!_started) {
+    fill(); // detects compression
+  }
+  if (codecIndexed(_codec) && loadIndex()) {
+    // Restart the decompression at the block which contains `offset`:
+    size_t b = _index->blockOf(offset);
+    _parallel.reset();
+    if (_threads > 0) {
+      _parallel = std::make_unique<ParallelDecompressor>(_fd, _codec, *_index,
+                                                         b, _threads);
+    } else {
+      if (!seekRaw(_index->compressed[b])) {
+        return false;
+      }
+      _decompressor = Decompressor::create(_codec);
+      if (_raw == nullptr) {
+        _raw = static_cast<char *>(malloc(_capacity));
+        if (_raw == nullptr) {
+          throw std::bad_alloc();
+        }
+      }
+      _rawPos = _rawEnd = 0;
+      _rawEof = false;
+    }
+    _rawOffset = _index->compressed[b];
+    _offset = _index->uncompressed[b];
+    _pos = _end = 0;
+    uint64_t skip = offset > _offset ? offset - _offset : 0;
+    while (skip > 0 && fill()) {
+      _pos = static_cast<size_t>(std::min<uint64_t>(skip, _end));
+      skip -= _pos;
+    }
+    return !_failed;
+  }
+  if (_codec != Codec::None) {
+    _failed = true;
+    _error = std::string("cannot seek in input compressed with ") +
+             codecName(_codec) + ", only in bgzf or zstd-seekable";
+    return false;
+  }
+  if (!seekRaw(offset)) {
+    return false;
+  }
+  _offset = offset;
+  _rawOffset = offset;
+  _pos = _end = 0;
+  return true;
+}
+
+bool BlockReader::seekRaw(uint64_t offset) {
+  if (_readAhead != nullptr) {
+    _readAhead->restart(offset);
+    return true;
+  }
+  if (::lseek(_fd, static_cast<off_t>(offset), SEEK_SET) < 0) {
+    _failed = true;
+    _error = strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool BlockReader::dataSize(uint64_t &size) {
+  if (!_started) {
+    fill();
+  }
+  if (_codec == Codec::None) {
+    struct stat st;
+    if (fstat(_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      size = st.st_size;
+      return true;
+    }
+    _failed = true;
+    _error = "input is not a regular file";
+    return false;
+  }
+  if (codecIndexed(_codec) && loadIndex()) {
+    size = _index->uncompressed.back();
+    return true;
+  }
+  _failed = true;
+  _error = std::string("the size of input compressed with ") +
+           codecName(_codec) + " is unknown, only bgzf or zstd-seekable work";
+  return false;
+}
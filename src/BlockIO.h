@@ -0,0 +1,267 @@
+// BlockIO.h - input and output in large blocks: lines are formatted into
+// one big buffer, numbers with std::to_chars, and the buffer goes out with
+// write(); input is read with read() and cut into lines in the buffer
+
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <type_traits>
+
+class BlockCompressor;
+struct BlockIndex;
+enum class Codec;
+class Decompressor;
+class ParallelDecompressor;
+class ReadAhead;
+class Sha1Stream;
+class WriteBehind;
+
+class BlockWriter {
+public:
+  // Compressed output is cut into blocks of this size, and asynchronous
+  // writes have this size:
+  static constexpr size_t defaultCapacity = 4 << 20;
+  // Enough for plain output, which is written with write() directly. The
+  // buffers of open files are not counted against `--memory`:
+  static constexpr size_t plainCapacity = 256 << 10;
+
+  // Collects everything in memory, the buffer grows as needed.
+  BlockWriter();
+  // Writes to `fd` whenever the buffer is full and on flush(). The file
+  // descriptor is not closed.
+  explicit BlockWriter(int fd, size_t capacity = defaultCapacity);
+  ~BlockWriter();
+  BlockWriter(BlockWriter const &) = delete;
+  BlockWriter &operator=(BlockWriter const &) = delete;
+
+  void append(std::string_view s) {
+    if (_size + s.size() > _capacity) {
+      makeRoom(s.size());
+    }
+    memcpy(_buf + _size, s.data(), s.size());
+    _size += s.size();
+  }
+
+  void append(char c) {
+    if (_size + 1 > _capacity) {
+      makeRoom(1);
+    }
+    _buf[_size++] = c;
+  }
+
+  template <typename T>
+  std::enable_if_t<std::is_integral_v<T>> appendNumber(T v) {
+    constexpr size_t maxDigits = 24;
+    if (_size + maxDigits > _capacity) {
+      makeRoom(maxDigits);
+    }
+    _size = std::to_chars(_buf + _size, _buf + _size + maxDigits, v).ptr - _buf;
+  }
+
+  // Writes the buffer to the file descriptor. Returns false if this or an
+  // earlier write failed, errno tells why.
+  bool flush();
+
+  // Everything flushed from now on is also fed into `digest`:
+  void hashInto(Sha1Stream *digest) { _digest = digest; }
+
+  // Everything flushed from now on goes to `compressor` instead of the
+  // file descriptor, which must be the one of the compressor. The digest
+  // sees the uncompressed data.
+  void compressInto(BlockCompressor *compressor) { _compressor = compressor; }
+
+  // Everything flushed from now on goes to `writer`, which writes to the
+  // same file descriptor asynchronously:
+  void writeBehind(WriteBehind *writer) { _writeBehind = writer; }
+
+  char const *data() const { return _buf; }
+  size_t size() const { return _size; }
+  void clear() { _size = 0; }
+
+private:
+  void makeRoom(size_t n);
+
+  int _fd;
+  char *_buf;
+  size_t _size = 0;
+  size_t _capacity;
+  bool _failed = false;
+  Sha1Stream *_digest = nullptr;
+  BlockCompressor *_compressor = nullptr;
+  WriteBehind *_writeBehind = nullptr;
+  int _errno = 0;
+};
+
+// Writes all of `data` to `fd` (at `offset` if it is not negative), retrying
+// on short writes and EINTR. Returns false on errors.
+bool writeAll(int fd, char const *data, size_t size, long long offset = -1);
+
+// Puts chunks which are formatted on several threads into the output in
+// the order of their sequence numbers 0, 1, 2, ... without a writer thread.
+// A prefix sum of the chunk sizes gives the offset of every chunk in the
+// file as soon as all chunks before it have arrived, then it is written
+// with pwrite() while other chunks are written at the same time into a
+// file which is preallocated with fallocate() ahead of the writes. Where
+// this is not possible (compression, pipes) the chunks are appended to a
+// BlockWriter in order.
+class OrderedWriter {
+public:
+  // Writes to the regular file `fd` from `offset` on, `sizeHint` is the
+  // expected number of bytes to preallocate.
+  OrderedWriter(int fd, uint64_t offset, uint64_t sizeHint);
+  // Appends to `stream`:
+  explicit OrderedWriter(BlockWriter &stream);
+  OrderedWriter(OrderedWriter const &) = delete;
+  OrderedWriter &operator=(OrderedWriter const &) = delete;
+
+  // Writes chunk `seq` and never waits for other chunks: if one before it
+  // is missing, the chunk is kept until that arrives and is written by the
+  // thread which brings it. Every sequence number must be written exactly
+  // once, even if the chunk is empty. Returns false if this or an earlier
+  // write failed, errno tells why. Thread-safe.
+  bool write(uint64_t seq, std::string_view data);
+
+  // The number of chunks which have their place in the output:
+  uint64_t placed() const { return _turn.load(); }
+
+  // Gives back what was preallocated behind the end, after all writes.
+  // Returns false on errors, errno tells why.
+  bool finish();
+
+private:
+  // Gives `data` the next offset and returns it, needs the mutex:
+  uint64_t place(std::string_view data);
+  void fail(int error);
+
+  int _fd = -1;
+  BlockWriter *_stream = nullptr;
+  std::mutex _mutex;
+  std::map<uint64_t, std::string> _waiting; // chunks which came too early
+  std::atomic<uint64_t> _turn{0};           // the next chunk to be placed
+  uint64_t _end;                            // end of the placed chunks
+  uint64_t _allocated;                      // preallocated up to here
+  bool _preallocate = true;
+  std::atomic<bool> _failed{false};
+  std::atomic<int> _errno{0};
+};
+
+class BlockReader {
+public:
+  // The buffers of open files are not counted against `--memory`, and
+  // read() calls of this size cost nothing next to the parsing:
+  static constexpr size_t defaultCapacity = 256 << 10;
+  // The size of the reads in flight with setReadAhead():
+  static constexpr size_t readAheadBlockSize = 4 << 20;
+
+  // Reads from `fd`, which can be a pipe. The file descriptor is not closed.
+  // Input compressed with gzip or zstd is decompressed on the fly.
+  explicit BlockReader(int fd, size_t capacity = defaultCapacity);
+  ~BlockReader();
+  BlockReader(BlockReader const &) = delete;
+  BlockReader &operator=(BlockReader const &) = delete;
+
+  // Input in a block-indexed format (BGZF, seekable zstd) from a regular
+  // file is decompressed on `threads` threads ahead of the reader, with 0
+  // it is decompressed while reading. Only before the first read.
+  void setThreads(size_t threads) { _threads = threads; }
+
+  // A regular file is read with `depth` reads of readAheadBlockSize in flight
+  // (see ReadAhead), with 0 it is read with read(). Only before the first
+  // read.
+  void setReadAhead(size_t depth) { _readAheadDepth = depth; }
+
+  // Reads the next line into `line`, without the '\n'. A last line without
+  // '\n' counts as well. Returns false at the end of the input and on
+  // errors, failed() tells the two apart.
+  bool getLine(std::string &line);
+
+  // Offset of the next line in the (decompressed) input:
+  uint64_t offset() const { return _offset + _pos; }
+
+  // How far the file has been read, in bytes of the file, for progress
+  // reports. Without compression this is offset().
+  uint64_t fileOffset() const {
+    if (_parallel) {
+      return _rawOffset;
+    }
+    return _decompressor ? _rawOffset - (_rawEnd - _rawPos) : offset();
+  }
+
+  // Continues reading at `offset` (of the decompressed input), only for
+  // regular files which are uncompressed or block-indexed. Returns false on
+  // errors.
+  bool seek(uint64_t offset);
+
+  // The size of the decompressed input, only for regular files which are
+  // uncompressed or block-indexed. Returns false on errors.
+  bool dataSize(uint64_t &size);
+
+  // The codec of the input, reads the first block if that has not yet
+  // happened:
+  Codec codec();
+
+  // Returns the rest of the current block and consumes it, an empty view
+  // at the end of the input:
+  std::string_view readBlock() {
+    if (_pos == _end && !fill()) {
+      return {};
+    }
+    std::string_view block(_buf + _pos, _end - _pos);
+    _pos = _end;
+    return block;
+  }
+
+  bool failed() const { return _failed; }
+
+  // What went wrong if failed():
+  std::string const &error() const { return _error; }
+
+private:
+  // Reads the next block behind the buffered data, returns false if there
+  // is none.
+  bool fill();
+  // Reads the next block of the file into _buf or, with compression, into
+  // _raw. Returns the number of bytes, 0 at the end and -1 on errors.
+  ssize_t readRaw(char *buf, size_t size);
+  // Takes the next piece from the ParallelDecompressor:
+  bool fillParallel();
+  // Reads the block index once, returns false if there is none:
+  bool loadIndex();
+  // Moves the file position to `offset`, returns false on errors:
+  bool seekRaw(uint64_t offset);
+
+  int _fd;
+  char *_buf;
+  size_t _pos = 0;      // next unread byte in _buf
+  size_t _end = 0;      // end of the data in _buf
+  size_t _capacity;
+  uint64_t _offset = 0; // offset of _buf[0] in the input
+  bool _started = false; // the codec is detected at the first read
+  Codec _codec{};
+  bool _failed = false;
+  std::string _error;
+  // Only for compressed input, the compressed data:
+  std::unique_ptr<Decompressor> _decompressor;
+  char *_raw = nullptr;
+  size_t _rawPos = 0;
+  size_t _rawEnd = 0;
+  uint64_t _rawOffset = 0; // bytes read from the file
+  bool _rawEof = false;
+  size_t _readAheadDepth = 0;
+  std::unique_ptr<ReadAhead> _readAhead;
+  // Only for block-indexed input:
+  size_t _threads = 0;
+  bool _indexLoaded = false;
+  std::unique_ptr<BlockIndex> _index;
+  std::unique_ptr<ParallelDecompressor> _parallel;
+};
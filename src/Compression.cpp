@@ -0,0 +1,640 @@
+// Compression.cpp - gzip and zstd for the input and output files
+
+#include "Compression.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef GRAPHUTILS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "BlockIO.h"
+
+char const *codecName(Codec codec) {
+  switch (codec) {
+  case Codec::Gzip:
+    return "gzip";
+  case Codec::Bgzf:
+    return "bgzf";
+  case Codec::Zstd:
+    return "zstd";
+  case Codec::ZstdSeekable:
+    return "zstd-seekable";
+  case Codec::None:
+  default:
+    return "none";
+  }
+}
+
+bool parseCodec(std::string const &name, Codec &codec) {
+  if (name == "none") {
+    codec = Codec::None;
+  } else if (name == "gzip") {
+    codec = Codec::Gzip;
+  } else if (name == "bgzf") {
+    codec = Codec::Bgzf;
+  } else if (name == "zstd") {
+    codec = Codec::Zstd;
+  } else if (name == "zstd-seekable") {
+    codec = Codec::ZstdSeekable;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool codecSupported(Codec codec) {
+#ifdef GRAPHUTILS_ZSTD
+  return true;
+#else
+  return codec != Codec::Zstd && codec != Codec::ZstdSeekable;
+#endif
+}
+
+namespace {
+
+// BGZF: a gzip member with the extra subfield "BC", which holds the size
+// of the member minus 1. The input of a member is limited so that the
+// member stays below 64 KiB even if the data does not compress.
+constexpr size_t bgzfHeaderSize = 18;
+constexpr size_t bgzfTrailerSize = 8;
+constexpr size_t bgzfMaxInput = 0xff00;
+constexpr unsigned char bgzfEof[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// Seekable zstd: the seek table is a skippable frame, the last 9 bytes are
+// the number of frames, a descriptor and the seekable magic number.
+constexpr uint32_t skippableMagic = 0x184D2A5E;
+constexpr uint32_t seekableMagic = 0x8F92EAB1;
+constexpr size_t seekTableFooterSize = 9;
+
+uint32_t readLE32(unsigned char const *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void appendLE32(std::string &out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  }
+}
+
+bool isBgzfHeader(unsigned char const *p, size_t size) {
+  return size >= bgzfHeaderSize && p[0] == 0x1f && p[1] == 0x8b &&
+         (p[3] & 4) != 0 && p[10] == 6 && p[11] == 0 && p[12] == 'B' &&
+         p[13] == 'C' && p[14] == 2 && p[15] == 0;
+}
+
+bool preadAll(int fd, void *buf, size_t size, uint64_t offset) {
+  auto *p = static_cast<char *>(buf);
+  while (size > 0) {
+    ssize_t n = ::pread(fd, p, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool endsWith(std::string const &s, char const *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+} // namespace
+
+Codec codecForFileName(std::string const &fileName) {
+  if (endsWith(fileName, ".gz")) {
+    return Codec::Bgzf;
+  }
+  if (endsWith(fileName, ".zst")) {
+    return Codec::ZstdSeekable;
+  }
+  return Codec::None;
+}
+
+Codec detectCodec(char const *data, size_t size) {
+  auto const *p = reinterpret_cast<unsigned char const *>(data);
+  if (isBgzfHeader(p, size)) {
+    return Codec::Bgzf;
+  }
+  if (size >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+    return Codec::Gzip;
+  }
+  // A zstd frame or a skippable frame, 0x184D2A5?, little endian:
+  if (size >= 4 && p[1] == 0x2a && p[2] == 0x4d && p[3] == 0x18 &&
+      (p[0] & 0xf0) == 0x50) {
+    return Codec::Zstd;
+  }
+  if (size >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f &&
+      p[3] == 0xfd) {
+    return Codec::Zstd;
+  }
+  return Codec::None;
+}
+
+bool hasSeekTable(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      static_cast<uint64_t>(st.st_size) < seekTableFooterSize) {
+    return false;
+  }
+  unsigned char footer[seekTableFooterSize];
+  return preadAll(fd, footer, sizeof(footer),
+                  st.st_size - seekTableFooterSize) &&
+         readLE32(footer + 5) == seekableMagic;
+}
+
+size_t BlockIndex::blockOf(uint64_t offset) const {
+  // The last block which starts at or before `offset`:
+  size_t b = std::upper_bound(uncompressed.begin(), uncompressed.end(),
+                              offset) -
+             uncompressed.begin();
+  return b == 0 ? 0 : std::min(b - 1, nrBlocks());
+}
+
+std::string readBlockIndex(int fd, Codec codec, BlockIndex &index) {
+  index.compressed.assign(1, 0);
+  index.uncompressed.assign(1, 0);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return "not a regular file";
+  }
+  uint64_t fileSize = st.st_size;
+  if (codec == Codec::Bgzf) {
+    uint64_t pos = 0;
+    while (pos < fileSize) {
+      unsigned char header[bgzfHeaderSize];
+      unsigned char size[4];
+      if (!preadAll(fd, header, sizeof(header), pos) ||
+          !isBgzfHeader(header, sizeof(header))) {
+        return "not a BGZF block at offset " + std::to_string(pos);
+      }
+      uint64_t blockSize = (header[16] | (header[17] << 8)) + 1;
+      if (!preadAll(fd, size, sizeof(size), pos + blockSize - 4)) {
+        return "truncated BGZF block at offset " + std::to_string(pos);
+      }
+      pos += blockSize;
+      index.compressed.push_back(pos);
+      index.uncompressed.push_back(index.uncompressed.back() +
+                                   readLE32(size));
+    }
+    return "";
+  }
+  if (codec == Codec::ZstdSeekable) {
+    unsigned char footer[seekTableFooterSize];
+    if (fileSize < seekTableFooterSize ||
+        !preadAll(fd, footer, sizeof(footer), fileSize - sizeof(footer)) ||
+        readLE32(footer + 5) != seekableMagic) {
+      return "no seek table";
+    }
+    uint64_t nrFrames = readLE32(footer);
+    size_t entrySize = (footer[4] & 0x80) != 0 ? 12 : 8;
+    uint64_t tableSize = nrFrames * entrySize;
+    if (fileSize < tableSize + seekTableFooterSize + 8) {
+      return "seek table is larger than the file";
+    }
+    uint64_t tableStart = fileSize - seekTableFooterSize - tableSize;
+    std::string table(tableSize + 8, '\0');
+    auto *t = reinterpret_cast<unsigned char *>(&table[0]);
+    if (!preadAll(fd, t, table.size(), tableStart - 8) ||
+        readLE32(t) != skippableMagic ||
+        readLE32(t + 4) != tableSize + seekTableFooterSize) {
+      return "corrupt seek table";
+    }
+    for (uint64_t i = 0; i < nrFrames; ++i) {
+      unsigned char const *e = t + 8 + i * entrySize;
+      index.compressed.push_back(index.compressed.back() + readLE32(e));
+      index.uncompressed.push_back(index.uncompressed.back() +
+                                   readLE32(e + 4));
+    }
+    if (index.compressed.back() != tableStart - 8) {
+      return "seek table does not match the frames";
+    }
+    return "";
+  }
+  return std::string(codecName(codec)) + " has no block index";
+}
+
+namespace {
+
+class GzipDecompressor : public Decompressor {
+public:
+  GzipDecompressor() {
+    memset(&_stream, 0, sizeof(_stream));
+    _ok = inflateInit2(&_stream, 15 + 16) == Z_OK; // gzip header
+  }
+
+  ~GzipDecompressor() override {
+    if (_ok) {
+      inflateEnd(&_stream);
+    }
+  }
+
+  std::string decompress(char const *&in, size_t &inSize, char *&out,
+                         size_t &outSize) override {
+    if (!_ok) {
+      return "could not initialize zlib";
+    }
+    while (inSize > 0 && outSize > 0) {
+      if (_boundary) {
+        // Another member follows:
+        inflateReset(&_stream);
+        _boundary = false;
+      }
+      _stream.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(in));
+      _stream.avail_in = static_cast<uInt>(std::min<size_t>(inSize, 1 << 30));
+      _stream.next_out = reinterpret_cast<Bytef *>(out);
+      _stream.avail_out = static_cast<uInt>(std::min<size_t>(outSize, 1 << 30));
+      uInt availIn = _stream.avail_in;
+      uInt availOut = _stream.avail_out;
+      int res = inflate(&_stream, Z_NO_FLUSH);
+      in += availIn - _stream.avail_in;
+      inSize -= availIn - _stream.avail_in;
+      out += availOut - _stream.avail_out;
+      outSize -= availOut - _stream.avail_out;
+      if (res == Z_STREAM_END) {
+        _boundary = true;
+      } else if (res == Z_BUF_ERROR) {
+        break; // needs more input or more room
+      } else if (res != Z_OK) {
+        return std::string("corrupt gzip data: ") +
+               (_stream.msg != nullptr ? _stream.msg : "unknown error");
+      }
+    }
+    return "";
+  }
+
+  bool atBoundary() const override { return _boundary; }
+
+private:
+  z_stream _stream;
+  bool _ok;
+  bool _boundary = true;
+};
+
+#ifdef GRAPHUTILS_ZSTD
+class ZstdDecompressor : public Decompressor {
+public:
+  ZstdDecompressor() : _ctx(ZSTD_createDCtx()) {}
+  ~ZstdDecompressor() override { ZSTD_freeDCtx(_ctx); }
+
+  std::string decompress(char const *&in, size_t &inSize, char *&out,
+                         size_t &outSize) override {
+    if (_ctx == nullptr) {
+      return "could not initialize zstd";
+    }
+    ZSTD_inBuffer input{in, inSize, 0};
+    ZSTD_outBuffer output{out, outSize, 0};
+    while (input.pos < input.size && output.pos < output.size) {
+      size_t res = ZSTD_decompressStream(_ctx, &output, &input);
+      if (ZSTD_isError(res)) {
+        return std::string("corrupt zstd data: ") + ZSTD_getErrorName(res);
+      }
+      _boundary = res == 0;
+    }
+    in += input.pos;
+    inSize -= input.pos;
+    out += output.pos;
+    outSize -= output.pos;
+    return "";
+  }
+
+  bool atBoundary() const override { return _boundary; }
+
+private:
+  ZSTD_DCtx *_ctx;
+  bool _boundary = true;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<Decompressor> Decompressor::create(Codec codec) {
+  switch (codec) {
+  case Codec::Gzip:
+  case Codec::Bgzf:
+    return std::make_unique<GzipDecompressor>();
+#ifdef GRAPHUTILS_ZSTD
+  case Codec::Zstd:
+  case Codec::ZstdSeekable:
+    return std::make_unique<ZstdDecompressor>();
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+namespace {
+
+// Appends one BGZF member with the raw deflate of `data` to `out`:
+bool compressBgzfMember(char const *data, size_t size, std::string &out) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  size_t start = out.size();
+  out.resize(start + bgzfHeaderSize + deflateBound(&stream, size) +
+             bgzfTrailerSize);
+  auto *p = reinterpret_cast<unsigned char *>(&out[start]);
+  memcpy(p, bgzfEof, bgzfHeaderSize);
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = p + bgzfHeaderSize;
+  stream.avail_out =
+      static_cast<uInt>(out.size() - start - bgzfHeaderSize - bgzfTrailerSize);
+  int res = deflate(&stream, Z_FINISH);
+  size_t compressedSize = stream.total_out;
+  deflateEnd(&stream);
+  size_t memberSize = bgzfHeaderSize + compressedSize + bgzfTrailerSize;
+  if (res != Z_STREAM_END || memberSize > 0x10000) {
+    return false;
+  }
+  p[16] = (memberSize - 1) & 0xff;
+  p[17] = (memberSize - 1) >> 8;
+  out.resize(start + bgzfHeaderSize + compressedSize);
+  appendLE32(out, static_cast<uint32_t>(crc32(
+                      0, reinterpret_cast<Bytef const *>(data), size)));
+  appendLE32(out, static_cast<uint32_t>(size));
+  return true;
+}
+
+} // namespace
+
+bool compressBlock(Codec codec, char const *data, size_t size,
+                   std::string &out) {
+  size_t start = out.size();
+  if (codec == Codec::Bgzf) {
+    do {
+      size_t n = std::min(size, bgzfMaxInput);
+      if (!compressBgzfMember(data, n, out)) {
+        return false;
+      }
+      data += n;
+      size -= n;
+    } while (size > 0);
+    return true;
+  }
+  if (codec == Codec::Gzip) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    out.resize(start + deflateBound(&stream, size));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef *>(&out[start]);
+    stream.avail_out = static_cast<uInt>(out.size() - start);
+    int res = deflate(&stream, Z_FINISH);
+    out.resize(out.size() - stream.avail_out);
+    deflateEnd(&stream);
+    return res == Z_STREAM_END;
+  }
+#ifdef GRAPHUTILS_ZSTD
+  if (codec == Codec::Zstd || codec == Codec::ZstdSeekable) {
+    out.resize(start + ZSTD_compressBound(size));
+    size_t res = ZSTD_compress(&out[start], out.size() - start, data, size,
+                               ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(res)) {
+      return false;
+    }
+    out.resize(start + res);
+    return true;
+  }
+#endif
+  if (codec == Codec::None) {
+    out.append(data, size);
+    return true;
+  }
+  return false;
+}
+
+BlockCompressor::BlockCompressor(int fd, Codec codec, size_t threads)
+    : _fd(fd), _codec(codec), _maxQueued(2 * threads + 1) {
+  for (size_t i = 0; i < threads; ++i) {
+    _threads.emplace_back([this]() { work(); });
+  }
+}
+
+BlockCompressor::~BlockCompressor() { finish(); }
+
+bool BlockCompressor::write(char const *data, size_t size) {
+  std::unique_lock<std::mutex> guard(_mutex);
+  _cond.wait(guard, [&] { return _queue.size() < _maxQueued || _failed; });
+  if (_failed) {
+    return false;
+  }
+  _queue.emplace_back();
+  Job &job = _queue.back();
+  job.data.assign(data, size);
+  if (_threads.empty()) {
+    ++_next;
+    if (!compressBlock(_codec, job.data.data(), job.data.size(),
+                       job.compressed)) {
+      _failed = true;
+      _errno = EINVAL;
+    }
+    job.done = true;
+    writeFinished();
+  } else {
+    _cond.notify_all();
+  }
+  return !_failed;
+}
+
+void BlockCompressor::work() {
+  std::unique_lock<std::mutex> guard(_mutex);
+  while (true) {
+    _cond.wait(guard, [&] { return _next < _queue.size() || _stop; });
+    if (_next >= _queue.size()) {
+      return; // stopped
+    }
+    Job &job = _queue[_next++];
+    guard.unlock();
+    bool ok = compressBlock(_codec, job.data.data(), job.data.size(),
+                            job.compressed);
+    guard.lock();
+    if (!ok && !_failed) {
+      _failed = true;
+      _errno = EINVAL;
+    }
+    job.done = true;
+    writeFinished();
+    _cond.notify_all();
+  }
+}
+
+void BlockCompressor::writeFinished() {
+  while (!_queue.empty() && _queue.front().done) {
+    Job &job = _queue.front();
+    if (!_failed &&
+        !writeAll(_fd, job.compressed.data(), job.compressed.size())) {
+      _failed = true;
+      _errno = errno;
+    }
+    if (_codec == Codec::ZstdSeekable) {
+      _seekTable.emplace_back(static_cast<uint32_t>(job.compressed.size()),
+                              static_cast<uint32_t>(job.data.size()));
+    }
+    _queue.pop_front();
+    --_next;
+  }
+}
+
+bool BlockCompressor::finish() {
+  {
+    std::unique_lock<std::mutex> guard(_mutex);
+    _cond.wait(guard, [&] { return _queue.empty() || _failed; });
+    _stop = true;
+    _cond.notify_all();
+  }
+  for (auto &t : _threads) {
+    t.join();
+  }
+  _threads.clear();
+  if (!_finished && !_failed) {
+    // The end of the file:
+    std::string trailer;
+    if (_codec == Codec::Bgzf) {
+      trailer.assign(reinterpret_cast<char const *>(bgzfEof), sizeof(bgzfEof));
+    } else if (_codec == Codec::ZstdSeekable) {
+      appendLE32(trailer, skippableMagic);
+      appendLE32(trailer, static_cast<uint32_t>(8 * _seekTable.size() +
+                                                seekTableFooterSize));
+      for (auto const &e : _seekTable) {
+        appendLE32(trailer, e.first);
+        appendLE32(trailer, e.second);
+      }
+      appendLE32(trailer, static_cast<uint32_t>(_seekTable.size()));
+      trailer.push_back('\0'); // no checksums
+      appendLE32(trailer, seekableMagic);
+    }
+    if (!writeAll(_fd, trailer.data(), trailer.size())) {
+      _failed = true;
+      _errno = errno;
+    }
+  }
+  _finished = true;
+  if (_failed) {
+    errno = _errno;
+  }
+  return !_failed;
+}
+
+ParallelDecompressor::ParallelDecompressor(int fd, Codec codec,
+                                           BlockIndex const &index,
+                                           size_t firstBlock, size_t threads)
+    : _fd(fd), _codec(codec), _index(index),
+      _maxAhead(2 * std::max<size_t>(threads, 1)) {
+  // Tasks of consecutive blocks with about 4 MiB of decompressed data:
+  constexpr uint64_t taskSize = 4 << 20;
+  size_t b = std::min(firstBlock, index.nrBlocks());
+  _taskStarts.push_back(b);
+  while (b < index.nrBlocks()) {
+    uint64_t start = index.uncompressed[b];
+    do {
+      ++b;
+    } while (b < index.nrBlocks() && index.uncompressed[b] - start < taskSize);
+    _taskStarts.push_back(b);
+  }
+  for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+    _threads.emplace_back([this]() { work(); });
+  }
+}
+
+ParallelDecompressor::~ParallelDecompressor() {
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _stop = true;
+    _cond.notify_all();
+  }
+  for (auto &t : _threads) {
+    t.join();
+  }
+}
+
+void ParallelDecompressor::work() {
+  std::unique_lock<std::mutex> guard(_mutex);
+  size_t nrTasks = _taskStarts.size() - 1;
+  while (true) {
+    _cond.wait(guard, [&] {
+      return _stop || (_nextTask < nrTasks && _window.size() < _maxAhead);
+    });
+    if (_stop) {
+      return;
+    }
+    _window.emplace_back();
+    Task &task = _window.back();
+    task.firstBlock = _taskStarts[_nextTask];
+    task.endBlock = _taskStarts[_nextTask + 1];
+    ++_nextTask;
+    guard.unlock();
+
+    uint64_t from = _index.compressed[task.firstBlock];
+    uint64_t to = _index.compressed[task.endBlock];
+    std::string compressed(to - from, '\0');
+    // One byte more, so that empty blocks are consumed as well:
+    size_t size = _index.uncompressed[task.endBlock] -
+                  _index.uncompressed[task.firstBlock];
+    task.data.resize(size + 1);
+    if (!preadAll(_fd, &compressed[0], compressed.size(), from)) {
+      task.error = "could not read compressed blocks: " +
+                   std::string(strerror(errno));
+    } else {
+      std::unique_ptr<Decompressor> d = Decompressor::create(_codec);
+      char const *in = compressed.data();
+      size_t inSize = compressed.size();
+      char *out = &task.data[0];
+      size_t outSize = task.data.size();
+      task.error = d->decompress(in, inSize, out, outSize);
+      if (task.error.empty() && (inSize != 0 || outSize != 1)) {
+        task.error = "compressed blocks do not match the index";
+      }
+      task.data.resize(size);
+    }
+
+    guard.lock();
+    task.done = true;
+    _cond.notify_all();
+  }
+}
+
+bool ParallelDecompressor::next(std::string &data, uint64_t &fileOffset) {
+  std::unique_lock<std::mutex> guard(_mutex);
+  size_t nrTasks = _taskStarts.size() - 1;
+  _cond.wait(guard, [&] {
+    return (!_window.empty() && _window.front().done) ||
+           (_window.empty() && _nextTask == nrTasks);
+  });
+  if (_window.empty() || !_error.empty()) {
+    return false;
+  }
+  Task &task = _window.front();
+  if (!task.error.empty()) {
+    _error = task.error;
+    return false;
+  }
+  data.swap(task.data);
+  fileOffset = _index.compressed[task.endBlock];
+  _window.pop_front();
+  _cond.notify_all();
+  return true;
+}
@@ -0,0 +1,175 @@
+// Compression.h - gzip and zstd for the input and output files: detection
+// of compressed input, streaming decompression, compression of the output
+// in independent blocks on several threads and, for the block-indexed
+// formats BGZF and seekable zstd, random access and parallel decompression
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bgzf and ZstdSeekable are gzip and zstd files which consist of
+// independently compressed blocks with an index of their sizes, BGZF in the
+// extra field of every gzip member and seekable zstd in a skippable frame
+// at the end. Every gzip or zstd decompressor can read them.
+enum class Codec { None, Gzip, Bgzf, Zstd, ZstdSeekable };
+
+char const *codecName(Codec codec);
+
+// Parses "none", "gzip", "bgzf", "zstd" or "zstd-seekable", returns false
+// for anything else.
+bool parseCodec(std::string const &name, Codec &codec);
+
+// zstd is only there if the library was found at build time.
+bool codecSupported(Codec codec);
+
+// True for BGZF and seekable zstd:
+inline bool codecIndexed(Codec codec) {
+  return codec == Codec::Bgzf || codec == Codec::ZstdSeekable;
+}
+
+// The codec of a file name by its extension, .gz gives BGZF and .zst
+// seekable zstd, so that the file can be read in parallel later:
+Codec codecForFileName(std::string const &fileName);
+
+// The codec of data by its magic bytes, `size` should be at least 18 to
+// recognize BGZF. Seekable zstd is only recognized by hasSeekTable().
+Codec detectCodec(char const *data, size_t size);
+
+// True if the file `fd` ends with the seek table of seekable zstd:
+bool hasSeekTable(int fd);
+
+// Where the blocks of a BGZF or seekable zstd file start, in the file and
+// in the decompressed data. Both vectors have one more entry, the ends.
+struct BlockIndex {
+  std::vector<uint64_t> compressed;
+  std::vector<uint64_t> uncompressed;
+
+  size_t nrBlocks() const { return compressed.size() - 1; }
+  // The block which contains the decompressed byte `offset`, nrBlocks()
+  // if the offset is at or behind the end:
+  size_t blockOf(uint64_t offset) const;
+};
+
+// Reads the index of the file `fd` compressed with `codec`, returns an
+// error message or "".
+std::string readBlockIndex(int fd, Codec codec, BlockIndex &index);
+
+// Streaming decompression, concatenated gzip members or zstd frames are
+// decompressed one after the other.
+class Decompressor {
+public:
+  static std::unique_ptr<Decompressor> create(Codec codec);
+  virtual ~Decompressor() = default;
+
+  // Decompresses from [in, in + inSize) to [out, out + outSize) as far as
+  // possible and advances all four. Returns an error message or "".
+  virtual std::string decompress(char const *&in, size_t &inSize, char *&out,
+                                 size_t &outSize) = 0;
+
+  // True if the input so far ends at the end of a member or frame:
+  virtual bool atBoundary() const = 0;
+};
+
+// Compresses `data` into one gzip member or one zstd frame, appended to
+// `out`. BGZF makes as many members of at most 64 KiB as needed. Returns
+// false on errors.
+bool compressBlock(Codec codec, char const *data, size_t size,
+                   std::string &out);
+
+// Compresses the blocks given to write() on `threads` threads and writes
+// them to `fd` in their original order. With 0 threads the blocks are
+// compressed in write(). finish() writes the end of file marker of BGZF
+// and the seek table of seekable zstd.
+class BlockCompressor {
+public:
+  BlockCompressor(int fd, Codec codec, size_t threads);
+  ~BlockCompressor();
+  BlockCompressor(BlockCompressor const &) = delete;
+  BlockCompressor &operator=(BlockCompressor const &) = delete;
+
+  // Copies the block, blocks if too many are waiting. Returns false if
+  // this or an earlier block could not be compressed or written.
+  bool write(char const *data, size_t size);
+
+  // Waits until all blocks are written. Returns false on errors, errno
+  // tells why if a write failed.
+  bool finish();
+
+private:
+  struct Job {
+    std::string data;
+    std::string compressed;
+    bool done = false;
+  };
+
+  void work();
+  // Writes the finished jobs at the front of the queue, needs the mutex:
+  void writeFinished();
+
+  int _fd;
+  Codec _codec;
+  bool _finished = false;
+  // Only for seekable zstd, compressed and decompressed size of each frame:
+  std::vector<std::pair<uint32_t, uint32_t>> _seekTable;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::deque<Job> _queue; // in the order of the file
+  size_t _next = 0;       // first job not yet taken
+  size_t _maxQueued;
+  bool _stop = false;
+  bool _failed = false;
+  int _errno = 0;
+  std::vector<std::thread> _threads;
+};
+
+// Decompresses the blocks of a BGZF or seekable zstd file on `threads`
+// threads, ahead of the reader, starting with block `firstBlock` of
+// `index`, which must outlive this.
+class ParallelDecompressor {
+public:
+  ParallelDecompressor(int fd, Codec codec, BlockIndex const &index,
+                       size_t firstBlock, size_t threads);
+  ~ParallelDecompressor();
+  ParallelDecompressor(ParallelDecompressor const &) = delete;
+  ParallelDecompressor &operator=(ParallelDecompressor const &) = delete;
+
+  // The next piece of decompressed data in the order of the file and the
+  // offset in the file behind its blocks. Returns false at the end and on
+  // errors, then error() is not empty.
+  bool next(std::string &data, uint64_t &fileOffset);
+
+  std::string const &error() const { return _error; }
+
+private:
+  struct Task {
+    size_t firstBlock;
+    size_t endBlock;
+    std::string data;
+    std::string error;
+    bool done = false;
+  };
+
+  void work();
+
+  int _fd;
+  Codec _codec;
+  BlockIndex const &_index;
+  std::vector<size_t> _taskStarts; // first blocks of the tasks and the end
+  size_t _nextTask = 0;            // first task not yet taken
+  size_t _maxAhead;
+  std::deque<Task> _window; // taken tasks, not yet returned by next()
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  bool _stop = false;
+  std::string _error;
+  std::vector<std::thread> _threads;
+};
@@ -0,0 +1,38 @@
+// CounterRng.h - a counter-based random generator: the numbers for an item
+// are a function of the seed, the stream and the index of the item only, so
+// that any range of items can be generated independently and in parallel
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// The finalizer of SplitMix64, a bijection with good avalanche behaviour.
+inline uint64_t splitMix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+class CounterRng {
+public:
+  using result_type = uint64_t;
+
+  static constexpr uint64_t golden = 0x9e3779b97f4a7c15ULL;
+
+  // `stream` separates the uses of one seed, for example vertices and edges.
+  CounterRng(uint64_t seed, uint64_t stream, uint64_t index)
+      : _key(splitMix64(splitMix64(seed + golden * (stream + 1)) +
+                        golden * index)) {}
+
+  uint64_t operator()() { return splitMix64(_key + golden * ++_counter); }
+
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() {
+    return std::numeric_limits<uint64_t>::max();
+  }
+
+private:
+  uint64_t _key;
+  uint64_t _counter = 0;
+};
@@ -0,0 +1,320 @@
+// CpuDispatch.cpp - kernels with SSE2, AVX2 and AVX-512 variants, chosen at
+// startup according to the CPU
+
+#include "CpuDispatch.h"
+
+#include <openssl/crypto.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GRAPHUTILS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+char const hexDigits[] = "0123456789abcdef";
+
+size_t findFirstOf2Generic(char const *p, size_t n, char a, char b) {
+  for (size_t i = 0; i < n; ++i) {
+    if (p[i] == a || p[i] == b) {
+      return i;
+    }
+  }
+  return n;
+}
+
+size_t countNewlinesGeneric(char const *p, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += p[i] == '\n';
+  }
+  return count;
+}
+
+void hexEncodeGeneric(unsigned char const *in, size_t n, char *out) {
+  for (size_t i = 0; i < n; ++i) {
+    out[2 * i] = hexDigits[in[i] >> 4];
+    out[2 * i + 1] = hexDigits[in[i] & 0xf];
+  }
+}
+
+#ifdef GRAPHUTILS_X86
+
+__attribute__((target("sse2"))) size_t
+findFirstOf2SSE2(char const *p, size_t n, char a, char b) {
+  __m128i va = _mm_set1_epi8(a);
+  __m128i vb = _mm_set1_epi8(b);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + findFirstOf2Generic(p + i, n - i, a, b);
+}
+
+__attribute__((target("sse2,popcnt"))) size_t
+countNewlinesSSE2(char const *p, size_t n) {
+  __m128i nl = _mm_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, nl)));
+  }
+  return count + countNewlinesGeneric(p + i, n - i);
+}
+
+// Looks up the hex digit of every nibble with a byte shuffle and
+// interleaves high and low nibbles.
+__attribute__((target("ssse3"))) void
+hexEncodeSSSE3(unsigned char const *in, size_t n, char *out) {
+  __m128i digits =
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(hexDigits));
+  __m128i low4 = _mm_set1_epi8(0xf);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+    __m128i hi = _mm_shuffle_epi8(digits,
+                                  _mm_and_si128(_mm_srli_epi16(x, 4), low4));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, low4));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                     _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+                     _mm_unpackhi_epi8(hi, lo));
+  }
+  hexEncodeGeneric(in + i, n - i, out + 2 * i);
+}
+
+__attribute__((target("avx2"))) size_t
+findFirstOf2AVX2(char const *p, size_t n, char a, char b) {
+  __m256i va = _mm256_set1_epi8(a);
+  __m256i vb = _mm256_set1_epi8(b);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p + i));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb))));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + findFirstOf2SSE2(p + i, n - i, a, b);
+}
+
+__attribute__((target("avx2,popcnt"))) size_t
+countNewlinesAVX2(char const *p, size_t n) {
+  __m256i nl = _mm256_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p + i));
+    count += __builtin_popcount(
+        static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, nl))));
+  }
+  return count + countNewlinesSSE2(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) void
+hexEncodeAVX2(unsigned char const *in, size_t n, char *out) {
+  __m256i digits = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(hexDigits)));
+  __m256i low4 = _mm256_set1_epi8(0xf);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i));
+    __m256i hi = _mm256_shuffle_epi8(
+        digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), low4));
+    __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, low4));
+    // The unpacks work within 128-bit lanes, so the four 16-byte results
+    // are in the order 0, 2, 1, 3:
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i),
+                        _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  hexEncodeSSSE3(in + i, n - i, out + 2 * i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) size_t
+findFirstOf2AVX512(char const *p, size_t n, char a, char b) {
+  __m512i va = _mm512_set1_epi8(a);
+  __m512i vb = _mm512_set1_epi8(b);
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512i x = _mm512_loadu_si512(p + i);
+    uint64_t mask =
+        _mm512_cmpeq_epi8_mask(x, va) | _mm512_cmpeq_epi8_mask(x, vb);
+    if (mask != 0) {
+      return i + __builtin_ctzll(mask);
+    }
+  }
+  if (i < n) {
+    // The masked load does not touch the bytes after the end:
+    __mmask64 valid = (~uint64_t(0)) >> (64 - (n - i));
+    __m512i x = _mm512_maskz_loadu_epi8(valid, p + i);
+    uint64_t mask = (_mm512_cmpeq_epi8_mask(x, va) |
+                     _mm512_cmpeq_epi8_mask(x, vb)) &
+                    valid;
+    if (mask != 0) {
+      return i + __builtin_ctzll(mask);
+    }
+  }
+  return n;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) size_t
+countNewlinesAVX512(char const *p, size_t n) {
+  __m512i nl = _mm512_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    count += __builtin_popcountll(
+        _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p + i), nl));
+  }
+  if (i < n) {
+    __mmask64 valid = (~uint64_t(0)) >> (64 - (n - i));
+    count += __builtin_popcountll(
+        _mm512_cmpeq_epi8_mask(_mm512_maskz_loadu_epi8(valid, p + i), nl) &
+        valid);
+  }
+  return count;
+}
+
+#endif
+
+CpuLevel levelFromEnvironment(CpuLevel best) {
+  char const *env = getenv("GRAPHUTILS_CPU");
+  if (env == nullptr) {
+    return best;
+  }
+  CpuLevel wanted = best;
+  if (strcmp(env, "generic") == 0) {
+    wanted = CpuLevel::Generic;
+  } else if (strcmp(env, "sse2") == 0) {
+    wanted = CpuLevel::SSE2;
+  } else if (strcmp(env, "avx2") == 0) {
+    wanted = CpuLevel::AVX2;
+  } else if (strcmp(env, "avx512") == 0) {
+    wanted = CpuLevel::AVX512;
+  }
+  return wanted < best ? wanted : best;
+}
+
+struct CpuDispatchInit {
+  CpuDispatchInit() {
+    cpuKernels = cpuKernelsFor(levelFromEnvironment(detectCpuLevel()));
+  }
+};
+
+} // namespace
+
+CpuKernels cpuKernels = {CpuLevel::Generic, findFirstOf2Generic,
+                         countNewlinesGeneric, hexEncodeGeneric,
+                         "generic", "generic", "generic"};
+
+namespace {
+CpuDispatchInit cpuDispatchInit;
+}
+
+CpuLevel detectCpuLevel() {
+#ifdef GRAPHUTILS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("popcnt")) {
+    return CpuLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return CpuLevel::AVX2;
+  }
+  if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+    return CpuLevel::SSE2;
+  }
+#endif
+  return CpuLevel::Generic;
+}
+
+std::vector<CpuLevel> supportedCpuLevels() {
+  std::vector<CpuLevel> res;
+  CpuLevel best = detectCpuLevel();
+  for (int l = 0; l <= static_cast<int>(best); ++l) {
+    res.push_back(static_cast<CpuLevel>(l));
+  }
+  return res;
+}
+
+CpuKernels cpuKernelsFor(CpuLevel level) {
+  CpuKernels k = {CpuLevel::Generic, findFirstOf2Generic,
+                  countNewlinesGeneric, hexEncodeGeneric,
+                  "generic", "generic", "generic"};
+  k.level = level;
+#ifdef GRAPHUTILS_X86
+  bool ssse3 = __builtin_cpu_supports("ssse3");
+  switch (level) {
+  case CpuLevel::AVX512:
+    k.findFirstOf2 = findFirstOf2AVX512;
+    k.countNewlines = countNewlinesAVX512;
+    k.hexEncode = hexEncodeAVX2; // a digest is too short for more
+    k.findFirstOf2Path = "avx512bw";
+    k.countNewlinesPath = "avx512bw";
+    k.hexEncodePath = "avx2";
+    break;
+  case CpuLevel::AVX2:
+    k.findFirstOf2 = findFirstOf2AVX2;
+    k.countNewlines = countNewlinesAVX2;
+    k.hexEncode = hexEncodeAVX2;
+    k.findFirstOf2Path = "avx2";
+    k.countNewlinesPath = "avx2";
+    k.hexEncodePath = "avx2";
+    break;
+  case CpuLevel::SSE2:
+    k.findFirstOf2 = findFirstOf2SSE2;
+    k.countNewlines = countNewlinesSSE2;
+    k.findFirstOf2Path = "sse2";
+    k.countNewlinesPath = "sse2";
+    if (ssse3) {
+      k.hexEncode = hexEncodeSSSE3;
+      k.hexEncodePath = "ssse3";
+    }
+    break;
+  case CpuLevel::Generic:
+    break;
+  }
+#endif
+  return k;
+}
+
+char const *cpuLevelName(CpuLevel level) {
+  switch (level) {
+  case CpuLevel::Generic:
+    return "generic";
+  case CpuLevel::SSE2:
+    return "sse2";
+  case CpuLevel::AVX2:
+    return "avx2";
+  case CpuLevel::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+std::string cpuDispatchReport() {
+  return std::string("CPU level: ") + cpuLevelName(cpuKernels.level) +
+         " (best supported: " + cpuLevelName(detectCpuLevel()) + ")\n" +
+         "  CSV scanning (split): " + cpuKernels.findFirstOf2Path + "\n" +
+         "  quoting and unquoting: memchr of the C library"
+         " (dispatches by itself)\n" +
+         "  newline counting: " + cpuKernels.countNewlinesPath + "\n" +
+         "  hex encoding: " + cpuKernels.hexEncodePath + "\n" +
+         "  SHA1 hashing: " + OpenSSL_version(OPENSSL_VERSION) +
+         " (dispatches by itself)\n";
+}
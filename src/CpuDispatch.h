@@ -0,0 +1,57 @@
+// CpuDispatch.h - kernels with SSE2, AVX2 and AVX-512 variants, chosen at
+// startup according to the CPU, so that one portable binary uses the best
+// instructions the host has
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class CpuLevel { Generic = 0, SSE2, AVX2, AVX512 };
+
+struct CpuKernels {
+  CpuLevel level;
+  // Position of the first `a` or `b` in p[0..n), n if there is none:
+  size_t (*findFirstOf2)(char const *p, size_t n, char a, char b);
+  // Number of '\n' in p[0..n):
+  size_t (*countNewlines)(char const *p, size_t n);
+  // Writes the 2 * n lowercase hex digits of in[0..n) to out:
+  void (*hexEncode)(unsigned char const *in, size_t n, char *out);
+  // The names of the variants, for `--version`:
+  char const *findFirstOf2Path;
+  char const *countNewlinesPath;
+  char const *hexEncodePath;
+};
+
+// The kernels for this CPU. They are the generic ones during static
+// initialization and are switched to the best supported variants before
+// `main` runs. The environment variable GRAPHUTILS_CPU (generic, sse2, avx2
+// or avx512) can lower the level, for example for benchmarks.
+extern CpuKernels cpuKernels;
+
+// The best level this CPU supports:
+CpuLevel detectCpuLevel();
+
+// All levels this CPU supports, from generic upwards:
+std::vector<CpuLevel> supportedCpuLevels();
+
+// The kernels of `level`, which must be supported:
+CpuKernels cpuKernelsFor(CpuLevel level);
+
+char const *cpuLevelName(CpuLevel level);
+
+// One line per kernel with the active variant:
+std::string cpuDispatchReport();
+
+inline size_t findFirstOf2(char const *p, size_t n, char a, char b) {
+  return cpuKernels.findFirstOf2(p, n, a, b);
+}
+
+inline size_t countNewlines(char const *p, size_t n) {
+  return cpuKernels.countNewlines(p, n);
+}
+
+inline void hexEncode(unsigned char const *in, size_t n, char *out) {
+  cpuKernels.hexEncode(in, n, out);
+}
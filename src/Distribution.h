@@ -0,0 +1,103 @@
+// Distribution.h - distributions of the attribute values of
+// sampleGraphMaker: uniform, Zipf or given by a histogram file
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "GraphTopology.h"
+
+class Distribution {
+public:
+  // Draws the index of a value in [0, n), using exactly one random number
+  // so that the other attributes do not depend on the distribution.
+  template <typename Rng> size_t draw(Rng &random) const {
+    if (_cumulative.empty()) {
+      return random() % _n;
+    }
+    double u = uniform01(random) * _cumulative.back();
+    size_t i = std::upper_bound(_cumulative.begin(), _cumulative.end(), u) -
+               _cumulative.begin();
+    return i < _n ? i : _n - 1;
+  }
+
+  size_t size() const { return _n; }
+
+  // Sets up the distribution from `spec` for the `values`: "uniform",
+  // "zipf:<exponent>" (value i has weight 1 / (i + 1)^exponent) or
+  // "histogram:<file>", in which case `values` is replaced by the values of
+  // the file, lines of the form `<value>,<weight>`. Returns an error
+  // message or "".
+  std::string setup(std::string const &spec,
+                    std::vector<std::string> &values) {
+    _cumulative.clear();
+    if (spec == "uniform") {
+      _n = values.size();
+    } else if (spec.compare(0, 5, "zipf:") == 0) {
+      double exponent = 0;
+      try {
+        exponent = std::stod(spec.substr(5));
+      } catch (std::exception const &) {
+        return "bad Zipf exponent in " + spec;
+      }
+      if (exponent < 0) {
+        return "the Zipf exponent must not be negative";
+      }
+      _n = values.size();
+      double sum = 0;
+      _cumulative.reserve(_n);
+      for (size_t i = 0; i < _n; ++i) {
+        sum += std::pow(static_cast<double>(i + 1), -exponent);
+        _cumulative.push_back(sum);
+      }
+    } else if (spec.compare(0, 10, "histogram:") == 0) {
+      std::string fileName = spec.substr(10);
+      std::ifstream in(fileName);
+      if (!in.is_open()) {
+        return "could not open histogram file " + fileName;
+      }
+      values.clear();
+      double sum = 0;
+      std::string line;
+      while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+          continue;
+        }
+        size_t comma = line.rfind(',');
+        double weight = 0;
+        try {
+          weight = comma == std::string::npos
+                       ? -1
+                       : std::stod(line.substr(comma + 1));
+        } catch (std::exception const &) {
+          weight = -1;
+        }
+        if (weight < 0) {
+          return "bad line in histogram file " + fileName + ": " + line;
+        }
+        values.push_back(line.substr(0, comma));
+        sum += weight;
+        _cumulative.push_back(sum);
+      }
+      if (values.empty() || sum <= 0) {
+        return "histogram file " + fileName + " has no weights";
+      }
+      _n = values.size();
+    } else {
+      return "unknown distribution " + spec;
+    }
+    if (_n == 0) {
+      return "no values to choose from";
+    }
+    return "";
+  }
+
+private:
+  size_t _n = 1;
+  std::vector<double> _cumulative; // empty for the uniform distribution
+};
@@ -0,0 +1,178 @@
+// GraphTopology.h - the shapes of the graphs of sampleGraphMaker: how the
+// endpoints of an edge are drawn and which community a vertex belongs to
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+enum class TopologyKind { Uniform, RMat, ChungLu, Community };
+
+struct Topology {
+  TopologyKind kind = TopologyKind::Uniform;
+  // R-MAT: probabilities of the four quadrants, d = 1 - a - b - c
+  double a = 0.57, b = 0.19, c = 0.19;
+  // Chung-Lu: exponent of the power law of the degrees, must be > 2
+  double exponent = 2.5;
+  // The vertices are cut into this many communities of consecutive numbers:
+  long communities = 1;
+  // Chung-Lu and community: fraction of edges within a community
+  double intra = 0.9;
+};
+
+// Uniform double in [0, 1) from the 53 high bits of one random number.
+template <typename Rng> double uniform01(Rng &random) {
+  return static_cast<double>(random() >> 11) * 0x1.0p-53;
+}
+
+// Block of item v (0-based) of n when the items are cut into `blocks`
+// blocks of consecutive items whose sizes differ by at most one.
+inline long blockOf(long v, long blocks, long n) {
+  return static_cast<long>((static_cast<__int128>(v) * blocks) / n);
+}
+
+// First item (0-based) of block b, b == blocks gives n.
+inline long blockStart(long b, long blocks, long n) {
+  return static_cast<long>((static_cast<__int128>(b) * n + blocks - 1) /
+                           blocks);
+}
+
+// The communities are blocks of consecutive vertices:
+inline long communityOf(Topology const &t, long v, long n) {
+  return blockOf(v, t.communities, n);
+}
+
+inline long communityStart(Topology const &t, long c, long n) {
+  return blockStart(c, t.communities, n);
+}
+
+namespace topology_detail {
+
+// Chung-Lu: vertex v (0-based) has weight (v + 1)^-alpha with alpha =
+// 1 / (exponent - 1), which gives a power law with that exponent for the
+// degrees. Endpoints are drawn with probability proportional to the weight
+// by inverting the integral of the weights, so no table of n entries is
+// needed. F is the antiderivative of x^-alpha, x in [1, n + 1).
+inline double chungLuF(double x, double alpha) {
+  return std::pow(x, 1.0 - alpha);
+}
+
+inline double chungLuFInverse(double y, double alpha) {
+  return std::pow(y, 1.0 / (1.0 - alpha));
+}
+
+// Draws a vertex in [lo, hi) (0-based) proportional to its weight.
+template <typename Rng>
+long chungLuDraw(Topology const &t, long lo, long hi, Rng &random) {
+  double alpha = 1.0 / (t.exponent - 1.0);
+  double flo = chungLuF(lo + 1.0, alpha);
+  double fhi = chungLuF(hi + 1.0, alpha);
+  long v = static_cast<long>(
+               chungLuFInverse(flo + uniform01(random) * (fhi - flo), alpha)) -
+           1;
+  return v < lo ? lo : (v >= hi ? hi - 1 : v);
+}
+
+template <typename Rng> long uniformDraw(long lo, long hi, Rng &random) {
+  return lo + static_cast<long>(random() % static_cast<uint64_t>(hi - lo));
+}
+
+} // namespace topology_detail
+
+// Draws the endpoints (1-based) of one edge among n vertices.
+template <typename Rng>
+std::pair<long, long> drawEdge(Topology const &t, long n, Rng &random) {
+  using namespace topology_detail;
+  switch (t.kind) {
+  case TopologyKind::Uniform:
+  default: {
+    long from = random() % n + 1;
+    long to = random() % n + 1;
+    return {from, to};
+  }
+  case TopologyKind::RMat: {
+    // Recursively choose one of the quadrants of the adjacency matrix of
+    // the next power of two and reject edges outside of it:
+    int scale = 0;
+    while ((1L << scale) < n) {
+      ++scale;
+    }
+    while (true) {
+      long from = 0;
+      long to = 0;
+      for (int level = 0; level < scale; ++level) {
+        // Quadrants a, b, c, d are (0, 0), (0, 1), (1, 0), (1, 1):
+        double u = uniform01(random);
+        bool lowerHalf = u >= t.a + t.b;
+        bool rightHalf = (u >= t.a && u < t.a + t.b) || u >= t.a + t.b + t.c;
+        from = (from << 1) | (lowerHalf ? 1 : 0);
+        to = (to << 1) | (rightHalf ? 1 : 0);
+      }
+      if (from < n && to < n) {
+        return {from + 1, to + 1};
+      }
+    }
+  }
+  case TopologyKind::ChungLu: {
+    long from = chungLuDraw(t, 0, n, random);
+    long to;
+    if (uniform01(random) < t.intra) {
+      long c = communityOf(t, from, n);
+      to = chungLuDraw(t, communityStart(t, c, n), communityStart(t, c + 1, n),
+                       random);
+    } else {
+      to = chungLuDraw(t, 0, n, random);
+    }
+    return {from + 1, to + 1};
+  }
+  case TopologyKind::Community: {
+    long from = uniformDraw(0, n, random);
+    long to;
+    if (uniform01(random) < t.intra) {
+      long c = communityOf(t, from, n);
+      to = uniformDraw(communityStart(t, c, n), communityStart(t, c + 1, n),
+                       random);
+    } else {
+      to = uniformDraw(0, n, random);
+    }
+    return {from + 1, to + 1};
+  }
+  }
+}
+
+// Parses the topology options, returns an error message or "".
+inline std::string parseTopology(Topology &t, std::string const &kind,
+                                 std::string const &rmat, double exponent,
+                                 long communities, double intra, long n) {
+  if (kind == "uniform") {
+    t.kind = TopologyKind::Uniform;
+  } else if (kind == "rmat") {
+    t.kind = TopologyKind::RMat;
+  } else if (kind == "chunglu") {
+    t.kind = TopologyKind::ChungLu;
+  } else if (kind == "community") {
+    t.kind = TopologyKind::Community;
+  } else {
+    return "unknown topology " + kind;
+  }
+  if (sscanf(rmat.c_str(), "%lf,%lf,%lf", &t.a, &t.b, &t.c) != 3 ||
+      t.a < 0 || t.b < 0 || t.c < 0 || t.a + t.b + t.c > 1) {
+    return "--rmat needs three probabilities a,b,c with a + b + c <= 1";
+  }
+  if (exponent <= 2) {
+    return "--exponent must be larger than 2";
+  }
+  t.exponent = exponent;
+  if (communities < 1) {
+    return "--communities must be at least 1";
+  }
+  t.communities = communities < n ? communities : (n > 0 ? n : 1);
+  if (intra < 0 || intra > 1) {
+    return "--intra must be between 0 and 1";
+  }
+  t.intra = intra;
+  return "";
+}
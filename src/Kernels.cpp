@@ -0,0 +1,292 @@
+// Kernels.cpp - the per-line functions of smartifier2: CSV splitting and
+// quoting, hashing, and the translation of vertex keys with their smart
+// graph attributes
+
+#include "Kernels.h"
+
+#include <openssl/evp.h>
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "CpuDispatch.h"
+#include "Metrics.h"
+#include "Profiling.h"
+
+std::string calculateSha1(const std::string &input) {
+  PROFILE_SCOPE(Sha1);
+  EVP_MD_CTX *context = EVP_MD_CTX_new();
+  if (context == nullptr) {
+    throw std::runtime_error("Failed to create EVP context");
+  }
+
+  if (EVP_DigestInit_ex(context, EVP_sha1(), nullptr) != 1) {
+    EVP_MD_CTX_free(context);
+    throw std::runtime_error("Failed to initialize digest");
+  }
+
+  if (EVP_DigestUpdate(context, input.c_str(), input.length()) != 1) {
+    EVP_MD_CTX_free(context);
+    throw std::runtime_error("Failed to update digest");
+  }
+
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int lengthOfHash = 0;
+
+  if (EVP_DigestFinal_ex(context, hash, &lengthOfHash) != 1) {
+    EVP_MD_CTX_free(context);
+    throw std::runtime_error("Failed to finalize digest");
+  }
+
+  EVP_MD_CTX_free(context);
+
+  std::string res(2 * lengthOfHash, '0');
+  hexEncode(hash, lengthOfHash, &res[0]);
+  return res;
+}
+
+Sha1Stream::Sha1Stream() {
+  EVP_MD_CTX *context = EVP_MD_CTX_new();
+  if (context == nullptr ||
+      EVP_DigestInit_ex(context, EVP_sha1(), nullptr) != 1) {
+    EVP_MD_CTX_free(context);
+    throw std::runtime_error("Failed to initialize digest");
+  }
+  _context = context;
+}
+
+Sha1Stream::~Sha1Stream() {
+  EVP_MD_CTX_free(static_cast<EVP_MD_CTX *>(_context));
+}
+
+void Sha1Stream::update(char const *data, size_t size) {
+  if (EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(_context), data, size) !=
+      1) {
+    throw std::runtime_error("Failed to update digest");
+  }
+}
+
+std::string Sha1Stream::hexDigest() {
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int lengthOfHash = 0;
+  if (EVP_DigestFinal_ex(static_cast<EVP_MD_CTX *>(_context), hash,
+                         &lengthOfHash) != 1) {
+    throw std::runtime_error("Failed to finalize digest");
+  }
+  std::string res(2 * lengthOfHash, '0');
+  hexEncode(hash, lengthOfHash, &res[0]);
+  return res;
+}
+
+std::vector<std::string> split(std::string const &line, char sep, char quo) {
+  PROFILE_SCOPE(Split);
+  size_t start = 0;
+  size_t pos = 0;
+  bool inQuote = false;
+  std::vector<std::string> res;
+  auto add = [&]() {
+    res.push_back(line.substr(start, pos - start));
+    start = ++pos;
+  };
+  char const *p = line.data();
+  size_t n = line.size();
+  while (pos < n) {
+    if (!inQuote) {
+      pos += findFirstOf2(p + pos, n - pos, quo, sep);
+      if (pos >= n) {
+        break;
+      }
+      if (p[pos] == quo) {
+        inQuote = true;
+        ++pos;
+        continue;
+      }
+      add();
+    } else { // inQuote == true
+      void const *q = memchr(p + pos, quo, n - pos);
+      if (q == nullptr) {
+        pos = n;
+        break;
+      }
+      pos = static_cast<char const *>(q) - p;
+      if (pos + 1 < n && p[pos + 1] == quo) {
+        pos += 2;
+        continue;
+      }
+      inQuote = false;
+      ++pos;
+    }
+  }
+  add();
+  return res;
+}
+
+std::string unquote(std::string const &s, char quo) {
+  PROFILE_SCOPE(Unquote);
+  std::string res;
+  size_t pos = s.find(quo);
+  if (pos == std::string::npos) {
+    return s;
+  }
+
+  res.reserve(s.size());
+  ++pos; // now pointing to the first character after the quote
+  char const *p = s.data();
+  size_t n = s.size();
+  while (pos < n) {
+    // In a quote: copy everything up to the next quote character:
+    void const *q = memchr(p + pos, quo, n - pos);
+    size_t end = q == nullptr ? n : static_cast<char const *>(q) - p;
+    res.append(p + pos, end - pos);
+    if (end + 1 < n && p[end + 1] == quo) {
+      res.push_back(quo);
+      pos = end + 2;
+      continue;
+    }
+    if (end + 1 >= n) {
+      break;
+    }
+    // Outside of a quote everything is dropped until the next quote:
+    q = memchr(p + end + 1, quo, n - end - 1);
+    if (q == nullptr) {
+      break;
+    }
+    pos = static_cast<char const *>(q) - p + 1;
+  }
+  return res;
+}
+
+std::string quote(std::string const &s, char quo) {
+  size_t pos = s.find(quo);
+  if (pos == std::string::npos) {
+    return s;
+  }
+  std::string res;
+  res.reserve(s.size() + 2); // Usually enough
+  res.push_back(quo);
+  size_t start = 0;
+  while (pos != std::string::npos) {
+    // Copy up to and including the quote character and double it:
+    res.append(s, start, pos + 1 - start);
+    res.push_back(quo);
+    start = pos + 1;
+    pos = s.find(quo, start);
+  }
+  res.append(s, start, std::string::npos);
+  res.push_back(quo);
+  return res;
+}
+
+MemoryAccount Translation::keyTabAccount() const {
+  MemoryAccount account;
+  for (auto const &shard : keyShards) {
+    account.add(shard->account);
+  }
+  return account;
+}
+
+size_t Translation::keyStringBytes() const {
+  size_t n = 0;
+  for (auto const &shard : keyShards) {
+    n += shard->stringBytes;
+  }
+  return n;
+}
+
+HashTableStats Translation::keyTabStats() const {
+  HashTableStats stats = hashTableStats(keyShards[0]->tab);
+  for (size_t i = 1; i < keyShards.size(); ++i) {
+    addHashTableStats(stats, hashTableStats(keyShards[i]->tab));
+  }
+  return stats;
+}
+
+void Translation::printMemoryReport(std::ostream &out) const {
+  size_t total = memUsage();
+  size_t keys = keyCount();
+  out << "Memory report of the translation: " << std::fixed
+      << std::setprecision(1) << total / (1024.0 * 1024.0) << " MB for "
+      << keys << " vertices and " << smartAttributes.size()
+      << " smart graph attributes, "
+      << (keys == 0 ? 0.0 : static_cast<double>(total) / keys)
+      << " bytes per vertex, RSS "
+      << readProcStatus("VmRSS") / (1024.0 * 1024.0) << " MB\n"
+      << std::defaultfloat;
+  printHashTableStats(out,
+                      keyShards.size() == 1
+                          ? std::string("keyTab")
+                          : "keyTab (" + std::to_string(keyShards.size()) +
+                                " shards)",
+                      keyTabStats(), keyTabAccount(), keyStringBytes());
+  printHashTableStats(out, "attTab", hashTableStats(attTab), attTabAccount,
+                      attStringBytes);
+  out << "  smartAttributes: capacity " << smartAttributes.capacity()
+      << ", " << std::fixed << std::setprecision(1)
+      << smartAttributesAccount.chunkBytes / (1024.0 * 1024.0)
+      << " MB (strings: "
+      << smartAttributesStringBytes / (1024.0 * 1024.0)
+      << " MB)\n"
+      << std::defaultfloat << std::flush;
+}
+
+void learnSmartKey(Translation &trans, std::string const &key,
+                   std::string const &vertexCollName, AttributeCache *cache) {
+  size_t splitPos = key.find(':');
+  if (splitPos != std::string::npos) {
+    // Before the colon is the smart graph attribute, after the colon there is
+    // the unique key
+    std::string uniq = key.substr(splitPos + 1);
+    std::string att = key.substr(0, splitPos);
+    PROFILE_SCOPE(Insert);
+    uint32_t pos;
+    if (cache == nullptr) {
+      pos = trans.addSmartAttribute(att);
+    } else {
+      auto it = cache->find(att);
+      if (it == cache->end()) {
+        it = cache->emplace(att, trans.addSmartAttribute(att)).first;
+      }
+      pos = it->second;
+    }
+    trans.addKey(vertexCollName + "/" + uniq, pos);
+  }
+}
+
+std::string translateEndpointCSV(Translation const &translation,
+                                 std::string &part,
+                                 std::string const &vertexCollDefault,
+                                 char quo, int smartIndex) {
+  std::string found = unquote(part, quo);
+  size_t slashpos = found.find('/');
+  if (slashpos == std::string::npos) {
+    // Prepend the default vertex collection name:
+    found = vertexCollDefault + "/" + found;
+    part = quote(found, quo);
+    slashpos = vertexCollDefault.size();
+  }
+  size_t colPos = found.find(':', slashpos + 1);
+  if (colPos != std::string::npos) {
+    // already transformed
+    return found.substr(slashpos + 1, colPos - slashpos - 1);
+  }
+  if (smartIndex > 0) {
+    // Case of no vertex collections, just prepend a few characters
+    // of the key.
+    std::string att = found.substr(slashpos + 1, smartIndex);
+    part = quote(found.substr(0, slashpos + 1) + att + ":" +
+                     found.substr(slashpos + 1),
+                 quo);
+    return att;
+  }
+  PROFILE_SCOPE(Lookup);
+  std::string const *att = translation.smartAttributeOf(found);
+  if (att == nullptr) {
+    // Did not find key, simply go on
+    return "";
+  }
+  std::string key = found.substr(slashpos + 1);
+  part = quote(found.substr(0, slashpos + 1) + *att + ":" + key, quo);
+  return *att;
+}
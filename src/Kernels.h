@@ -0,0 +1,217 @@
+// Kernels.h - the per-line functions of smartifier2: CSV splitting and
+// quoting, hashing, and the translation of vertex keys with their smart
+// graph attributes. They live here so that the microbenchmark can use them.
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryAccounting.h"
+
+// Hex encoded SHA1 of `input`:
+std::string calculateSha1(const std::string &input);
+
+// SHA1 of a stream of data, for example of a file while it is written.
+class Sha1Stream {
+public:
+  Sha1Stream();
+  ~Sha1Stream();
+  Sha1Stream(Sha1Stream const &) = delete;
+  Sha1Stream &operator=(Sha1Stream const &) = delete;
+
+  void update(char const *data, size_t size);
+  // Hex encoded SHA1 of everything so far, the same as sha1sum prints:
+  std::string hexDigest();
+
+private:
+  void *_context; // EVP_MD_CTX
+};
+
+// Splits a CSV line at `sep`, outside of quotes. The fields keep their
+// quotes.
+std::vector<std::string> split(std::string const &line, char sep, char quo);
+
+// Removes the quotes from a CSV field, doubled quote characters become one.
+std::string unquote(std::string const &s, char quo);
+
+// Quotes a CSV field if it contains the quote character.
+std::string quote(std::string const &s, char quo);
+
+template <typename V>
+using CountedMap =
+    std::unordered_map<std::string, V, std::hash<std::string>,
+                       std::equal_to<std::string>,
+                       CountingAllocator<std::pair<std::string const, V>>>;
+
+// The translation from vertex keys to smart graph attributes. All
+// containers allocate through counting allocators and the heap buffers of
+// the strings are counted, too, including the malloc chunk overhead, so
+// `memUsage()` is only off by the fragmentation of the heap.
+//
+// The keys are split into shards by their hash, so that several threads
+// can load vertices at the same time. With more than one shard `addKey`
+// and `addSmartAttribute` are thread-safe, every shard and the smart
+// graph attributes have a lock and an account of their own. With one
+// shard, the default, no locks are taken and keys are not hashed twice.
+struct Translation {
+  struct KeyShard {
+    MemoryAccount account;
+    size_t stringBytes = 0; // heap buffers of the keys in tab
+    CountedMap<uint32_t> tab{
+        0, std::hash<std::string>(), std::equal_to<std::string>(),
+        CountingAllocator<std::pair<std::string const, uint32_t>>(&account)};
+    std::mutex mutex;
+  };
+
+  std::vector<std::unique_ptr<KeyShard>> keyShards;
+  MemoryAccount attTabAccount;
+  MemoryAccount smartAttributesAccount;
+  size_t attStringBytes = 0;             // heap buffers of keys in attTab
+  size_t smartAttributesStringBytes = 0; // the same for smartAttributes
+  CountedMap<uint32_t> attTab{
+      0, std::hash<std::string>(), std::equal_to<std::string>(),
+      CountingAllocator<std::pair<std::string const, uint32_t>>(
+          &attTabAccount)};
+  std::vector<std::string, CountingAllocator<std::string>> smartAttributes{
+      CountingAllocator<std::string>(&smartAttributesAccount)};
+  std::mutex attMutex;
+
+  Translation() { setKeyShards(1); }
+  Translation(Translation const &) = delete; // the allocators point here
+  Translation &operator=(Translation const &) = delete;
+
+  // Splits the keys into `n` shards from now on, only while it is empty:
+  void setKeyShards(size_t n) {
+    keyShards.clear();
+    for (size_t i = 0; i < std::max<size_t>(n, 1); ++i) {
+      keyShards.push_back(std::make_unique<KeyShard>());
+    }
+  }
+
+  void clear() {
+    for (auto &shard : keyShards) {
+      shard->tab.clear();
+      shard->stringBytes = 0;
+    }
+    attTab.clear();
+    smartAttributes.clear();
+    attStringBytes = 0;
+    smartAttributesStringBytes = 0;
+  }
+
+  size_t memUsage() const {
+    size_t total = attTabAccount.chunkBytes +
+                   smartAttributesAccount.chunkBytes + attStringBytes +
+                   smartAttributesStringBytes;
+    for (auto const &shard : keyShards) {
+      total += shard->account.chunkBytes + shard->stringBytes;
+    }
+    return total;
+  }
+
+  size_t keyCount() const {
+    size_t n = 0;
+    for (auto const &shard : keyShards) {
+      n += shard->tab.size();
+    }
+    return n;
+  }
+
+  size_t keyBucketCount() const {
+    size_t n = 0;
+    for (auto const &shard : keyShards) {
+      n += shard->tab.bucket_count();
+    }
+    return n;
+  }
+
+  // The accounts and table shapes of all shards together:
+  MemoryAccount keyTabAccount() const;
+  size_t keyStringBytes() const;
+  HashTableStats keyTabStats() const;
+
+  KeyShard &shardOf(std::string const &key) const {
+    if (keyShards.size() == 1) {
+      return *keyShards[0];
+    }
+    return *keyShards[std::hash<std::string>()(key) % keyShards.size()];
+  }
+
+  // The smart graph attribute of `key`, nullptr if it is not known:
+  std::string const *smartAttributeOf(std::string const &key) const {
+    KeyShard const &shard = shardOf(key);
+    auto it = shard.tab.find(key);
+    if (it == shard.tab.end()) {
+      return nullptr;
+    }
+    return &smartAttributes[it->second];
+  }
+
+  // Returns the position of `att` in `smartAttributes`, adds it if needed:
+  uint32_t addSmartAttribute(std::string const &att) {
+    std::unique_lock<std::mutex> guard(attMutex, std::defer_lock);
+    if (keyShards.size() > 1) {
+      guard.lock();
+    }
+    auto it = attTab.find(att);
+    if (it != attTab.end()) {
+      return it->second;
+    }
+    smartAttributes.emplace_back(att);
+    uint32_t pos = static_cast<uint32_t>(smartAttributes.size() - 1);
+    it = attTab.insert(std::make_pair(att, pos)).first;
+    attStringBytes += mallocBytes(it->first);
+    smartAttributesStringBytes += mallocBytes(smartAttributes.back());
+    return pos;
+  }
+
+  // Adds `key` (of the form <collname>/<key>) if it is not yet known:
+  void addKey(std::string const &key, uint32_t pos) {
+    KeyShard &shard = shardOf(key);
+    std::unique_lock<std::mutex> guard(shard.mutex, std::defer_lock);
+    if (keyShards.size() > 1) {
+      guard.lock();
+    }
+    auto it = shard.tab.find(key);
+    if (it == shard.tab.end()) {
+      it = shard.tab.insert(std::make_pair(key, pos)).first;
+      shard.stringBytes += mallocBytes(it->first);
+    }
+  }
+
+  // Prints the memory report of `--memory-report`:
+  void printMemoryReport(std::ostream &out) const;
+
+private:
+  static size_t mallocBytes(std::string const &s) {
+    size_t n = stringHeapBytes(s);
+    return n == 0 ? 0 : mallocChunkSize(n);
+  }
+};
+
+// The positions of the smart graph attributes a loading thread has already
+// seen, so that it takes the lock of the translation only for new ones:
+using AttributeCache = std::unordered_map<std::string, uint32_t>;
+
+// Learns a vertex key of the form <smartattribute>:<key> of the vertex
+// collection `vertexCollName`, other keys are ignored.
+void learnSmartKey(Translation &trans, std::string const &key,
+                   std::string const &vertexCollName,
+                   AttributeCache *cache = nullptr);
+
+// Translates the `_from` or `_to` field `part` of a CSV edge line in place.
+// A value without a slash gets `vertexCollDefault` prepended. With
+// `smartIndex > 0` the smart graph attribute is the first `smartIndex`
+// characters of the key, otherwise it is looked up in `translation`.
+// Returns the smart graph attribute, or an empty string if the key is
+// unknown.
+std::string translateEndpointCSV(Translation const &translation,
+                                 std::string &part,
+                                 std::string const &vertexCollDefault,
+                                 char quo, int smartIndex);
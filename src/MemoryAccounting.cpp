@@ -0,0 +1,120 @@
+// MemoryAccounting.cpp - exact accounting of the memory used by the
+// translation tables and the report printed with --memory-report
+
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "Metrics.h"
+
+namespace {
+
+struct MemoryPhase {
+  std::string name;
+  uint64_t rssBefore = 0;
+  uint64_t peakRss = 0;
+  uint64_t rssAfter = 0;
+  bool resetWorked = false;
+};
+
+std::vector<MemoryPhase> phases;
+bool inPhase = false;
+
+// Writing "5" to clear_refs resets the peak RSS (VmHWM) of the process,
+// see proc(5).
+bool resetPeakRss() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5" << std::flush;
+  return clearRefs.good();
+}
+
+double mb(uint64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+} // namespace
+
+void addHashTableStats(HashTableStats &s, HashTableStats const &other) {
+  double probes = s.meanProbeLength * s.size +
+                  other.meanProbeLength * other.size;
+  s.size += other.size;
+  s.buckets += other.buckets;
+  s.loadFactor = s.buckets == 0 ? 0 : static_cast<double>(s.size) / s.buckets;
+  s.maxLoadFactor = std::max(s.maxLoadFactor, other.maxLoadFactor);
+  s.emptyBuckets += other.emptyBuckets;
+  s.longestChain = std::max(s.longestChain, other.longestChain);
+  s.meanProbeLength = s.size == 0 ? 0 : probes / s.size;
+  s.probeLengths.resize(std::max(s.probeLengths.size(),
+                                 other.probeLengths.size()));
+  for (size_t i = 0; i < other.probeLengths.size(); ++i) {
+    s.probeLengths[i] += other.probeLengths[i];
+  }
+}
+
+void printHashTableStats(std::ostream &out, std::string const &name,
+                         HashTableStats const &s, MemoryAccount const &account,
+                         size_t stringBytes) {
+  out << "  " << name << ": " << s.size << " entries, " << s.buckets
+      << " buckets (" << s.emptyBuckets << " empty), load factor "
+      << std::fixed << std::setprecision(3) << s.loadFactor << " (max "
+      << s.maxLoadFactor << "), mean probe length " << s.meanProbeLength
+      << ", longest chain " << s.longestChain << "\n"
+      << "    nodes and buckets: " << std::setprecision(1)
+      << mb(account.chunkBytes) << " MB in " << account.allocations
+      << " allocations (" << mb(account.bytes)
+      << " MB requested), key strings: " << mb(stringBytes) << " MB\n"
+      << "    probe lengths:";
+  for (size_t i = 0; i < s.probeLengths.size(); ++i) {
+    out << ' ' << i + 1 << (i + 1 == s.probeLengths.size() ? "+" : "") << ':'
+        << s.probeLengths[i];
+  }
+  out << '\n' << std::defaultfloat;
+}
+
+void beginMemoryPhase(std::string const &name) {
+  endMemoryPhase();
+  MemoryPhase p;
+  p.name = name;
+  p.rssBefore = readProcStatus("VmRSS");
+  p.resetWorked = resetPeakRss();
+  phases.push_back(std::move(p));
+  inPhase = true;
+}
+
+void endMemoryPhase() {
+  if (!inPhase) {
+    return;
+  }
+  MemoryPhase &p = phases.back();
+  p.rssAfter = readProcStatus("VmRSS");
+  // The counters of the kernel lag behind a bit, so that VmHWM can be
+  // below the RSS which was read before:
+  p.peakRss =
+      std::max({readProcStatus("VmHWM"), p.rssBefore, p.rssAfter});
+  inPhase = false;
+}
+
+void printMemoryPhases(std::ostream &out) {
+  endMemoryPhase();
+  if (phases.empty()) {
+    return;
+  }
+  out << "\nMemory by phase (MB):\n"
+      << std::left << std::setw(24) << "phase" << std::right << std::setw(12)
+      << "RSS before" << std::setw(12) << "peak RSS" << std::setw(12)
+      << "RSS after" << '\n'
+      << std::fixed << std::setprecision(1);
+  bool allReset = true;
+  for (auto const &p : phases) {
+    out << std::left << std::setw(24) << p.name << std::right << std::setw(12)
+        << mb(p.rssBefore) << std::setw(12) << mb(p.peakRss) << std::setw(12)
+        << mb(p.rssAfter) << '\n';
+    allReset = allReset && p.resetWorked;
+  }
+  if (!allReset) {
+    out << "(the peak RSS could not be reset, peaks are since the start of "
+           "the process)\n";
+  }
+  out << std::defaultfloat << std::flush;
+}
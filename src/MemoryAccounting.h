@@ -0,0 +1,150 @@
+// MemoryAccounting.h - exact accounting of the memory used by the
+// translation tables and the report printed with --memory-report
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Size of the chunk glibc's malloc uses for a request of `n` bytes: an 8 byte
+// header, rounded up to 16 bytes, at least 32 bytes.
+inline size_t mallocChunkSize(size_t n) {
+  size_t c = (n + 8 + 15) & ~static_cast<size_t>(15);
+  return c < 32 ? 32 : c;
+}
+
+// Counts the allocations of one or more containers.
+struct MemoryAccount {
+  size_t bytes = 0;      // requested bytes currently allocated
+  size_t chunkBytes = 0; // the same including malloc overhead
+  size_t allocations = 0;
+  size_t peakChunkBytes = 0;
+
+  void allocate(size_t n) {
+    bytes += n;
+    chunkBytes += mallocChunkSize(n);
+    ++allocations;
+    if (chunkBytes > peakChunkBytes) {
+      peakChunkBytes = chunkBytes;
+    }
+  }
+  void deallocate(size_t n) {
+    bytes -= n;
+    chunkBytes -= mallocChunkSize(n);
+    --allocations;
+  }
+  // Adds the counts of `other`, the peaks add up to an upper bound:
+  void add(MemoryAccount const &other) {
+    bytes += other.bytes;
+    chunkBytes += other.chunkBytes;
+    allocations += other.allocations;
+    peakChunkBytes += other.peakChunkBytes;
+  }
+};
+
+// An allocator which books everything on a `MemoryAccount`. The account is
+// not thread-safe, every shard of the translation has its own account which
+// is only modified with the lock of the shard held.
+template <typename T> class CountingAllocator {
+public:
+  using value_type = T;
+
+  explicit CountingAllocator(MemoryAccount *account) : _account(account) {}
+  template <typename U>
+  CountingAllocator(CountingAllocator<U> const &other)
+      : _account(other.account()) {}
+
+  T *allocate(size_t n) {
+    _account->allocate(n * sizeof(T));
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) {
+    _account->deallocate(n * sizeof(T));
+    ::operator delete(p);
+  }
+
+  MemoryAccount *account() const { return _account; }
+
+  template <typename U> bool operator==(CountingAllocator<U> const &o) const {
+    return _account == o.account();
+  }
+  template <typename U> bool operator!=(CountingAllocator<U> const &o) const {
+    return _account != o.account();
+  }
+
+private:
+  MemoryAccount *_account;
+};
+
+// Heap bytes owned by a string, 0 if it uses the small string buffer.
+inline size_t stringHeapBytes(std::string const &s) {
+  char const *p = s.data();
+  char const *self = reinterpret_cast<char const *>(&s);
+  if (p >= self && p < self + sizeof(std::string)) {
+    return 0;
+  }
+  return s.capacity() + 1;
+}
+
+// Shape of a hash table with separate chaining. The probe length of a key is
+// the number of nodes visited by a successful lookup, that is its position
+// in the chain of its bucket.
+struct HashTableStats {
+  size_t size = 0;
+  size_t buckets = 0;
+  double loadFactor = 0;
+  double maxLoadFactor = 0;
+  size_t emptyBuckets = 0;
+  size_t longestChain = 0;
+  double meanProbeLength = 0;
+  std::vector<size_t> probeLengths; // index i: keys with probe length i + 1
+};
+
+constexpr size_t maxProbeLengthBucket = 8; // the last one is "8 or more"
+
+// Adds the table of `other` to `s`, as if it was one table with the buckets
+// of both:
+void addHashTableStats(HashTableStats &s, HashTableStats const &other);
+
+template <typename Map> HashTableStats hashTableStats(Map const &m) {
+  HashTableStats s;
+  s.size = m.size();
+  s.buckets = m.bucket_count();
+  s.loadFactor = m.load_factor();
+  s.maxLoadFactor = m.max_load_factor();
+  s.probeLengths.assign(maxProbeLengthBucket, 0);
+  uint64_t probes = 0;
+  for (size_t b = 0; b < s.buckets; ++b) {
+    size_t len = m.bucket_size(b);
+    if (len == 0) {
+      ++s.emptyBuckets;
+      continue;
+    }
+    s.longestChain = std::max(s.longestChain, len);
+    for (size_t i = 0; i < len; ++i) {
+      ++s.probeLengths[std::min(i, maxProbeLengthBucket - 1)];
+    }
+    probes += len * (len + 1) / 2;
+  }
+  if (s.size > 0) {
+    s.meanProbeLength = static_cast<double>(probes) / s.size;
+  }
+  return s;
+}
+
+void printHashTableStats(std::ostream &out, std::string const &name,
+                         HashTableStats const &s, MemoryAccount const &account,
+                         size_t stringBytes);
+
+// Peak RSS per phase (a vertex batch or an edge pass). When a phase begins
+// the peak RSS of the process is reset via /proc/self/clear_refs if the
+// kernel allows it, otherwise the peaks are the ones since the start.
+void beginMemoryPhase(std::string const &name);
+void endMemoryPhase();
+
+// Prints the peak RSS of all finished phases.
+void printMemoryPhases(std::ostream &out);
@@ -0,0 +1,285 @@
+// Metrics.cpp - live metrics for long running jobs
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+Metrics metrics;
+
+uint64_t readProcStatus(char const *field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  size_t len = strlen(field);
+  while (getline(status, line)) {
+    if (line.compare(0, len, field) == 0 && line.size() > len &&
+        line[len] == ':') {
+      return strtoull(line.c_str() + len + 1, nullptr, 10) * 1024; // in kB
+    }
+  }
+  return 0;
+}
+
+namespace {
+
+std::string jsonString(std::string const &s) {
+  std::string res = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      res.push_back('\\');
+      res.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      res += buf;
+    } else {
+      res.push_back(c);
+    }
+  }
+  res.push_back('"');
+  return res;
+}
+
+std::string promLabel(std::string const &s) {
+  std::string res;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      res.push_back('\\');
+      res.push_back(c);
+    } else if (c == '\n') {
+      res += "\\n";
+    } else {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+} // namespace
+
+bool Metrics::start(std::string const &jsonFile, std::string const &promFile,
+                    double interval, uint64_t memLimit,
+                    std::chrono::steady_clock::time_point startTime) {
+  std::lock_guard<std::mutex> guard(_mutex);
+  if (jsonFile == "-") {
+    _json = &std::cout;
+  } else if (!jsonFile.empty()) {
+    _jsonFile.open(jsonFile, std::ios_base::out | std::ios_base::app);
+    if (!_jsonFile.good()) {
+      std::cerr << "Could not open metrics file " << jsonFile
+                << " for writing." << std::endl;
+      return false;
+    }
+    _json = &_jsonFile;
+  }
+  _promFile = promFile;
+  _memLimit = memLimit;
+  _startTime = startTime;
+  _lastReport = std::chrono::steady_clock::now();
+  _running = true;
+  // Without an interval there is only the final report and no thread:
+  if (interval > 0) {
+    _interval = std::chrono::duration<double>(interval);
+    _reporter = std::thread([this]() { run(); });
+  }
+  return true;
+}
+
+void Metrics::stop() {
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (!_running) {
+      return;
+    }
+    _stopping = true;
+  }
+  _cond.notify_all();
+  if (_reporter.joinable()) {
+    _reporter.join();
+  }
+  std::lock_guard<std::mutex> guard(_mutex);
+  report(true);
+  _running = false;
+  _jsonFile.close();
+}
+
+void Metrics::beginPhase(std::string const &phase, uint64_t totalBytes,
+                         uint64_t doneBytes) {
+  std::lock_guard<std::mutex> guard(_mutex);
+  for (auto &f : _files) {
+    _oldFiles.push_back(std::move(f));
+  }
+  _files.clear();
+  _phase = phase;
+  _phaseTotal = totalBytes;
+  _phaseDoneBefore = doneBytes;
+  _phaseLastBytes = doneBytes;
+}
+
+void Metrics::setPass(size_t pass) {
+  _pass.store(pass, std::memory_order_relaxed);
+  _resolved.store(0, std::memory_order_relaxed);
+  _unresolved.store(0, std::memory_order_relaxed);
+}
+
+FileMetrics *Metrics::addFile(std::string const &fileName, uint64_t size) {
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto f = std::make_unique<FileMetrics>();
+  f->phase = _phase;
+  f->fileName = fileName;
+  f->size = size;
+  _files.push_back(std::move(f));
+  return _files.back().get();
+}
+
+void Metrics::run() {
+  std::unique_lock<std::mutex> guard(_mutex);
+  while (!_stopping) {
+    _cond.wait_for(guard, _interval);
+    if (!_stopping) {
+      report(false);
+    }
+  }
+}
+
+// Must be called with `_mutex` held.
+void Metrics::report(bool final) {
+  auto now = std::chrono::steady_clock::now();
+  double time = std::chrono::duration<double>(now - _startTime).count();
+  double dt = std::chrono::duration<double>(now - _lastReport).count();
+  _lastReport = now;
+  if (dt <= 0) {
+    dt = 1e-9;
+  }
+
+  uint64_t rss = readProcStatus("VmRSS");
+  uint64_t keys = _keys.load(std::memory_order_relaxed);
+  uint64_t buckets = _buckets.load(std::memory_order_relaxed);
+  double loadFactor =
+      buckets > 0 ? static_cast<double>(keys) / static_cast<double>(buckets)
+                  : 0.0;
+  uint64_t resolved = _resolved.load(std::memory_order_relaxed);
+  uint64_t unresolved = _unresolved.load(std::memory_order_relaxed);
+
+  struct Rates {
+    FileMetrics *f;
+    uint64_t lines;
+    uint64_t bytes;
+    double linesPerSec;
+    double bytesPerSec;
+  };
+  std::vector<Rates> rates;
+  uint64_t phaseBytes = _phaseDoneBefore;
+  for (auto &f : _files) {
+    uint64_t lines = f->lines.load(std::memory_order_relaxed);
+    uint64_t bytes = f->bytes.load(std::memory_order_relaxed);
+    bool finished = f->finished.load(std::memory_order_relaxed);
+    phaseBytes += finished ? std::max(bytes, f->size) : bytes;
+    if (f->reportedFinished) {
+      continue; // no news
+    }
+    rates.push_back(Rates{f.get(), lines, bytes, (lines - f->lastLines) / dt,
+                          (bytes - f->lastBytes) / dt});
+    f->lastLines = lines;
+    f->lastBytes = bytes;
+    f->reportedFinished = finished;
+  }
+  double phaseRate =
+      phaseBytes >= _phaseLastBytes ? (phaseBytes - _phaseLastBytes) / dt : 0;
+  _phaseLastBytes = phaseBytes;
+  double eta = -1; // unknown
+  if (_phaseTotal == 0) {
+    // nothing known about the phase
+  } else if (phaseBytes >= _phaseTotal) {
+    eta = 0;
+  } else if (phaseRate > 0) {
+    eta = (_phaseTotal - phaseBytes) / phaseRate;
+  }
+  size_t pass = _pass.load(std::memory_order_relaxed);
+
+  if (_json != nullptr) {
+    std::ostringstream out;
+    out << "{\"time\":" << time << ",\"final\":" << (final ? "true" : "false")
+        << ",\"phase\":" << jsonString(_phase) << ",\"pass\":" << pass
+        << ",\"rss\":" << rss << ",\"memoryLimit\":" << _memLimit
+        << ",\"translation\":{\"keys\":" << keys << ",\"attributes\":"
+        << _attributes.load(std::memory_order_relaxed)
+        << ",\"buckets\":" << buckets << ",\"loadFactor\":" << loadFactor
+        << ",\"memUsage\":" << _memUsage.load(std::memory_order_relaxed)
+        << "},\"endpoints\":{\"resolved\":" << resolved
+        << ",\"unresolved\":" << unresolved << "},\"bytes\":" << phaseBytes
+        << ",\"totalBytes\":" << _phaseTotal
+        << ",\"bytesPerSecond\":" << phaseRate << ",\"etaSeconds\":" << eta
+        << ",\"files\":[";
+    bool first = true;
+    for (auto const &r : rates) {
+      if (!first) {
+        out << ',';
+      }
+      first = false;
+      out << "{\"file\":" << jsonString(r.f->fileName)
+          << ",\"phase\":" << jsonString(r.f->phase)
+          << ",\"lines\":" << r.lines << ",\"bytes\":" << r.bytes
+          << ",\"size\":" << r.f->size
+          << ",\"linesPerSecond\":" << r.linesPerSec
+          << ",\"bytesPerSecond\":" << r.bytesPerSec << ",\"finished\":"
+          << (r.f->reportedFinished ? "true" : "false") << '}';
+    }
+    out << "]}\n";
+    *_json << out.str() << std::flush;
+  }
+
+  if (!_promFile.empty()) {
+    std::string tmp = _promFile + ".tmp";
+    {
+      std::ofstream prom(tmp, std::ios_base::out | std::ios_base::trunc);
+      prom << "# TYPE smartifier2_pass gauge\n"
+           << "smartifier2_pass " << pass << '\n'
+           << "# TYPE smartifier2_rss_bytes gauge\n"
+           << "smartifier2_rss_bytes " << rss << '\n'
+           << "# TYPE smartifier2_memory_limit_bytes gauge\n"
+           << "smartifier2_memory_limit_bytes " << _memLimit << '\n'
+           << "# TYPE smartifier2_translation_keys gauge\n"
+           << "smartifier2_translation_keys " << keys << '\n'
+           << "# TYPE smartifier2_translation_load_factor gauge\n"
+           << "smartifier2_translation_load_factor " << loadFactor << '\n'
+           << "# TYPE smartifier2_translation_mem_usage_bytes gauge\n"
+           << "smartifier2_translation_mem_usage_bytes "
+           << _memUsage.load(std::memory_order_relaxed) << '\n'
+           << "# TYPE smartifier2_endpoints_resolved gauge\n"
+           << "smartifier2_endpoints_resolved " << resolved << '\n'
+           << "# TYPE smartifier2_endpoints_unresolved gauge\n"
+           << "smartifier2_endpoints_unresolved " << unresolved << '\n'
+           << "# TYPE smartifier2_phase_bytes gauge\n"
+           << "smartifier2_phase_bytes{phase=\"" << promLabel(_phase) << "\"} "
+           << phaseBytes << '\n'
+           << "# TYPE smartifier2_phase_total_bytes gauge\n"
+           << "smartifier2_phase_total_bytes{phase=\"" << promLabel(_phase)
+           << "\"} " << _phaseTotal << '\n'
+           << "# TYPE smartifier2_phase_bytes_per_second gauge\n"
+           << "smartifier2_phase_bytes_per_second{phase=\""
+           << promLabel(_phase) << "\"} " << phaseRate << '\n'
+           << "# TYPE smartifier2_eta_seconds gauge\n"
+           << "smartifier2_eta_seconds " << eta << '\n'
+           << "# TYPE smartifier2_finished gauge\n"
+           << "smartifier2_finished " << (final ? 1 : 0) << '\n';
+      prom << "# TYPE smartifier2_file_lines_per_second gauge\n";
+      for (auto const &r : rates) {
+        prom << "smartifier2_file_lines_per_second{file=\""
+             << promLabel(r.f->fileName) << "\",phase=\""
+             << promLabel(r.f->phase) << "\"} " << r.linesPerSec << '\n';
+      }
+      prom << "# TYPE smartifier2_file_bytes_per_second gauge\n";
+      for (auto const &r : rates) {
+        prom << "smartifier2_file_bytes_per_second{file=\""
+             << promLabel(r.f->fileName) << "\",phase=\""
+             << promLabel(r.f->phase) << "\"} " << r.bytesPerSec << '\n';
+      }
+    }
+    ::rename(tmp.c_str(), _promFile.c_str());
+  }
+}
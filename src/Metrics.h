@@ -0,0 +1,118 @@
+// Metrics.h - live metrics for long running jobs, emitted periodically as
+// JSON lines and optionally as a Prometheus textfile
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Progress of reading one input file (or one range of it) in one phase.
+// There is exactly one thread updating an object, the reporter thread only
+// reads it, so relaxed stores are enough.
+struct FileMetrics {
+  std::string phase;
+  std::string fileName;
+  uint64_t size = 0;                 // bytes to read
+  std::atomic<uint64_t> lines{0};    // lines read so far
+  std::atomic<uint64_t> bytes{0};    // bytes read so far
+  std::atomic<bool> finished{false};
+
+  void update(uint64_t l, uint64_t b) {
+    lines.store(l, std::memory_order_relaxed);
+    bytes.store(b, std::memory_order_relaxed);
+  }
+  void finish() { finished.store(true, std::memory_order_relaxed); }
+
+  // Only used by the reporter thread:
+  uint64_t lastLines = 0;
+  uint64_t lastBytes = 0;
+  bool reportedFinished = false;
+};
+
+// Values of /proc/self/status like "VmRSS" or "VmHWM" in bytes, 0 if not
+// available.
+uint64_t readProcStatus(char const *field);
+
+class Metrics {
+public:
+  ~Metrics() { stop(); }
+
+  // Starts the reporter thread. `jsonFile` gets one JSON object per line
+  // every `interval` seconds ("-" is stdout), `promFile`, if not empty, is
+  // rewritten atomically in the Prometheus textfile format. With an
+  // `interval` of 0 only the final report is written.
+  bool start(std::string const &jsonFile, std::string const &promFile,
+             double interval, uint64_t memLimit,
+             std::chrono::steady_clock::time_point startTime);
+
+  // Stops the reporter thread after emitting a final report.
+  void stop();
+
+  // A phase is for example "vertices", "load" or "edges". `totalBytes` is
+  // the input of the phase and `doneBytes` the part of it which has already
+  // been read before, both are used to estimate the time to completion.
+  void beginPhase(std::string const &phase, uint64_t totalBytes,
+                  uint64_t doneBytes = 0);
+
+  // Sets the pass number and resets the endpoint counters.
+  void setPass(size_t pass);
+
+  // Registers an input file (or a range of it) of `size` bytes in the
+  // current phase. The returned object stays valid until the end.
+  FileMetrics *addFile(std::string const &fileName, uint64_t size);
+
+  void setTranslation(uint64_t keys, uint64_t attributes, uint64_t buckets,
+                      uint64_t memUsage) {
+    _keys.store(keys, std::memory_order_relaxed);
+    _attributes.store(attributes, std::memory_order_relaxed);
+    _buckets.store(buckets, std::memory_order_relaxed);
+    _memUsage.store(memUsage, std::memory_order_relaxed);
+  }
+
+  void addEndpoints(uint64_t resolved, uint64_t unresolved) {
+    _resolved.fetch_add(resolved, std::memory_order_relaxed);
+    _unresolved.fetch_add(unresolved, std::memory_order_relaxed);
+  }
+
+private:
+  void run();
+  void report(bool final);
+
+  std::mutex _mutex; // protects everything below which is not atomic
+  std::condition_variable _cond;
+  bool _running = false;
+  bool _stopping = false;
+  std::thread _reporter;
+  std::ofstream _jsonFile;
+  std::ostream *_json = nullptr;
+  std::string _promFile;
+  std::chrono::duration<double> _interval{10.0};
+  std::chrono::steady_clock::time_point _startTime;
+  std::chrono::steady_clock::time_point _lastReport;
+  uint64_t _memLimit = 0;
+
+  std::string _phase;
+  uint64_t _phaseTotal = 0;
+  uint64_t _phaseDoneBefore = 0;
+  uint64_t _phaseLastBytes = 0;
+  std::deque<std::unique_ptr<FileMetrics>> _files; // of the current phase
+  std::deque<std::unique_ptr<FileMetrics>> _oldFiles;
+
+  std::atomic<size_t> _pass{0};
+  std::atomic<uint64_t> _keys{0};
+  std::atomic<uint64_t> _attributes{0};
+  std::atomic<uint64_t> _buckets{0};
+  std::atomic<uint64_t> _memUsage{0};
+  std::atomic<uint64_t> _resolved{0};
+  std::atomic<uint64_t> _unresolved{0};
+};
+
+extern Metrics metrics;
@@ -0,0 +1,234 @@
+// Profiling.cpp - scoped per-phase timers and hardware performance counters
+
+#include "Profiling.h"
+
+#ifdef GRAPHUTILS_PROFILING
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t nrPhases = static_cast<size_t>(ProfilePhase::NrPhases);
+constexpr size_t nrCounters = 4;
+
+char const *phaseNames[nrPhases] = {"split",  "unquote", "vpack-parse",
+                                    "sha1",   "insert",  "lookup",
+                                    "output"};
+
+uint64_t const counterConfigs[nrCounters] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+bool useCounters = false;
+
+} // namespace
+
+struct PhaseStats {
+  uint64_t calls = 0;
+  uint64_t nanos = 0;
+  uint64_t counters[nrCounters] = {0, 0, 0, 0};
+};
+
+struct ThreadProfile {
+  size_t id;
+  PhaseStats phases[nrPhases];
+  int groupFd = -1;
+  int fds[nrCounters] = {-1, -1, -1, -1};
+  bool valid[nrCounters] = {false, false, false, false};
+  size_t nrValid = 0;
+
+  ~ThreadProfile() {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  void openCounters() {
+    for (size_t i = 0; i < nrCounters; ++i) {
+      perf_event_attr pe{};
+      pe.type = PERF_TYPE_HARDWARE;
+      pe.size = sizeof(pe);
+      pe.config = counterConfigs[i];
+      pe.disabled = groupFd < 0 ? 1 : 0;
+      pe.exclude_kernel = 1;
+      pe.exclude_hv = 1;
+      pe.read_format = PERF_FORMAT_GROUP;
+      int fd = static_cast<int>(
+          ::syscall(__NR_perf_event_open, &pe, 0, -1, groupFd, 0));
+      if (fd < 0) {
+        if (groupFd < 0) {
+          return; // no leader, no counters at all
+        }
+        continue;
+      }
+      if (groupFd < 0) {
+        groupFd = fd;
+      }
+      fds[i] = fd;
+      valid[i] = true;
+      ++nrValid;
+    }
+    ::ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // Returns false and leaves `counters` alone if they cannot be read:
+  bool readCounters(uint64_t *counters) {
+    uint64_t buf[1 + nrCounters];
+    if (groupFd < 0 ||
+        ::read(groupFd, buf, sizeof(uint64_t) * (1 + nrValid)) <= 0) {
+      return false;
+    }
+    size_t j = 1;
+    for (size_t i = 0; i < nrCounters; ++i) {
+      counters[i] = valid[i] ? buf[j++] : 0;
+    }
+    return true;
+  }
+};
+
+namespace {
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadProfile>> registry;
+
+} // namespace
+
+namespace profiling {
+
+bool enabled = false;
+
+ThreadProfile &threadProfile() {
+  thread_local ThreadProfile *mine = nullptr;
+  if (mine == nullptr) {
+    auto t = std::make_unique<ThreadProfile>();
+    if (useCounters) {
+      t->openCounters();
+    }
+    std::lock_guard<std::mutex> guard(registryMutex);
+    t->id = registry.size();
+    mine = t.get();
+    registry.push_back(std::move(t));
+  }
+  return *mine;
+}
+
+bool enter(ThreadProfile &t, uint64_t *counters) {
+  return t.groupFd >= 0 && t.readCounters(counters);
+}
+
+void leave(ThreadProfile &t, ProfilePhase p,
+           std::chrono::steady_clock::time_point start,
+           uint64_t const *counters, bool counted) {
+  auto now = std::chrono::steady_clock::now();
+  PhaseStats &s = t.phases[static_cast<size_t>(p)];
+  ++s.calls;
+  s.nanos += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - start)
+          .count());
+  if (counted) {
+    uint64_t end[nrCounters];
+    if (t.readCounters(end)) {
+      for (size_t i = 0; i < nrCounters; ++i) {
+        s.counters[i] += end[i] - counters[i];
+      }
+    }
+  }
+}
+
+} // namespace profiling
+
+bool startProfiling(bool counters) {
+  useCounters = counters;
+  profiling::enabled = true;
+  if (counters && profiling::threadProfile().groupFd < 0) {
+    std::cerr << "Warning: could not open hardware performance counters "
+                 "(check /proc/sys/kernel/perf_event_paranoid), only timing."
+              << std::endl;
+    useCounters = false;
+  }
+  return true;
+}
+
+void printProfile(std::ostream &out, double wallTime) {
+  std::lock_guard<std::mutex> guard(registryMutex);
+  if (!profiling::enabled || registry.empty()) {
+    return;
+  }
+  auto printRow = [&](std::string const &name, PhaseStats const &s) {
+    double secs = s.nanos / 1e9;
+    out << std::left << std::setw(14) << name << std::right << std::setw(13)
+        << s.calls << std::setw(11) << std::fixed << std::setprecision(3)
+        << secs << std::setw(8) << std::setprecision(1)
+        << (wallTime > 0 ? 100.0 * secs / wallTime : 0.0) << std::setw(10)
+        << (s.calls > 0 ? static_cast<double>(s.nanos) / s.calls : 0.0);
+    if (useCounters) {
+      out << std::setw(16) << s.counters[0] << std::setw(16) << s.counters[1]
+          << std::setw(7) << std::setprecision(2)
+          << (s.counters[0] > 0 ? static_cast<double>(s.counters[1]) /
+                                      static_cast<double>(s.counters[0])
+                                : 0.0)
+          << std::setw(14) << s.counters[2] << std::setw(14) << s.counters[3];
+    }
+    out << '\n';
+  };
+  auto printHeader = [&](std::string const &title) {
+    out << "\n" << title << "\n"
+        << std::left << std::setw(14) << "phase" << std::right
+        << std::setw(13) << "calls" << std::setw(11) << "seconds"
+        << std::setw(8) << "%wall" << std::setw(10) << "ns/call";
+    if (useCounters) {
+      out << std::setw(16) << "cycles" << std::setw(16) << "instructions"
+          << std::setw(7) << "IPC" << std::setw(14) << "cache-miss"
+          << std::setw(14) << "branch-miss";
+    }
+    out << '\n';
+  };
+
+  PhaseStats total[nrPhases];
+  for (auto const &t : registry) {
+    for (size_t p = 0; p < nrPhases; ++p) {
+      total[p].calls += t->phases[p].calls;
+      total[p].nanos += t->phases[p].nanos;
+      for (size_t i = 0; i < nrCounters; ++i) {
+        total[p].counters[i] += t->phases[p].counters[i];
+      }
+    }
+  }
+  printHeader("Profile of all threads (wall time " + std::to_string(wallTime) +
+              " s):");
+  for (size_t p = 0; p < nrPhases; ++p) {
+    printRow(phaseNames[p], total[p]);
+  }
+  if (registry.size() > 1) {
+    for (auto const &t : registry) {
+      printHeader("Thread " + std::to_string(t->id) + ":");
+      for (size_t p = 0; p < nrPhases; ++p) {
+        if (t->phases[p].calls > 0) {
+          printRow(phaseNames[p], t->phases[p]);
+        }
+      }
+    }
+  }
+  out << std::defaultfloat << std::flush;
+}
+
+#else
+
+bool startProfiling(bool) { return false; }
+
+void printProfile(std::ostream &, double) {}
+
+#endif
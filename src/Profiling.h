@@ -0,0 +1,82 @@
+// Profiling.h - scoped per-phase timers and hardware performance counters,
+// only compiled in if the CMake option GRAPHUTILS_PROFILING is on
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+// The phases which are instrumented:
+enum class ProfilePhase {
+  Split = 0,
+  Unquote,
+  Parse,  // VelocyPack parsing
+  Sha1,   // calculateSha1
+  Insert, // insertions into the translation
+  Lookup, // lookups in the translation
+  Output, // writing output lines
+  NrPhases
+};
+
+#ifdef GRAPHUTILS_PROFILING
+
+#include <chrono>
+
+struct ThreadProfile;
+
+namespace profiling {
+extern bool enabled;
+ThreadProfile &threadProfile();
+// Returns whether `counters` could be read:
+bool enter(ThreadProfile &t, uint64_t *counters);
+// Adds the counter deltas only if `counted`, the result of enter():
+void leave(ThreadProfile &t, ProfilePhase p,
+           std::chrono::steady_clock::time_point start,
+           uint64_t const *counters, bool counted);
+} // namespace profiling
+
+// Accounts the time (and counters) of its lifetime to a phase of the
+// current thread.
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfilePhase p) : _phase(p) {
+    if (profiling::enabled) {
+      _thread = &profiling::threadProfile();
+      _counted = profiling::enter(*_thread, _counters);
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+  ~ProfileScope() {
+    if (_thread != nullptr) {
+      profiling::leave(*_thread, _phase, _start, _counters, _counted);
+    }
+  }
+  ProfileScope(ProfileScope const &) = delete;
+  ProfileScope &operator=(ProfileScope const &) = delete;
+
+private:
+  ProfilePhase _phase;
+  ThreadProfile *_thread = nullptr;
+  std::chrono::steady_clock::time_point _start;
+  uint64_t _counters[4] = {};
+  bool _counted = false;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(phase)                                                   \
+  ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(ProfilePhase::phase)
+
+#else
+
+#define PROFILE_SCOPE(phase)
+
+#endif
+
+// Switches profiling on, with `counters` also the hardware performance
+// counters via perf_event_open. Returns false if profiling is not compiled
+// in.
+bool startProfiling(bool counters);
+
+// Prints the breakdown table of all threads.
+void printProfile(std::ostream &out, double wallTime);
@@ -0,0 +1,139 @@
+// TaskPool.cpp - work stealing thread pool
+
+#include "TaskPool.h"
+
+#include <chrono>
+
+namespace {
+
+// The pool and index of a pool thread:
+thread_local TaskPool const *currentPool = nullptr;
+thread_local size_t currentPoolIndex = 0;
+
+} // namespace
+
+TaskPool::TaskPool(size_t threads, std::function<void(size_t)> const &init)
+    : _nrThreads(threads == 0 ? 1 : threads) {
+  for (size_t i = 0; i <= _nrThreads; ++i) {
+    _queues.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < _nrThreads; ++i) {
+    _threads.emplace_back([this, i, init] {
+      currentPool = this;
+      currentPoolIndex = i;
+      if (init) {
+        init(i);
+      }
+      work(i);
+    });
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> guard(_sleepMutex);
+    _stop = true;
+  }
+  _sleep.notify_all();
+  for (auto &t : _threads) {
+    t.join();
+  }
+}
+
+size_t TaskPool::currentIndex() const {
+  return currentPool == this ? currentPoolIndex : _nrThreads;
+}
+
+void TaskPool::submit(Task task) {
+  size_t index = currentIndex(); // the outside queue for other threads
+  {
+    std::lock_guard<std::mutex> guard(_queues[index]->mutex);
+    _queues[index]->tasks.push_back(std::move(task));
+  }
+  _queued.fetch_add(1);
+  {
+    // A thread going to sleep checks _queued with this mutex held:
+    std::lock_guard<std::mutex> guard(_sleepMutex);
+  }
+  _sleep.notify_one();
+}
+
+bool TaskPool::runOne() {
+  if (_queued.load() == 0) {
+    return false;
+  }
+  size_t n = _nrThreads;
+  size_t self = currentIndex();
+  Task task;
+  if (self < n) {
+    Queue &q = *_queues[self];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    }
+  }
+  // The outside queue comes first, then the other threads:
+  for (size_t k = 0; !task && k <= n; ++k) {
+    Queue &q = *_queues[(n + k) % (n + 1)];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  _queued.fetch_sub(1);
+  task();
+  return true;
+}
+
+void TaskPool::work(size_t) {
+  while (true) {
+    if (runOne()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> guard(_sleepMutex);
+    _sleep.wait(guard, [this] { return _stop || _queued.load() > 0; });
+    if (_stop && _queued.load() == 0) {
+      return;
+    }
+  }
+}
+
+void TaskGroup::run(TaskPool::Task task) {
+  _open.fetch_add(1);
+  _pool.submit([this, task = std::move(task)] {
+    task();
+    // The waiter only returns with the mutex held, so the group is still
+    // there until this is done:
+    std::lock_guard<std::mutex> guard(_mutex);
+    _open.fetch_sub(1);
+    _cond.notify_all();
+  });
+}
+
+void TaskGroup::join() {
+  std::unique_lock<std::mutex> guard(_mutex);
+  _cond.wait(guard, [this] { return _open.load() == 0; });
+}
+
+void TaskGroup::waitUntil(std::function<bool()> const &done) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(_mutex);
+      if (done()) {
+        return;
+      }
+    }
+    if (_pool.runOne()) {
+      continue;
+    }
+    // Everything is running elsewhere, or is about to be queued by a task
+    // which is running, so look again after a short while:
+    std::unique_lock<std::mutex> guard(_mutex);
+    _cond.wait_for(guard, std::chrono::milliseconds(1), done);
+  }
+}
@@ -0,0 +1,94 @@
+// TaskPool.h - a pool of threads with work stealing: every thread has a
+// deque of tasks, takes the newest task of its own and, when that is empty,
+// the oldest task submitted from outside of the pool or else steals the
+// oldest task of another thread
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskPool {
+public:
+  using Task = std::function<void()>;
+
+  // Starts `threads` threads (at least one), `init(index)` runs first in
+  // each of them, for example to name the thread.
+  explicit TaskPool(size_t threads,
+                    std::function<void(size_t)> const &init = {});
+  // Runs the remaining tasks and joins the threads.
+  ~TaskPool();
+  TaskPool(TaskPool const &) = delete;
+  TaskPool &operator=(TaskPool const &) = delete;
+
+  size_t threads() const { return _nrThreads; }
+
+  // Index of the pool thread which calls this, threads() for other threads:
+  size_t currentIndex() const;
+
+  // Queues `task` on the deque of the calling thread if it belongs to the
+  // pool, otherwise on a queue for outside tasks, which are started in the
+  // order of submission.
+  void submit(Task task);
+
+  // Runs one queued task in the calling thread, the newest of its own deque,
+  // the oldest from outside or the oldest of another thread. Returns false
+  // if there was none.
+  bool runOne();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void work(size_t index);
+
+  size_t const _nrThreads;
+  // One per thread and the last one for tasks from outside:
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::atomic<size_t> _queued{0}; // tasks in all queues
+  std::mutex _sleepMutex;
+  std::condition_variable _sleep;
+  bool _stop = false;
+  std::vector<std::thread> _threads;
+};
+
+// Tasks which are waited for together. Waiting runs queued tasks of the
+// pool in the meantime, so a task of the pool can wait for tasks it
+// submitted without blocking a thread.
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskPool &pool) : _pool(pool) {}
+  ~TaskGroup() { wait(); }
+  TaskGroup(TaskGroup const &) = delete;
+  TaskGroup &operator=(TaskGroup const &) = delete;
+
+  void run(TaskPool::Task task);
+
+  // Waits until `done()` is true, which must only change when a task of
+  // this group finishes:
+  void waitUntil(std::function<bool()> const &done);
+
+  // Waits until at most `n` tasks of the group are unfinished:
+  void wait(size_t n = 0) {
+    waitUntil([this, n] { return _open.load() <= n; });
+  }
+
+  // Waits for all tasks without running any, for a thread outside of the
+  // pool which should not add to its threads:
+  void join();
+
+private:
+  TaskPool &_pool;
+  std::atomic<size_t> _open{0};
+  std::mutex _mutex;
+  std::condition_variable _cond;
+};
@@ -0,0 +1,139 @@
+// Trace.cpp - record per-thread activity spans in Chrome trace-event format
+
+#include "Trace.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+  char const *name;
+  std::string arg;
+  uint64_t start;
+  uint64_t end;
+};
+
+// The buffer of one thread. Buffers are linked into a lock-free list when a
+// thread records its first span and live until the end of the process.
+struct TraceBuffer {
+  size_t tid;
+  std::string threadName;
+  std::vector<TraceEvent> events;
+  TraceBuffer *next = nullptr;
+};
+
+std::chrono::steady_clock::time_point traceStart;
+std::atomic<TraceBuffer *> buffers{nullptr};
+std::atomic<size_t> nextTid{0};
+
+TraceBuffer &threadBuffer() {
+  thread_local TraceBuffer *mine = nullptr;
+  if (mine == nullptr) {
+    mine = new TraceBuffer();
+    mine->tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+    mine->events.reserve(1024);
+    mine->next = buffers.load(std::memory_order_relaxed);
+    while (!buffers.compare_exchange_weak(mine->next, mine,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+  return *mine;
+}
+
+void writeJsonString(std::ostream &out, std::string const &s) {
+  out << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out << buf;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+} // namespace
+
+namespace tracing {
+
+bool enabled = false;
+
+uint64_t now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - traceStart)
+          .count());
+}
+
+void record(char const *name, std::string const &arg, uint64_t start,
+            uint64_t end) {
+  threadBuffer().events.push_back(TraceEvent{name, arg, start, end});
+}
+
+} // namespace tracing
+
+void startTracing(std::chrono::steady_clock::time_point startTime) {
+  traceStart = startTime;
+  tracing::enabled = true;
+}
+
+void setTraceThreadName(std::string const &name) {
+  if (tracing::enabled) {
+    threadBuffer().threadName = name;
+  }
+}
+
+bool writeTrace(std::string const &fileName) {
+  std::ofstream out(fileName, std::ios_base::out | std::ios_base::trunc);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  auto sep = [&]() {
+    if (!first) {
+      out << ",\n";
+    }
+    first = false;
+  };
+  out.setf(std::ios::fixed);
+  out.precision(3);
+  for (TraceBuffer *b = buffers.load(std::memory_order_acquire); b != nullptr;
+       b = b->next) {
+    sep();
+    out << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << b->tid
+        << R"(,"args":{"name":)";
+    writeJsonString(out, b->threadName.empty()
+                             ? "thread " + std::to_string(b->tid)
+                             : b->threadName);
+    out << "}}";
+    for (auto const &e : b->events) {
+      sep();
+      out << R"({"name":)";
+      writeJsonString(out, e.name);
+      out << R"(,"cat":"smartifier2","ph":"X","pid":1,"tid":)" << b->tid
+          << R"(,"ts":)" << e.start / 1000.0 << R"(,"dur":)"
+          << (e.end - e.start) / 1000.0;
+      if (!e.arg.empty()) {
+        out << R"(,"args":{"file":)";
+        writeJsonString(out, e.arg);
+        out << '}';
+      }
+      out << '}';
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+  if (!out.good()) {
+    std::cerr << "An error happened when writing the trace file " << fileName
+              << "." << std::endl;
+    return false;
+  }
+  return true;
+}
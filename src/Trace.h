@@ -0,0 +1,96 @@
+// Trace.h - record per-thread activity spans and export them in the Chrome
+// trace-event format, which can be inspected with Perfetto or
+// chrome://tracing
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace tracing {
+
+extern bool enabled;
+
+// Nanoseconds since the start of tracing:
+uint64_t now();
+
+// Appends a complete span to the buffer of the calling thread. Every thread
+// has its own buffer, so this does not need a lock.
+void record(char const *name, std::string const &arg, uint64_t start,
+            uint64_t end);
+
+} // namespace tracing
+
+// Records a span from construction to destruction. `name` must be a string
+// literal, `arg` is shown as argument (usually a file name).
+class TraceSpan {
+public:
+  explicit TraceSpan(char const *name, std::string arg = std::string())
+      : _name(name) {
+    if (tracing::enabled) {
+      _arg = std::move(arg);
+      _start = tracing::now();
+    }
+  }
+  ~TraceSpan() {
+    if (tracing::enabled) {
+      tracing::record(_name, _arg, _start, tracing::now());
+    }
+  }
+  TraceSpan(TraceSpan const &) = delete;
+  TraceSpan &operator=(TraceSpan const &) = delete;
+
+private:
+  char const *_name;
+  std::string _arg;
+  uint64_t _start = 0;
+};
+
+// For loops over lines: records one span per `chunkSize` calls of `tick`.
+class TraceChunks {
+public:
+  TraceChunks(char const *name, std::string arg, uint64_t chunkSize = 100000)
+      : _name(name), _chunkSize(chunkSize) {
+    if (tracing::enabled) {
+      _arg = std::move(arg);
+      _start = tracing::now();
+    }
+  }
+  ~TraceChunks() { flush(); }
+
+  void tick() {
+    if (tracing::enabled && ++_count >= _chunkSize) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (tracing::enabled && _count > 0) {
+      uint64_t end = tracing::now();
+      tracing::record(_name, _arg, _start, end);
+      _start = end;
+      _count = 0;
+    }
+  }
+
+  TraceChunks(TraceChunks const &) = delete;
+  TraceChunks &operator=(TraceChunks const &) = delete;
+
+private:
+  char const *_name;
+  std::string _arg;
+  uint64_t _chunkSize;
+  uint64_t _count = 0;
+  uint64_t _start = 0;
+};
+
+// Switches tracing on, timestamps are relative to `startTime`.
+void startTracing(std::chrono::steady_clock::time_point startTime);
+
+// Names the calling thread in the trace.
+void setTraceThreadName(std::string const &name);
+
+// Writes all recorded spans of all threads to `fileName`. Must only be
+// called when no other thread records spans any more.
+bool writeTrace(std::string const &fileName);
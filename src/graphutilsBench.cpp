@@ -0,0 +1,687 @@
+// graphutilsBench.cpp - end-to-end benchmark: generates graphs with
+// sampleGraphMaker and runs the vertices and edges modes of smartifier2 on
+// them with various settings, the results are written as CSV or JSON.
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CommandLineParsing.h"
+#include "CpuDispatch.h"
+#include "GraphUtilsConfig.h"
+
+static const char USAGE[] =
+    R"(graphutils_bench - End-to-end benchmark of smartifier2
+
+    Usage:
+      graphutils_bench [ --dir <dir> ]
+                       [ --vertices <n> ]
+                       [ --edges <n> ]
+                       [ --collections <n> ]
+                       [ --types <types> ]
+                       [ --threads <list> ]
+                       [ --memory <list> ]
+                       [ --repeat <n> ]
+                       [ --seed <seed> ]
+                       [ --format <format> ]
+                       [ --output <file> ]
+                       [ --bin-dir <dir> ]
+                       [ --compare <baseline> ]
+                       [ --max-slowdown <fraction> ]
+                       [ --max-rss-growth <fraction> ]
+
+    Options:
+      --help (-h)                   Show this screen.
+      --version (-v)                Show version.
+      --dir <dir>                   Directory for the generated graphs and
+                                    the logs of the runs [default: bench].
+      --vertices <n>                Vertices per collection
+                                    [default: 1000000].
+      --edges <n>                   Edges per collection [default: 2000000].
+      --collections <n>             Number of vertex and edge collections,
+                                    each made by its own run of
+                                    sampleGraphMaker [default: 1].
+      --types <types>               Comma separated data types
+                                    [default: csv,jsonl].
+      --threads <list>              Comma separated thread counts,
+                                    `--threads` of the edge mode and
+                                    `--chunk-threads` of the vertex mode
+                                    [default: 1,4].
+      --memory <list>               Comma separated memory limits in MiB for
+                                    the edge mode [default: 4096,256].
+      --repeat <n>                  Repetitions of every run [default: 1].
+      --seed <seed>                 Seed of the first collection, the others
+                                    use the following numbers [default: 1].
+      --format <format>             "csv" or "json" [default: csv].
+      --output <file>               Where to write the results ("-" for
+                                    stdout) [default: -].
+      --bin-dir <dir>               Where smartifier2 and sampleGraphMaker
+                                    are, by default the directory of this
+                                    executable.
+      --compare <baseline>          Compare with the results of an earlier
+                                    run written with `--format csv`, fail
+                                    if a setting got slower or needs more
+                                    memory than the tolerances allow.
+      --max-slowdown <fraction>     Tolerated loss of throughput for
+                                    --compare [default: 0.25].
+      --max-rss-growth <fraction>   Tolerated growth of the peak RSS for
+                                    --compare [default: 0.2].
+
+    For every type the graphs are generated once. Then the vertex files are
+    transformed with `smartifier2 vertices` for every thread count and, for
+    every combination of threads and memory limit, a fresh copy of the edge
+    files with `smartifier2 edges`. A result row has the wall time, the throughput in
+    lines and bytes of input per second, the peak RSS of the smartifier2
+    process and the number of passes over the edge files.
+
+    With --compare the median throughput and peak RSS over the repetitions
+    of every setting are compared with the baseline, the differences are
+    printed and the exit code is 8 if there is a regression or a setting
+    of the baseline was not run.
+)";
+
+struct RunResult {
+  std::string mode;
+  std::string type;
+  size_t threads = 0;
+  size_t memory = 0; // MiB, 0 for the vertex mode
+  size_t repetition = 0;
+  double seconds = 0;
+  uint64_t lines = 0;
+  uint64_t bytes = 0;
+  uint64_t peakRss = 0; // bytes
+  size_t passes = 0;
+  int exitCode = 0;
+};
+
+std::vector<size_t> parseList(std::string const &s) {
+  std::vector<size_t> res;
+  std::istringstream in(s);
+  std::string item;
+  while (getline(in, item, ',')) {
+    if (!item.empty()) {
+      res.push_back(strtoul(item.c_str(), nullptr, 10));
+    }
+  }
+  return res;
+}
+
+std::vector<std::string> parseStringList(std::string const &s) {
+  std::vector<std::string> res;
+  std::istringstream in(s);
+  std::string item;
+  while (getline(in, item, ',')) {
+    if (!item.empty()) {
+      res.push_back(item);
+    }
+  }
+  return res;
+}
+
+// Runs `argv` with stdout and stderr appended to `logFile`, returns the
+// exit code (-1 if the program could not be run) and sets the wall time
+// and the peak RSS of the child.
+int runCommand(std::vector<std::string> const &argv, std::string const &logFile,
+               double &seconds, uint64_t &peakRss) {
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "Could not fork: " << strerror(errno) << std::endl;
+    return -1;
+  }
+  if (pid == 0) {
+    int fd = ::open(logFile.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+      ::dup2(fd, 1);
+      ::dup2(fd, 2);
+      ::close(fd);
+    }
+    std::vector<char *> cargv;
+    for (auto const &a : argv) {
+      cargv.push_back(const_cast<char *>(a.c_str()));
+    }
+    cargv.push_back(nullptr);
+    ::execv(cargv[0], cargv.data());
+    _exit(127);
+  }
+  int status = 0;
+  struct rusage usage;
+  if (::wait4(pid, &status, 0, &usage) < 0) {
+    std::cerr << "Could not wait for child: " << strerror(errno) << std::endl;
+    return -1;
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count();
+  peakRss = static_cast<uint64_t>(usage.ru_maxrss) * 1024; // in kB
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  return -1;
+}
+
+// Number of newlines in a file:
+uint64_t countLines(std::string const &fileName) {
+  std::ifstream in(fileName, std::ios::in | std::ios::binary);
+  std::vector<char> buf(1 << 20);
+  uint64_t count = 0;
+  while (in) {
+    in.read(buf.data(), buf.size());
+    count += countNewlines(buf.data(), in.gcount());
+  }
+  return count;
+}
+
+// The number of passes over the edge files of a run, the `pass` field of
+// the final report in its `--metrics` stream, 0 if there is none:
+size_t readPasses(std::string const &metricsFile) {
+  std::ifstream in(metricsFile);
+  std::string line;
+  size_t passes = 0;
+  while (getline(in, line)) {
+    if (line.find("\"final\":true") == std::string::npos) {
+      continue;
+    }
+    size_t pos = line.find("\"pass\":");
+    if (pos != std::string::npos) {
+      passes = strtoul(line.c_str() + pos + 7, nullptr, 10);
+    }
+  }
+  return passes;
+}
+
+// sampleGraphMaker always calls the vertex collection "profiles", to get
+// distinct collections the references in the edges are renamed.
+bool renameCollection(std::string const &fileName, std::string const &to) {
+  std::string tmp = fileName + ".tmp";
+  {
+    std::ifstream in(fileName);
+    std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+    std::string const from = "profiles/";
+    std::string line;
+    while (getline(in, line)) {
+      size_t pos = 0;
+      while ((pos = line.find(from, pos)) != std::string::npos) {
+        line.replace(pos, from.size(), to + "/");
+        pos += to.size() + 1;
+      }
+      out << line << '\n';
+    }
+    out.close();
+    if (!out.good()) {
+      std::cerr << "Could not write " << tmp << "." << std::endl;
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, fileName);
+  return true;
+}
+
+void writeResults(std::ostream &out, std::string const &format,
+                  std::vector<RunResult> const &results, size_t collections,
+                  uint64_t nrVertices, uint64_t nrEdges) {
+  auto rate = [](uint64_t n, double secs) { return secs > 0 ? n / secs : 0.0; };
+  if (format == "json") {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      auto const &r = results[i];
+      out << "  {\"mode\":\"" << r.mode << "\",\"type\":\"" << r.type
+          << "\",\"collections\":" << collections
+          << ",\"vertices\":" << nrVertices << ",\"edges\":" << nrEdges
+          << ",\"threads\":" << r.threads << ",\"memoryMB\":" << r.memory
+          << ",\"repetition\":" << r.repetition
+          << ",\"seconds\":" << r.seconds << ",\"lines\":" << r.lines
+          << ",\"bytes\":" << r.bytes
+          << ",\"linesPerSecond\":" << rate(r.lines, r.seconds)
+          << ",\"bytesPerSecond\":" << rate(r.bytes, r.seconds)
+          << ",\"peakRss\":" << r.peakRss << ",\"passes\":" << r.passes
+          << ",\"exitCode\":" << r.exitCode << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+  } else {
+    out << "mode,type,collections,vertices,edges,threads,memory_mb,"
+           "repetition,seconds,lines,bytes,lines_per_second,bytes_per_second,"
+           "peak_rss,passes,exit_code\n";
+    for (auto const &r : results) {
+      out << r.mode << ',' << r.type << ',' << collections << ','
+          << nrVertices << ',' << nrEdges << ',' << r.threads << ','
+          << r.memory << ',' << r.repetition << ',' << r.seconds << ','
+          << r.lines << ',' << r.bytes << ',' << rate(r.lines, r.seconds)
+          << ',' << rate(r.bytes, r.seconds) << ',' << r.peakRss << ','
+          << r.passes << ',' << r.exitCode << '\n';
+    }
+  }
+  out << std::flush;
+}
+
+// Reads results written with `--format csv`, returns false if the file
+// cannot be read or does not look like such results.
+bool readResultsCSV(std::string const &fileName,
+                    std::vector<RunResult> &results) {
+  std::ifstream in(fileName);
+  std::string line;
+  if (!getline(in, line)) {
+    return false;
+  }
+  std::vector<std::string> header = parseStringList(line);
+  auto col = [&](char const *name) -> int {
+    auto it = std::find(header.begin(), header.end(), name);
+    return it == header.end() ? -1 : static_cast<int>(it - header.begin());
+  };
+  int mode = col("mode"), type = col("type"), threads = col("threads"),
+      memory = col("memory_mb"), rep = col("repetition"),
+      seconds = col("seconds"), lines = col("lines"), bytes = col("bytes"),
+      peakRss = col("peak_rss"), passes = col("passes"),
+      exitCode = col("exit_code");
+  for (int c : {mode, type, threads, memory, rep, seconds, lines, bytes,
+                peakRss, passes, exitCode}) {
+    if (c < 0) {
+      return false;
+    }
+  }
+  while (getline(in, line)) {
+    std::vector<std::string> f;
+    std::istringstream fields(line);
+    std::string item;
+    while (getline(fields, item, ',')) {
+      f.push_back(item);
+    }
+    if (f.size() < header.size()) {
+      continue;
+    }
+    RunResult r;
+    r.mode = f[mode];
+    r.type = f[type];
+    r.threads = strtoul(f[threads].c_str(), nullptr, 10);
+    r.memory = strtoul(f[memory].c_str(), nullptr, 10);
+    r.repetition = strtoul(f[rep].c_str(), nullptr, 10);
+    r.seconds = strtod(f[seconds].c_str(), nullptr);
+    r.lines = strtoull(f[lines].c_str(), nullptr, 10);
+    r.bytes = strtoull(f[bytes].c_str(), nullptr, 10);
+    r.peakRss = strtoull(f[peakRss].c_str(), nullptr, 10);
+    r.passes = strtoul(f[passes].c_str(), nullptr, 10);
+    r.exitCode = atoi(f[exitCode].c_str());
+    results.push_back(r);
+  }
+  return true;
+}
+
+// The medians over the repetitions of one setting:
+struct Summary {
+  uint64_t lines = 0;
+  double linesPerSecond = 0;
+  double peakRss = 0;
+  size_t passes = 0;
+};
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+std::map<std::string, Summary>
+summarize(std::vector<RunResult> const &results) {
+  std::map<std::string, std::vector<RunResult const *>> groups;
+  for (auto const &r : results) {
+    std::string key =
+        r.mode + " " + r.type + " threads=" + std::to_string(r.threads);
+    if (r.mode == "edges") {
+      key += " memory=" + std::to_string(r.memory);
+    }
+    groups[key].push_back(&r);
+  }
+  std::map<std::string, Summary> res;
+  for (auto const &g : groups) {
+    std::vector<double> rates, rss;
+    Summary s;
+    for (auto const *r : g.second) {
+      rates.push_back(r->seconds > 0 ? r->lines / r->seconds : 0.0);
+      rss.push_back(static_cast<double>(r->peakRss));
+      s.lines = r->lines;
+      s.passes = std::max(s.passes, r->passes);
+    }
+    s.linesPerSecond = median(rates);
+    s.peakRss = median(rss);
+    res[g.first] = s;
+  }
+  return res;
+}
+
+// Prints the differences to the baseline, returns false on a regression.
+bool compareWithBaseline(std::vector<RunResult> const &baseline,
+                         std::vector<RunResult> const &results,
+                         double maxSlowdown, double maxRssGrowth) {
+  auto base = summarize(baseline);
+  auto cur = summarize(results);
+  bool ok = true;
+  std::cout << "\nComparison with the baseline (medians):\n"
+            << std::left << std::setw(40) << "setting" << std::right
+            << std::setw(14) << "lines/s" << std::setw(9) << "delta"
+            << std::setw(12) << "RSS MB" << std::setw(9) << "delta"
+            << std::setw(8) << "passes" << "  verdict\n";
+  for (auto const &c : cur) {
+    std::cout << std::left << std::setw(40) << c.first << std::right
+              << std::fixed << std::setprecision(0) << std::setw(14)
+              << c.second.linesPerSecond;
+    auto it = base.find(c.first);
+    if (it == base.end()) {
+      std::cout << std::setw(9) << "" << std::setw(12) << std::setprecision(1)
+                << c.second.peakRss / (1024 * 1024) << std::setw(9) << ""
+                << std::setw(8) << c.second.passes << "  no baseline\n"
+                << std::defaultfloat;
+      continue;
+    }
+    Summary const &b = it->second;
+    double rateDelta = b.linesPerSecond > 0
+                           ? c.second.linesPerSecond / b.linesPerSecond - 1
+                           : 0.0;
+    double rssDelta = b.peakRss > 0 ? c.second.peakRss / b.peakRss - 1 : 0.0;
+    std::string verdict = "ok";
+    if (b.lines != c.second.lines) {
+      verdict = "DIFFERENT WORKLOAD";
+    } else if (rateDelta < -maxSlowdown) {
+      verdict = "SLOWER";
+    } else if (rssDelta > maxRssGrowth) {
+      verdict = "MORE MEMORY";
+    }
+    if (verdict != "ok") {
+      ok = false;
+    }
+    std::cout << std::showpos << std::setprecision(1) << std::setw(8)
+              << 100 * rateDelta << '%' << std::noshowpos << std::setw(12)
+              << c.second.peakRss / (1024 * 1024) << std::showpos
+              << std::setw(8) << 100 * rssDelta << '%' << std::noshowpos
+              << std::setw(8) << c.second.passes;
+    if (c.second.passes != b.passes) {
+      std::cout << " (was " << b.passes << ")";
+    }
+    std::cout << "  " << verdict << '\n' << std::defaultfloat;
+  }
+  // A setting which is no longer run would otherwise go unnoticed:
+  for (auto const &b : base) {
+    if (cur.find(b.first) == cur.end()) {
+      ok = false;
+      std::cout << std::left << std::setw(40) << b.first << std::right
+                << std::setw(14) << "" << std::setw(9) << ""
+                << std::setw(12) << "" << std::setw(9) << "" << std::setw(8)
+                << "" << "  MISSING\n";
+    }
+  }
+  std::cout << (ok ? "No performance regression."
+                   : "Performance regression, see above.")
+            << std::endl;
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  OptionConfig optionConfig = {
+      {"--help", OptionConfigItem(ArgType::Bool, "false", "-h")},
+      {"--version", OptionConfigItem(ArgType::Bool, 0, "-v")},
+      {"--dir", OptionConfigItem(ArgType::StringOnce, "bench")},
+      {"--vertices", OptionConfigItem(ArgType::StringOnce, "1000000")},
+      {"--edges", OptionConfigItem(ArgType::StringOnce, "2000000")},
+      {"--collections", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--types", OptionConfigItem(ArgType::StringOnce, "csv,jsonl")},
+      {"--threads", OptionConfigItem(ArgType::StringOnce, "1,4")},
+      {"--memory", OptionConfigItem(ArgType::StringOnce, "4096,256")},
+      {"--repeat", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--seed", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--format", OptionConfigItem(ArgType::StringOnce, "csv")},
+      {"--output", OptionConfigItem(ArgType::StringOnce, "-")},
+      {"--bin-dir", OptionConfigItem(ArgType::StringOnce)},
+      {"--compare", OptionConfigItem(ArgType::StringOnce)},
+      {"--max-slowdown", OptionConfigItem(ArgType::StringOnce, "0.25")},
+      {"--max-rss-growth", OptionConfigItem(ArgType::StringOnce, "0.2")},
+  };
+
+  Options options;
+  std::vector<std::string> args;
+  if (parseCommandLineArgs(USAGE, optionConfig, argc, argv, options, args) !=
+      0) {
+    return -1;
+  }
+  if ((*getOption(options, "--help").value())[0] == "true") {
+    std::cout << USAGE << std::endl;
+    return 0;
+  }
+  auto version = getOption(options, "--version");
+  if (version && (*version.value())[0] == "true") {
+    std::cout << "graphutils_bench: Version " GRAPHUTILS_VERSION_MAJOR
+                 "." GRAPHUTILS_VERSION_MINOR
+              << std::endl;
+    return 0;
+  }
+  if (!args.empty()) {
+    std::cerr << "No positional arguments expected, giving up.\n"
+              << USAGE << std::endl;
+    return 1;
+  }
+
+  auto opt = [&](char const *name) {
+    return (*getOption(options, name).value())[0];
+  };
+  std::filesystem::path dir = opt("--dir");
+  uint64_t nrVertices = strtoull(opt("--vertices").c_str(), nullptr, 10);
+  uint64_t nrEdges = strtoull(opt("--edges").c_str(), nullptr, 10);
+  size_t collections = strtoul(opt("--collections").c_str(), nullptr, 10);
+  std::vector<std::string> types = parseStringList(opt("--types"));
+  std::vector<size_t> threadCounts = parseList(opt("--threads"));
+  std::vector<size_t> memoryLimits = parseList(opt("--memory"));
+  size_t repeat = strtoul(opt("--repeat").c_str(), nullptr, 10);
+  uint64_t seed = strtoull(opt("--seed").c_str(), nullptr, 10);
+  std::string format = opt("--format");
+  if (nrVertices == 0 || collections == 0 || repeat == 0 ||
+      threadCounts.empty() || memoryLimits.empty()) {
+    std::cerr << "Need positive numbers of vertices, collections and "
+                 "repetitions and at least one thread count and memory "
+                 "limit, giving up."
+              << std::endl;
+    return 1;
+  }
+  for (auto const &t : types) {
+    if (t != "csv" && t != "jsonl") {
+      std::cerr << "Unknown type " << t << ", giving up." << std::endl;
+      return 1;
+    }
+  }
+  if (format != "csv" && format != "json") {
+    std::cerr << "Unknown format " << format << ", giving up." << std::endl;
+    return 1;
+  }
+
+  std::filesystem::path binDir;
+  auto binDirOpt = getOption(options, "--bin-dir");
+  if (binDirOpt) {
+    binDir = (*binDirOpt.value())[0];
+  } else {
+    std::error_code ec;
+    binDir = std::filesystem::read_symlink("/proc/self/exe", ec).parent_path();
+  }
+  std::string smartifier = (binDir / "smartifier2").string();
+  std::string graphMaker = (binDir / "sampleGraphMaker").string();
+  for (auto const &b : {smartifier, graphMaker}) {
+    if (::access(b.c_str(), X_OK) != 0) {
+      std::cerr << "Cannot execute " << b << ", use --bin-dir, giving up."
+                << std::endl;
+      return 2;
+    }
+  }
+
+  std::vector<RunResult> baseline;
+  auto compare = getOption(options, "--compare");
+  if (compare && !readResultsCSV((*compare.value())[0], baseline)) {
+    std::cerr << "Could not read baseline " << (*compare.value())[0]
+              << ", giving up." << std::endl;
+    return 1;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Could not create directory " << dir << ": " << ec.message()
+              << std::endl;
+    return 3;
+  }
+  std::string logFile = (dir / "bench.log").string();
+  std::string metricsFile = (dir / "metrics.jsonl").string();
+
+  std::vector<RunResult> results;
+  for (auto const &type : types) {
+    // Generate the graphs:
+    std::vector<std::string> vertexFiles, smartVertexFiles, edgeFiles,
+        workFiles, collNames;
+    uint64_t vertexLines = 0, vertexBytes = 0, edgeLines = 0, edgeBytes = 0;
+    for (size_t c = 0; c < collections; ++c) {
+      std::string base = (dir / (type + std::to_string(c))).string();
+      std::string collName = "profiles" + std::to_string(c);
+      std::cerr << "Generating " << base << " ..." << std::endl;
+      double secs;
+      uint64_t rss;
+      int res = runCommand({graphMaker, "--type=" + type, base,
+                            std::to_string(nrVertices),
+                            std::to_string(nrEdges), std::to_string(seed + c)},
+                           logFile, secs, rss);
+      if (res != 0) {
+        std::cerr << "sampleGraphMaker failed with exit code " << res
+                  << ", see " << logFile << ", giving up." << std::endl;
+        return 4;
+      }
+      std::string vfile = base + "_profiles." + type;
+      std::string efile = base + "_relations." + type;
+      if (!renameCollection(efile, collName)) {
+        return 5;
+      }
+      vertexFiles.push_back(vfile);
+      smartVertexFiles.push_back(base + "_smart_profiles." + type);
+      edgeFiles.push_back(efile);
+      workFiles.push_back(base + "_work_relations." + type);
+      collNames.push_back(collName);
+      vertexLines += countLines(vfile);
+      vertexBytes += std::filesystem::file_size(vfile);
+      edgeLines += countLines(efile);
+      edgeBytes += std::filesystem::file_size(efile);
+    }
+
+    // Vertex mode, one row for all collections per thread count:
+    for (size_t threads : threadCounts) {
+      for (size_t rep = 0; rep < repeat; ++rep) {
+        RunResult r;
+        r.mode = "vertices";
+        r.type = type;
+        r.threads = threads;
+        r.repetition = rep;
+        r.lines = vertexLines;
+        r.bytes = vertexBytes;
+        for (size_t c = 0; c < collections; ++c) {
+          std::cerr << "Running vertices on " << vertexFiles[c] << " with "
+                    << threads << " threads ..." << std::endl;
+          double secs = 0;
+          uint64_t rss = 0;
+          int res = runCommand(
+              {smartifier, "vertices", "--type", type, "--input",
+               vertexFiles[c], "--output", smartVertexFiles[c],
+               "--smart-graph-attribute", "country", "--chunk-threads",
+               std::to_string(threads)},
+              logFile, secs, rss);
+          r.seconds += secs;
+          r.peakRss = std::max(r.peakRss, rss);
+          if (res != 0) {
+            r.exitCode = res;
+          }
+        }
+        results.push_back(r);
+      }
+    }
+
+    // Edge mode:
+    for (size_t threads : threadCounts) {
+      for (size_t memory : memoryLimits) {
+        for (size_t rep = 0; rep < repeat; ++rep) {
+          // Only the final report of the metrics, for the passes:
+          std::vector<std::string> cmd = {smartifier,
+                                          "edges",
+                                          "--type",
+                                          type,
+                                          "--threads",
+                                          std::to_string(threads),
+                                          "--memory",
+                                          std::to_string(memory),
+                                          "--metrics",
+                                          metricsFile,
+                                          "--metrics-interval",
+                                          "0"};
+          std::filesystem::remove(metricsFile, ec);
+          for (size_t c = 0; c < collections; ++c) {
+            std::filesystem::copy_file(
+                edgeFiles[c], workFiles[c],
+                std::filesystem::copy_options::overwrite_existing);
+            cmd.push_back("--vertices");
+            cmd.push_back(collNames[c] + ":" + smartVertexFiles[c]);
+            cmd.push_back("--edges");
+            cmd.push_back(workFiles[c] + ":" + collNames[c] + ":" +
+                          collNames[c]);
+          }
+          std::cerr << "Running edges of " << type << " with " << threads
+                    << " threads and " << memory << " MiB ..." << std::endl;
+          RunResult r;
+          r.mode = "edges";
+          r.type = type;
+          r.threads = threads;
+          r.memory = memory;
+          r.repetition = rep;
+          r.lines = edgeLines;
+          r.bytes = edgeBytes;
+          r.exitCode = runCommand(cmd, logFile, r.seconds, r.peakRss);
+          r.passes = readPasses(metricsFile);
+          results.push_back(r);
+        }
+      }
+    }
+    for (auto const &f : workFiles) {
+      std::filesystem::remove(f, ec);
+    }
+  }
+
+  std::string outputFile = opt("--output");
+  if (outputFile == "-") {
+    writeResults(std::cout, format, results, collections, nrVertices,
+                 nrEdges);
+  } else {
+    std::ofstream out(outputFile, std::ios::out | std::ios::trunc);
+    writeResults(out, format, results, collections, nrVertices, nrEdges);
+    out.close();
+    if (!out.good()) {
+      std::cerr << "An error happened when writing " << outputFile << "."
+                << std::endl;
+      return 6;
+    }
+  }
+  for (auto const &r : results) {
+    if (r.exitCode != 0) {
+      std::cerr << "Some runs failed, see " << logFile << "." << std::endl;
+      return 7;
+    }
+  }
+  if (compare &&
+      !compareWithBaseline(
+          baseline, results, strtod(opt("--max-slowdown").c_str(), nullptr),
+          strtod(opt("--max-rss-growth").c_str(), nullptr))) {
+    return 8;
+  }
+  return 0;
+}
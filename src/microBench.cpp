@@ -0,0 +1,375 @@
+// microBench.cpp - microbenchmark of the per-line kernels of smartifier2 on
+// synthetic lines, to judge kernel-level optimizations
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CommandLineParsing.h"
+#include "GraphUtilsConfig.h"
+#include "Kernels.h"
+
+static const char USAGE[] =
+    R"(graphutils_microbench - Microbenchmark of the smartifier2 kernels
+
+    Usage:
+      graphutils_microbench [ --lines <n> ]
+                            [ --repeat <n> ]
+                            [ --kernels <list> ]
+                            [ --hit-ratio <list> ]
+                            [ --seed <seed> ]
+                            [ --format <format> ]
+
+    Options:
+      --help (-h)                   Show this screen.
+      --version (-v)                Show version.
+      --lines <n>                   Lines per line mix [default: 100000].
+      --repeat <n>                  Timed repetitions of every measurement,
+                                    the statistics are over these
+                                    [default: 10].
+      --kernels <list>              Comma separated subset of split,
+                                    unquote, quote, learn, sha1, translate
+                                    [default: split,unquote,quote,learn,sha1,translate].
+      --hit-ratio <list>            Comma separated fractions of edge
+                                    endpoints which are found in the
+                                    translation [default: 1,0.5,0].
+      --seed <seed>                 Seed of the line generator [default: 1].
+      --format <format>             "table" or "csv" [default: table].
+
+    The line mixes are "short" (short unquoted fields), "long" (long
+    unquoted fields) and "quoted" (quoted fields with separators and
+    doubled quotes inside) for split, unquote, quote and sha1, and
+    "numeric" and "string" keys for learn and translate. Every measurement
+    is repeated, reported are the median, minimum and relative standard
+    deviation of the nanoseconds per item and the bytes/s at the median.
+    The item is what the kernel works on: a line for split, a field for
+    unquote, quote and sha1, a key for learn and an endpoint for
+    translate.
+)";
+
+namespace {
+
+std::mt19937_64 rng;
+
+std::string randomString(size_t minLen, size_t maxLen,
+                         std::string const &alphabet) {
+  size_t len = minLen + rng() % (maxLen - minLen + 1);
+  std::string s;
+  s.reserve(len);
+  for (size_t i = 0; i < len; ++i) {
+    s.push_back(alphabet[rng() % alphabet.size()]);
+  }
+  return s;
+}
+
+std::string const letters =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ;.-";
+std::vector<std::string> const countries = {"DE", "US", "FR", "UK",
+                                            "AU", "CA", "MX"};
+
+// CSV lines with 8 fields:
+std::vector<std::string> makeLines(std::string const &mix, size_t n) {
+  std::vector<std::string> lines;
+  lines.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    std::string line;
+    for (size_t f = 0; f < 8; ++f) {
+      if (f > 0) {
+        line.push_back(',');
+      }
+      if (mix == "short") {
+        line += randomString(1, 8, letters);
+      } else if (mix == "long") {
+        line += randomString(40, 200, letters);
+      } else { // quoted
+        std::string v = randomString(4, 40, letters);
+        v.insert(rng() % v.size(), ",");
+        v.insert(rng() % v.size(), "\"\"");
+        line += "\"" + v + "\"";
+      }
+    }
+    lines.push_back(std::move(line));
+  }
+  return lines;
+}
+
+// Vertex keys without the smart graph attribute:
+std::vector<std::string> makeKeys(std::string const &mix, size_t n) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    if (mix == "numeric") {
+      keys.push_back(std::to_string(1000000 + i));
+    } else {
+      keys.push_back("person-" + randomString(12, 24, letters.substr(0, 52)) +
+                     "-" + std::to_string(i));
+    }
+  }
+  return keys;
+}
+
+struct Stats {
+  double median = 0; // ns per item
+  double min = 0;
+  double relStddev = 0;
+};
+
+// Runs `body` over `items` items `repeat` times, `prepare` before every run
+// is not timed.
+Stats measure(size_t repeat, size_t items, std::function<void()> prepare,
+              std::function<void()> body) {
+  std::vector<double> ns;
+  for (size_t r = 0; r < repeat; ++r) {
+    prepare();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() /
+                 static_cast<double>(items));
+  }
+  std::sort(ns.begin(), ns.end());
+  Stats s;
+  s.median = ns.size() % 2 == 1
+                 ? ns[ns.size() / 2]
+                 : (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]) / 2;
+  s.min = ns[0];
+  double mean = 0;
+  for (double x : ns) {
+    mean += x;
+  }
+  mean /= ns.size();
+  double var = 0;
+  for (double x : ns) {
+    var += (x - mean) * (x - mean);
+  }
+  s.relStddev = mean > 0 ? std::sqrt(var / ns.size()) / mean : 0;
+  return s;
+}
+
+// Keeps the compiler from dropping the results:
+volatile size_t sink = 0;
+void keep(size_t x) { sink = sink + x; }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  OptionConfig optionConfig = {
+      {"--help", OptionConfigItem(ArgType::Bool, "false", "-h")},
+      {"--version", OptionConfigItem(ArgType::Bool, 0, "-v")},
+      {"--lines", OptionConfigItem(ArgType::StringOnce, "100000")},
+      {"--repeat", OptionConfigItem(ArgType::StringOnce, "10")},
+      {"--kernels", OptionConfigItem(ArgType::StringOnce,
+                                     "split,unquote,quote,learn,sha1,"
+                                     "translate")},
+      {"--hit-ratio", OptionConfigItem(ArgType::StringOnce, "1,0.5,0")},
+      {"--seed", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--format", OptionConfigItem(ArgType::StringOnce, "table")},
+  };
+
+  Options options;
+  std::vector<std::string> args;
+  if (parseCommandLineArgs(USAGE, optionConfig, argc, argv, options, args) !=
+      0) {
+    return -1;
+  }
+  if ((*getOption(options, "--help").value())[0] == "true") {
+    std::cout << USAGE << std::endl;
+    return 0;
+  }
+  auto version = getOption(options, "--version");
+  if (version && (*version.value())[0] == "true") {
+    std::cout << "graphutils_microbench: Version " GRAPHUTILS_VERSION_MAJOR
+                 "." GRAPHUTILS_VERSION_MINOR
+              << std::endl;
+    return 0;
+  }
+  auto opt = [&](char const *name) {
+    return (*getOption(options, name).value())[0];
+  };
+  size_t nrLines = strtoul(opt("--lines").c_str(), nullptr, 10);
+  size_t repeat = strtoul(opt("--repeat").c_str(), nullptr, 10);
+  std::string format = opt("--format");
+  if (nrLines == 0 || repeat == 0) {
+    std::cerr << "Need positive numbers of lines and repetitions, giving up."
+              << std::endl;
+    return 1;
+  }
+  if (format != "table" && format != "csv") {
+    std::cerr << "Unknown format " << format << ", giving up." << std::endl;
+    return 1;
+  }
+  std::vector<std::string> kernels;
+  {
+    std::istringstream in(opt("--kernels"));
+    std::string k;
+    while (getline(in, k, ',')) {
+      if (k != "split" && k != "unquote" && k != "quote" && k != "learn" &&
+          k != "sha1" && k != "translate") {
+        std::cerr << "Unknown kernel " << k << ", giving up." << std::endl;
+        return 1;
+      }
+      kernels.push_back(k);
+    }
+  }
+  std::vector<double> hitRatios;
+  {
+    std::istringstream in(opt("--hit-ratio"));
+    std::string h;
+    while (getline(in, h, ',')) {
+      hitRatios.push_back(strtod(h.c_str(), nullptr));
+    }
+  }
+  rng.seed(strtoull(opt("--seed").c_str(), nullptr, 10));
+
+  if (format == "table") {
+    std::cout << std::left << std::setw(10) << "kernel" << std::setw(18)
+              << "mix" << std::right << std::setw(10) << "items"
+              << std::setw(13) << "unit" << std::setw(10) << "median"
+              << std::setw(10) << "min" << std::setw(9) << "rsd%"
+              << std::setw(12) << "MB/s" << '\n';
+  } else {
+    std::cout << "kernel,mix,item,items,bytes,ns_per_item_median,"
+                 "ns_per_item_min,rel_stddev,bytes_per_second\n";
+  }
+  // `item` is what one unit of `items` is, e.g. "line" or "field":
+  auto report = [&](std::string const &kernel, std::string const &mix,
+                    std::string const &item, size_t items, uint64_t bytes,
+                    Stats const &s) {
+    double bytesPerSec = s.median > 0 ? bytes / (s.median * items / 1e9) : 0.0;
+    if (format == "table") {
+      std::cout << std::left << std::setw(10) << kernel << std::setw(18) << mix
+                << std::right << std::setw(10) << items << std::setw(13)
+                << "ns/" + item << std::fixed << std::setprecision(1)
+                << std::setw(10) << s.median << std::setw(10) << s.min
+                << std::setw(9) << 100 * s.relStddev << std::setw(12)
+                << bytesPerSec / 1e6 << std::defaultfloat << std::endl;
+    } else {
+      std::cout << kernel << ',' << mix << ',' << item << ',' << items << ','
+                << bytes << ',' << s.median << ',' << s.min << ','
+                << s.relStddev << ',' << bytesPerSec << std::endl;
+    }
+  };
+  auto wanted = [&](char const *k) {
+    return std::find(kernels.begin(), kernels.end(), k) != kernels.end();
+  };
+  auto nothing = []() {};
+
+  for (std::string mix : {"short", "long", "quoted"}) {
+    std::vector<std::string> lines = makeLines(mix, nrLines);
+    uint64_t lineBytes = 0;
+    std::vector<std::string> fields;
+    for (auto const &l : lines) {
+      lineBytes += l.size() + 1;
+      for (auto &f : split(l, ',', '"')) {
+        fields.push_back(std::move(f));
+      }
+    }
+    uint64_t fieldBytes = 0;
+    std::vector<std::string> unquoted;
+    for (auto const &f : fields) {
+      fieldBytes += f.size();
+      unquoted.push_back(unquote(f, '"'));
+    }
+    uint64_t unquotedBytes = 0;
+    for (auto const &f : unquoted) {
+      unquotedBytes += f.size();
+    }
+
+    if (wanted("split")) {
+      report("split", mix, "line", nrLines, lineBytes,
+             measure(repeat, nrLines, nothing, [&]() {
+               for (auto const &l : lines) {
+                 keep(split(l, ',', '"').size());
+               }
+             }));
+    }
+    if (wanted("unquote")) {
+      report("unquote", mix, "field", fields.size(), fieldBytes,
+             measure(repeat, fields.size(), nothing, [&]() {
+               for (auto const &f : fields) {
+                 keep(unquote(f, '"').size());
+               }
+             }));
+    }
+    if (wanted("quote")) {
+      report("quote", mix, "field", fields.size(), unquotedBytes,
+             measure(repeat, fields.size(), nothing, [&]() {
+               for (auto const &f : unquoted) {
+                 keep(quote(f, '"').size());
+               }
+             }));
+    }
+    if (wanted("sha1")) {
+      report("sha1", mix, "field", fields.size(), unquotedBytes,
+             measure(repeat, fields.size(), nothing, [&]() {
+               for (auto const &f : unquoted) {
+                 keep(calculateSha1(f).size());
+               }
+             }));
+    }
+  }
+
+  for (std::string mix : {"numeric", "string"}) {
+    std::vector<std::string> keys = makeKeys(mix, nrLines);
+    std::vector<std::string> smartKeys;
+    uint64_t smartKeyBytes = 0;
+    for (auto const &k : keys) {
+      smartKeys.push_back(countries[rng() % countries.size()] + ":" + k);
+      smartKeyBytes += smartKeys.back().size();
+    }
+
+    if (wanted("learn")) {
+      std::unique_ptr<Translation> trans;
+      report("learn", mix, "key", nrLines, smartKeyBytes,
+             measure(
+                 repeat, nrLines,
+                 [&]() { trans = std::make_unique<Translation>(); },
+                 [&]() {
+                   for (auto const &k : smartKeys) {
+                     learnSmartKey(*trans, k, "profiles");
+                   }
+                   keep(trans->keyCount());
+                 }));
+    }
+
+    if (wanted("translate")) {
+      Translation trans;
+      for (auto const &k : smartKeys) {
+        learnSmartKey(trans, k, "profiles");
+      }
+      for (double hitRatio : hitRatios) {
+        // One endpoint per line, misses refer to keys which are not known:
+        std::vector<std::string> endpoints;
+        uint64_t endpointBytes = 0;
+        for (size_t i = 0; i < nrLines; ++i) {
+          std::string const &k = keys[rng() % keys.size()];
+          bool hit = static_cast<double>(rng() % 1000000) / 1000000 < hitRatio;
+          endpoints.push_back("profiles/" + (hit ? k : k + "x"));
+          endpointBytes += endpoints.back().size();
+        }
+        std::vector<std::string> work;
+        std::ostringstream label;
+        label << mix << " hit " << hitRatio;
+        report("translate", label.str(), "endpoint", nrLines, endpointBytes,
+               measure(
+                   repeat, nrLines, [&]() { work = endpoints; },
+                   [&]() {
+                     for (auto &e : work) {
+                       keep(translateEndpointCSV(trans, e, "profiles", '"',
+                                                    -1)
+                                   .size());
+                     }
+                   }));
+      }
+    }
+  }
+  return 0;
+}
@@ -1,15 +1,26 @@
 // This program creates a social-network like graph as CSV data
 
 #include <docopt.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include <fstream>
+#include <atomic>
+#include <barrier>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "BlockIO.h"
+#include "CounterRng.h"
+#include "Distribution.h"
+#include "GraphTopology.h"
 #include "GraphUtilsConfig.h"
+#include "Kernels.h"
 #include "velocypack/Builder.h"
 #include "velocypack/Parser.h"
 #include "velocypack/Slice.h"
@@ -19,14 +30,74 @@ static const char USAGE[] =
     R"(SampleGraphMaker - make a sample social graph of configurable size
 
     Usage:
-      sampleGraphMaker [--type=<type>] 
+      sampleGraphMaker [--type=<type>] [--rng=<rng>] [--threads=<threads>]
+               [--topology=<topology>] [--rmat=<abc>]
+               [--exponent=<exponent>] [--communities=<communities>]
+               [--intra=<intra>] [--country-by-community]
+               [--countries=<countries>] [--country-distribution=<dist>]
+               [--attribute-distribution=<dist>]
+               [--collections=<collections>] [--shards=<shards>]
+               [--only=<part>] [--format=<format>] [--manifest=<file>]
                <baseName> <numberVertices> <numberEdges> [<seed>]
 
     Options:
       -h --help                Show this screen.
       --version                Show version.
       --type=<type>            Data type "csv" or "jsonl" [default: csv].
-      <baseName>               Name prefix for files.
+      --rng=<rng>              Random generator: "mt19937" is one sequential
+                               stream, "counter" derives the numbers of every
+                               vertex and edge from the seed and its number,
+                               which allows more than one thread
+                               [default: mt19937].
+      --threads=<threads>      Number of threads, needs --rng=counter, the
+                               output does not depend on it [default: 1].
+      --topology=<topology>    How the endpoints of the edges are chosen:
+                               "uniform", "rmat" (R-MAT/Kronecker),
+                               "chunglu" (power-law degrees) or "community"
+                               (planted communities) [default: uniform].
+      --rmat=<abc>             Probabilities of the upper left, upper right
+                               and lower left quadrant for R-MAT
+                               [default: 0.57,0.19,0.19].
+      --exponent=<exponent>    Exponent of the power law of the degrees for
+                               chunglu, larger than 2 [default: 2.5].
+      --communities=<communities>
+                               Number of communities, blocks of vertices
+                               with consecutive keys [default: 1].
+      --intra=<intra>          Fraction of the edges within a community for
+                               chunglu and community [default: 0.9].
+      --country-by-community   The country of a vertex is determined by its
+                               community.
+      --countries=<countries>  Number of distinct countries, the smart graph
+                               attribute, 0 for the seven built-in ones
+                               [default: 0].
+      --country-distribution=<dist>
+                               Distribution of the countries: "uniform",
+                               "zipf:<exponent>" or "histogram:<file>" with
+                               lines "<country>,<weight>" [default: uniform].
+      --attribute-distribution=<dist>
+                               Distribution of the email names, streets and
+                               cities: "uniform" or "zipf:<exponent>"
+                               [default: uniform].
+      --collections=<collections>
+                               Number of vertex collections, "profiles" for
+                               one, otherwise "profiles0", "profiles1" and so
+                               on. Each gets a block of consecutive keys and
+                               the edges link all of them [default: 1].
+      --shards=<shards>        Number of files per vertex collection and for
+                               the edges [default: 1].
+      --only=<part>            Write only "vertices" or "edges" instead of
+                               "both" [default: both].
+      --format=<format>        "raw" for the usual files, "smart" for files
+                               in smart graph format with the country as
+                               smart graph attribute, "both" for the usual
+                               files and next to each the expected result of
+                               smartifier2, "<name>_expected.<type>",
+                               "manifest" like "both" but the expected files
+                               only appear in the manifest [default: raw].
+      --manifest=<file>        Write the SHA1 checksums of all files to
+                               <file>, in the format of sha1sum.
+      <baseName>               Name prefix for files, "-" for stdout, which
+                               needs --only and one file.
       <numberVertices>         Number of vertices.
       <numberEdges>            Number of edges.
       <seed>                   Smart graph attribute [default: 1].
@@ -34,111 +105,718 @@ static const char USAGE[] =
 
 enum DataType { CSV = 0, JSONL = 1 };
 
+struct GraphSpec {
+  DataType type = CSV;
+  long nrVert = 0;
+  Topology topology;
+  bool countryByCommunity = false;
+  std::vector<std::string> countries;
+  std::vector<std::string> collections;
+  Distribution countryDist;
+  Distribution emailDist;
+  Distribution streetDist;
+  Distribution cityDist;
+  uint64_t seed = 0;
+  bool counterRng = false;
+  // With the sequential generator the smart graph keys of the edges need the
+  // country of every vertex, as index into `countries`:
+  std::vector<uint32_t> vertexCountries;
+
+  // Vertex collection of vertex v (1-based):
+  std::string const& collectionOf(long v) const {
+    return collections[blockOf(v - 1, collections.size(), nrVert)];
+  }
+
+  // Country of vertex v (1-based):
+  std::string const& countryOf(long v) const;
+};
+
+// The two forms of every file: as it comes from the source and in smart
+// graph format, as smartifier2 makes it out of the former.
+enum OutputForm { Raw = 0, Smart = 1, NrForms = 2 };
+
+// One output file with the items `first` to `last`, which may be empty. A
+// form with an empty name is not written. If no form is written, the items
+// are still made but thrown away, which keeps the sequential random
+// generator in step.
+struct OutputFile {
+  std::string names[NrForms];  // "-" for stdout
+  // Only the checksum of the smart form goes into the manifest:
+  bool smartOnlyChecksum = false;
+  std::string collection;
+  long first;
+  long last;
+};
+
+// The writers of the forms of the current item, nullptr if not written:
+struct Outputs {
+  BlockWriter* out[NrForms] = {nullptr, nullptr};
+};
+
+// Progress messages go to stderr when the data goes to stdout:
+std::ostream* info = &std::cout;
+
+// The streams of CounterRng:
+enum RngStream : uint64_t { VertexStream = 0, EdgeStream = 1 };
+
 std::vector<std::string> cities = {"San Francisco", "New York", "Eppelheim"};
 std::vector<std::string> streets = {"Main Street", "Baker Street",
                                     "Butcher Street"};
 std::vector<std::string> emails = {"miller", "meier", "hans", "karl"};
 std::vector<std::string> countries = {"DE", "US", "FR", "UK", "AU", "CA", "MX"};
 
+struct Vertex {
+  size_t country;  // index into GraphSpec::countries
+  std::string const* email;
+  uint64_t age;
+  uint64_t gender;
+  uint64_t zip;
+  uint64_t houseNumber;
+  std::string const* street;
+  std::string const* city;
+};
+
+// The country is drawn in any case to keep the other attributes the same:
+template <typename Rng>
+size_t drawCountry(GraphSpec const& spec, long i, Rng& random) {
+  size_t drawn = spec.countryDist.draw(random);
+  return spec.countryByCommunity
+             ? communityOf(spec.topology, i - 1, spec.nrVert) %
+                   spec.countries.size()
+             : drawn;
+}
+
+// Draws the attributes of vertex number `i`. `random` is either the one
+// sequential generator or the counter-based one of this vertex, it is called
+// in the same order in both cases.
+template <typename Rng>
+Vertex drawVertex(GraphSpec const& spec, long i, Rng& random) {
+  Vertex v;
+  v.country = drawCountry(spec, i, random);
+  v.email = &emails[spec.emailDist.draw(random)];
+  v.age = (random() % 80) + 20;
+  v.gender = random() % 2;
+  v.zip = random() % 100000 + 1;
+  v.houseNumber = (random() % 100) + 1;
+  v.street = &streets[spec.streetDist.draw(random)];
+  v.city = &cities[spec.cityDist.draw(random)];
+  return v;
+}
+
+std::string const& GraphSpec::countryOf(long v) const {
+  if (counterRng) {
+    CounterRng random(seed, VertexStream, v);
+    return countries[drawCountry(*this, v, random)];
+  }
+  return countries[vertexCountries[v - 1]];
+}
+
+void appendAddress(BlockWriter& outv, Vertex const& v) {
+  outv.appendNumber(v.houseNumber);
+  outv.append(' ');
+  outv.append(*v.street);
+  outv.append(';');
+  outv.append(*v.city);
+  outv.append(';');
+  outv.appendNumber(v.zip);
+}
+
+// Writes vertex number `i`. In smart graph format the key is prefixed with
+// the country and, for JSONL, the attributes are in the order of smartifier2:
+// `_key`, the smart graph attribute and then the others sorted.
+void writeVertex(BlockWriter& outv, GraphSpec const& spec, long i,
+                 Vertex const& v, bool smart) {
+  std::string const& country = spec.countries[v.country];
+  if (spec.type == CSV) {
+    if (smart) {
+      outv.append(country);
+      outv.append(':');
+      outv.appendNumber(i);
+      outv.append(",name");
+    } else {
+      outv.append('"');
+      outv.appendNumber(i);
+      outv.append("\",name");
+    }
+    outv.appendNumber(i);
+    outv.append(',');
+    outv.appendNumber(i);
+    outv.append(',');
+    outv.append(country);
+    outv.append(",\"");
+    outv.appendNumber(1518384838843 + i);
+    outv.append("\",");
+    outv.append(*v.email);
+    outv.append("@person");
+    outv.appendNumber(i);
+    outv.append(".com,");
+    outv.appendNumber(v.age);
+    outv.append(v.gender == 0 ? ",M," : ",F,");
+    appendAddress(outv, v);
+    outv.append('\n');
+  } else if (smart) {  // JSONL
+    outv.append(R"({"_key":")");
+    outv.append(country);
+    outv.append(':');
+    outv.appendNumber(i);
+    outv.append(R"(","country":")");
+    outv.append(country);
+    outv.append(R"(","address":")");
+    appendAddress(outv, v);
+    outv.append(R"(","age":)");
+    outv.appendNumber(v.age);
+    outv.append(R"(,"email":")");
+    outv.append(*v.email);
+    outv.append("@person");
+    outv.appendNumber(i);
+    outv.append(v.gender == 0 ? R"(.com","gender":"M","keybak":)"
+                              : R"(.com","gender":"F","keybak":)");
+    outv.appendNumber(i);
+    outv.append(R"(,"name":"name)");
+    outv.appendNumber(i);
+    outv.append(R"(","telephone":")");
+    outv.appendNumber(1518384838843 + i);
+    outv.append("\"}\n");
+  } else {  // JSONL
+    outv.append(R"({"_key":")");
+    outv.appendNumber(i);
+    outv.append(R"(","name":"name)");
+    outv.appendNumber(i);
+    outv.append(R"(","keybak":)");
+    outv.appendNumber(i);
+    outv.append(R"(,"country":")");
+    outv.append(country);
+    outv.append(R"(","telephone":")");
+    outv.appendNumber(1518384838843 + i);
+    outv.append(R"(","email":")");
+    outv.append(*v.email);
+    outv.append("@person");
+    outv.appendNumber(i);
+    outv.append(R"(.com","age":)");
+    outv.appendNumber(v.age);
+    outv.append(v.gender == 0 ? R"(,"gender":"M","address":")"
+                              : R"(,"gender":"F","address":")");
+    appendAddress(outv, v);
+    outv.append("\"}\n");
+  }
+}
+
+// Writes edge number `i`. In smart graph format the key becomes
+// `<from country>:<i>:<to country>` and the endpoints get the countries of
+// their vertices as prefix of the key.
+void writeEdge(BlockWriter& oute, GraphSpec const& spec, long i, long from,
+               long to, bool smart) {
+  std::string const* fromCountry = smart ? &spec.countryOf(from) : nullptr;
+  std::string const* toCountry = smart ? &spec.countryOf(to) : nullptr;
+  oute.append(spec.type == CSV ? (smart ? "" : "\"") : R"({"_key":")");
+  if (smart) {
+    oute.append(*fromCountry);
+    oute.append(':');
+  }
+  oute.appendNumber(i);
+  if (smart) {
+    oute.append(':');
+    oute.append(*toCountry);
+  }
+  oute.append(spec.type == CSV ? (smart ? "," : "\",") : R"(","_from":")");
+  oute.append(spec.collectionOf(from));
+  oute.append('/');
+  if (smart) {
+    oute.append(*fromCountry);
+    oute.append(':');
+  }
+  oute.appendNumber(from);
+  oute.append(spec.type == CSV ? "," : R"(","_to":")");
+  oute.append(spec.collectionOf(to));
+  oute.append('/');
+  if (smart) {
+    oute.append(*toCountry);
+    oute.append(':');
+  }
+  oute.appendNumber(to);
+  oute.append(spec.type == CSV ? "\n" : "\"}\n");
+}
+
+void reportProgress(long before, long done, long total, char const* what) {
+  for (long m = (before / 1000000 + 1) * 1000000; m <= done; m += 1000000) {
+    *info << "Have written " << m << " " << what << " out of " << total
+          << " ..." << std::endl;
+  }
+}
+
+int openOutput(std::string const& fileName) {
+  if (fileName == "-") {
+    return STDOUT_FILENO;
+  }
+  int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Could not open " << fileName << ": " << strerror(errno)
+              << ", giving up." << std::endl;
+  }
+  return fd;
+}
+
+bool closeOutput(int fd, std::string const& fileName, bool ok) {
+  if (fd != STDOUT_FILENO && close(fd) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    std::cerr << "Could not write " << fileName << ": " << strerror(errno)
+              << ", giving up." << std::endl;
+  }
+  return ok;
+}
+
+// The line of a file in the checksum manifest, as sha1sum prints it:
+void addToManifest(std::vector<std::string>* manifest,
+                   std::string const& fileName, Sha1Stream& digest) {
+  if (manifest != nullptr) {
+    manifest->push_back(digest.hexDigest() + "  " + fileName);
+  }
+}
+
+constexpr long segmentSize = 65536;  // items per thread and round
+
+// Writes `header` and then the items of `f` with `nrThreads` threads. The
+// items are made in rounds, in every round each thread formats a segment of
+// consecutive items into memory. At the end of the round the offsets of the
+// segments follow from their sizes and all threads write their segments at
+// the same time with pwrite. Pipes and FIFOs cannot do that, there the first
+// thread writes all segments in order. If `manifest` is given, the SHA1 of
+// every file is added to it. Returns false on errors.
+template <typename Item>
+bool writeParallel(OutputFile const& f, std::string const& header,
+                   long total, size_t nrThreads, Item const& item,
+                   char const* what, std::vector<std::string>* manifest) {
+  int fds[NrForms] = {-1, -1};
+  bool seekable[NrForms] = {false, false};
+  std::vector<BlockWriter> segments[NrForms];
+  std::vector<off_t> offsets[NrForms];
+  off_t fileSizes[NrForms] = {0, 0};
+  Sha1Stream digests[NrForms];
+  std::atomic<bool> ok = true;
+  for (int form = 0; form < NrForms; ++form) {
+    if (f.names[form].empty()) {
+      continue;
+    }
+    fds[form] = openOutput(form == Smart && f.smartOnlyChecksum
+                               ? std::string("/dev/null")
+                               : f.names[form]);
+    if (fds[form] < 0) {
+      if (form == Smart && fds[Raw] >= 0) {
+        closeOutput(fds[Raw], f.names[Raw], true);
+      }
+      return false;
+    }
+    seekable[form] = lseek(fds[form], 0, SEEK_CUR) >= 0;
+    segments[form] = std::vector<BlockWriter>(nrThreads);
+    offsets[form].resize(nrThreads);
+    fileSizes[form] = header.size();
+    digests[form].update(header.data(), header.size());
+    if (!writeAll(fds[form], header.data(), header.size(),
+                  seekable[form] ? 0 : -1)) {
+      ok = false;
+    }
+  }
+  long roundStart = f.first;
+
+  // Runs when all threads have made their segments of a round:
+  auto placeSegments = [&]() noexcept {
+    for (int form = 0; form < NrForms; ++form) {
+      for (size_t t = 0; t < segments[form].size(); ++t) {
+        BlockWriter const& seg = segments[form][t];
+        offsets[form][t] = fileSizes[form];
+        fileSizes[form] += seg.size();
+        if (manifest != nullptr) {
+          digests[form].update(seg.data(), seg.size());
+        }
+      }
+    }
+  };
+  std::barrier formatted(nrThreads, placeSegments);
+  auto nextRound = [&]() noexcept {
+    long done =
+        std::min(f.last, roundStart + segmentSize * (long)nrThreads - 1);
+    reportProgress(roundStart - 1, done, total, what);
+    roundStart = done + 1;
+  };
+  std::barrier written(nrThreads, nextRound);
+
+  auto work = [&](size_t t) {
+    Outputs out;
+    for (int form = 0; form < NrForms; ++form) {
+      if (fds[form] >= 0) {
+        out.out[form] = &segments[form][t];
+      }
+    }
+    while (roundStart <= f.last) {
+      long first = roundStart + segmentSize * (long)t;
+      long last = std::min(f.last, first + segmentSize - 1);
+      for (BlockWriter* o : out.out) {
+        if (o != nullptr) {
+          o->clear();
+        }
+      }
+      for (long i = first; i <= last; ++i) {
+        item(out, i);
+      }
+      formatted.arrive_and_wait();
+      for (int form = 0; form < NrForms; ++form) {
+        if (fds[form] < 0) {
+          continue;
+        }
+        if (seekable[form]) {
+          BlockWriter const& seg = segments[form][t];
+          if (!writeAll(fds[form], seg.data(), seg.size(),
+                        offsets[form][t])) {
+            ok = false;
+          }
+        } else if (t == 0) {
+          for (auto const& seg : segments[form]) {
+            if (!writeAll(fds[form], seg.data(), seg.size())) {
+              ok = false;
+            }
+          }
+        }
+      }
+      written.arrive_and_wait();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < nrThreads; ++t) {
+    threads.emplace_back(work, t);
+  }
+  work(0);
+  for (auto& th : threads) {
+    th.join();
+  }
+  bool res = ok;
+  for (int form = 0; form < NrForms; ++form) {
+    if (fds[form] >= 0) {
+      res = closeOutput(fds[form], f.names[form], ok) && res;
+      addToManifest(manifest, f.names[form], digests[form]);
+    }
+  }
+  return res;
+}
+
+// Writes `header` and then the items of `f` in one thread.
+template <typename Item>
+bool writeSequential(OutputFile const& f, std::string const& header,
+                     long total, Item const& item, char const* what,
+                     std::vector<std::string>* manifest) {
+  int fds[NrForms] = {-1, -1};
+  std::unique_ptr<BlockWriter> writers[NrForms];
+  Sha1Stream digests[NrForms];
+  Outputs out;
+  for (int form = 0; form < NrForms; ++form) {
+    if (f.names[form].empty()) {
+      continue;
+    }
+    fds[form] = openOutput(form == Smart && f.smartOnlyChecksum
+                               ? std::string("/dev/null")
+                               : f.names[form]);
+    if (fds[form] < 0) {
+      if (form == Smart && fds[Raw] >= 0) {
+        closeOutput(fds[Raw], f.names[Raw], true);
+      }
+      return false;
+    }
+    writers[form] = std::make_unique<BlockWriter>(fds[form]);
+    if (manifest != nullptr) {
+      writers[form]->hashInto(&digests[form]);
+    }
+    writers[form]->append(header);
+    out.out[form] = writers[form].get();
+  }
+  for (long i = f.first; i <= f.last; ++i) {
+    item(out, i);
+    if (i % 1000000 == 0) {
+      reportProgress(i - 1, i, total, what);
+    }
+  }
+  bool res = true;
+  for (int form = 0; form < NrForms; ++form) {
+    if (fds[form] >= 0) {
+      res = closeOutput(fds[form], f.names[form], writers[form]->flush()) &&
+            res;
+      addToManifest(manifest, f.names[form], digests[form]);
+    }
+  }
+  return res;
+}
+
 int main(int argc, char* argv[]) {
   std::map<std::string, docopt::value> args =
       docopt::docopt(USAGE, {argv + 1, argv + argc},
                      true,  // show help if requested
                      "sampleGraphMaker V" GRAPHUTILS_VERSION_MAJOR
                      "." GRAPHUTILS_VERSION_MINOR);  // version string
-  DataType type = CSV;
+  GraphSpec spec;
   if (args["--type"].asString() == "jsonl") {
-    type = JSONL;
+    spec.type = JSONL;
   }
+  DataType type = spec.type;
   std::string name = args["<baseName>"].asString();
-  std::string vname = name + "_profiles." + (type == CSV ? "csv" : "jsonl");
-  std::string ename = name + "_relations." + (type == CSV ? "csv" : "jsonl");
   long nrVert = args["<numberVertices>"].asLong();
+  spec.nrVert = nrVert;
   long nrEdge = args["<numberEdges>"].asLong();
   long seed = args["<seed>"].asLong();
+  std::string rng = args["--rng"].asString();
+  long nrThreads = args["--threads"].asLong();
+  if (rng != "mt19937" && rng != "counter") {
+    std::cerr << "Unknown random generator " << rng << ", giving up."
+              << std::endl;
+    return 1;
+  }
+  if (nrThreads < 1 || (nrThreads > 1 && rng != "counter")) {
+    std::cerr << "--threads must be at least 1 and more than one thread "
+                 "needs --rng=counter, giving up."
+              << std::endl;
+    return 1;
+  }
+
+  std::string error = parseTopology(
+      spec.topology, args["--topology"].asString(), args["--rmat"].asString(),
+      std::stod(args["--exponent"].asString()), args["--communities"].asLong(),
+      std::stod(args["--intra"].asString()), nrVert);
+  if (!error.empty()) {
+    std::cerr << error << ", giving up." << std::endl;
+    return 1;
+  }
+  spec.countryByCommunity = args["--country-by-community"].asBool();
+  long nrCountries = args["--countries"].asLong();
+  if (nrCountries < 0) {
+    std::cerr << "--countries must not be negative, giving up." << std::endl;
+    return 1;
+  }
+  spec.countries = countries;
+  if (nrCountries > 0) {
+    spec.countries.clear();
+    for (long c = 1; c <= nrCountries; ++c) {
+      spec.countries.push_back("C" + std::to_string(c));
+    }
+  }
+  std::string attributeDist = args["--attribute-distribution"].asString();
+  if (attributeDist.compare(0, 10, "histogram:") == 0) {
+    error = "histograms are only supported for the countries";
+  }
+  // The lists of the other attributes stay fixed, only the weights change:
+  std::vector<std::string> e = emails, st = streets, ci = cities;
+  for (auto const& err :
+       {error,
+        spec.countryDist.setup(args["--country-distribution"].asString(),
+                               spec.countries),
+        spec.emailDist.setup(attributeDist, e),
+        spec.streetDist.setup(attributeDist, st),
+        spec.cityDist.setup(attributeDist, ci)}) {
+    if (!err.empty()) {
+      std::cerr << err << ", giving up." << std::endl;
+      return 1;
+    }
+  }
+
+  long nrCollections = args["--collections"].asLong();
+  long nrShards = args["--shards"].asLong();
+  std::string only = args["--only"].asString();
+  bool toStdout = name == "-";
+  if (nrCollections < 1 || nrShards < 1) {
+    std::cerr << "--collections and --shards must be at least 1, giving up."
+              << std::endl;
+    return 1;
+  }
+  if (only != "both" && only != "vertices" && only != "edges") {
+    std::cerr << "--only must be vertices, edges or both, giving up."
+              << std::endl;
+    return 1;
+  }
+  std::string format = args["--format"].asString();
+  if (format != "raw" && format != "smart" && format != "both" &&
+      format != "manifest") {
+    std::cerr << "--format must be raw, smart, both or manifest, giving up."
+              << std::endl;
+    return 1;
+  }
+  if (format == "manifest" && !args["--manifest"]) {
+    std::cerr << "--format manifest needs --manifest, giving up."
+              << std::endl;
+    return 1;
+  }
+  if (toStdout &&
+      (only == "both" || nrShards > 1 || format == "both" ||
+       format == "manifest" ||
+       (only == "vertices" && nrCollections > 1))) {
+    std::cerr << "Writing to stdout needs --only and a single file, giving up."
+              << std::endl;
+    return 1;
+  }
+  if (toStdout) {
+    info = &std::cerr;
+  }
+
+  // The files, in the order of the keys of their items:
+  std::string ext = type == CSV ? "csv" : "jsonl";
+  for (long c = 0; c < nrCollections; ++c) {
+    spec.collections.push_back(nrCollections == 1
+                                   ? std::string("profiles")
+                                   : "profiles" + std::to_string(c));
+  }
+  auto fileName = [&](std::string const& what, long s, OutputForm form,
+                      bool wanted) {
+    if (!wanted || (form == Raw && format == "smart") ||
+        (form == Smart && format == "raw")) {
+      return std::string();
+    }
+    if (toStdout) {
+      return std::string("-");
+    }
+    return name + "_" + what + (nrShards > 1 ? "_" + std::to_string(s) : "") +
+           (form == Smart && format != "smart" ? "_expected." : ".") + ext;
+  };
+  std::vector<OutputFile> vfiles;
+  std::vector<OutputFile> efiles;
+  for (long c = 0; c < nrCollections; ++c) {
+    long first = blockStart(c, nrCollections, nrVert);
+    long size = blockStart(c + 1, nrCollections, nrVert) - first;
+    for (long s = 0; s < nrShards; ++s) {
+      vfiles.push_back(
+          {{fileName(spec.collections[c], s, Raw, only != "edges"),
+            fileName(spec.collections[c], s, Smart, only != "edges")},
+           format == "manifest", spec.collections[c],
+           first + blockStart(s, nrShards, size) + 1,
+           first + blockStart(s + 1, nrShards, size)});
+    }
+  }
+  for (long s = 0; s < nrShards; ++s) {
+    efiles.push_back({{fileName("relations", s, Raw, only != "vertices"),
+                       fileName("relations", s, Smart, only != "vertices")},
+                      format == "manifest", "relations",
+                      blockStart(s, nrShards, nrEdge) + 1,
+                      blockStart(s + 1, nrShards, nrEdge)});
+  }
+
+  std::string vheader =
+      type == CSV
+          ? "_key,name,keybak,country,telephone,email,age,gender,address\n"
+          : "";
+  std::string eheader = type == CSV ? "_key,_from,_to\n" : "";
 
-  // Random:
-  std::mt19937_64 random;
-  random.seed(seed);
-
-  std::fstream outv(vname, std::ios_base::out);
-
-  if (type == CSV) {
-    outv << "_key,name,keybak,country,telephone,email,age,gender,address\n";
-    for (long i = 1; i <= nrVert; ++i) {
-      outv << '"' << i << "\",name" << i << "," << i << ","
-           << countries[random() % countries.size()] << ",\""
-           << 1518384838843 + i << "\"," << emails[random() % emails.size()]
-           << "@person" << i << ".com,";
-      auto age = (random() % 80) + 20;
-      auto gender = random() % 2;
-      auto zip = random() % 100000 + 1;
-      outv << age << "," << (gender == 0 ? "M," : "F,") << (random() % 100) + 1
-           << " " << streets[random() % streets.size()] << ";"
-           << cities[random() % cities.size()] << ";" << zip << "\n";
-      if (i % 1000000 == 0) {
-        std::cout << "Have written " << i << " vertices out of " << nrVert
-                  << " ..." << std::endl;
+  std::vector<std::string> manifestLines;
+  std::vector<std::string>* manifest =
+      args["--manifest"] ? &manifestLines : nullptr;
+  auto unwritten = [](OutputFile const& f) {
+    return f.names[Raw].empty() && f.names[Smart].empty();
+  };
+  spec.seed = static_cast<uint64_t>(seed);
+  spec.counterRng = rng == "counter";
+  auto vertexOut = [&](Outputs& out, long i, Vertex const& v) {
+    for (int form = 0; form < NrForms; ++form) {
+      if (out.out[form] != nullptr) {
+        writeVertex(*out.out[form], spec, i, v, form == Smart);
       }
     }
-  } else {  // JSONL
-    for (long i = 1; i <= nrVert; ++i) {
-      outv << '{' << R"("_key":")" << i << "\","
-           << R"("name":"name)" << i << "\","
-           << R"("keybak":)" << i << ","
-           << R"("country":")" << countries[random() % countries.size()]
-           << "\","
-           << R"("telephone":")" << 1518384838843 + i << "\","
-           << R"("email":")" << emails[random() % emails.size()] << "@person"
-           << i << ".com\",";
-      auto age = (random() % 80) + 20;
-      auto gender = random() % 2;
-      auto zip = random() % 100000 + 1;
-      outv << R"("age":)" << age << ","
-           << R"("gender":")" << (gender == 0 ? "M\"," : "F\",")
-           << R"("address":")" << (random() % 100) + 1 << " "
-           << streets[random() % streets.size()] << ";"
-           << cities[random() % cities.size()] << ";" << zip << "\"}\n";
-      if (i % 1000000 == 0) {
-        std::cout << "Have written " << i << " vertices out of " << nrVert
-                  << " ..." << std::endl;
+  };
+  auto edgeOut = [&](Outputs& out, long i, std::pair<long, long> e) {
+    for (int form = 0; form < NrForms; ++form) {
+      if (out.out[form] != nullptr) {
+        writeEdge(*out.out[form], spec, i, e.first, e.second, form == Smart);
+      }
+    }
+  };
+
+  if (spec.counterRng) {
+    auto vertex = [&](Outputs& out, long i) {
+      CounterRng random(spec.seed, VertexStream, i);
+      vertexOut(out, i, drawVertex(spec, i, random));
+    };
+    auto edge = [&](Outputs& out, long i) {
+      CounterRng random(spec.seed, EdgeStream, i);
+      edgeOut(out, i, drawEdge(spec.topology, spec.nrVert, random));
+    };
+    // Every item has its own random numbers, so unwanted files are skipped:
+    for (auto const& f : vfiles) {
+      if (!unwritten(f) && !writeParallel(f, vheader, nrVert, nrThreads,
+                                          vertex, "vertices", manifest)) {
+        return 1;
+      }
+    }
+    for (auto const& f : efiles) {
+      if (!unwritten(f) && !writeParallel(f, eheader, nrEdge, nrThreads, edge,
+                                          "edges", manifest)) {
+        return 1;
+      }
+    }
+  } else {
+    // Random:
+    std::mt19937_64 random;
+    random.seed(seed);
+    bool smartEdges = format != "raw" && only != "vertices";
+    if (smartEdges) {
+      spec.vertexCountries.resize(nrVert);
+    }
+    auto vertex = [&](Outputs& out, long i) {
+      Vertex v = drawVertex(spec, i, random);
+      if (smartEdges) {
+        spec.vertexCountries[i - 1] = static_cast<uint32_t>(v.country);
+      }
+      vertexOut(out, i, v);
+    };
+    auto edge = [&](Outputs& out, long i) {
+      edgeOut(out, i, drawEdge(spec.topology, spec.nrVert, random));
+    };
+    for (auto const& f : vfiles) {
+      if (!writeSequential(f, vheader, nrVert, vertex, "vertices",
+                           manifest)) {
+        return 1;
+      }
+    }
+    if (only != "vertices") {
+      for (auto const& f : efiles) {
+        if (!writeSequential(f, eheader, nrEdge, edge, "edges", manifest)) {
+          return 1;
+        }
       }
     }
   }
 
-  std::fstream oute(ename, std::ios_base::out);
+  if (manifest != nullptr) {
+    std::string manifestName = args["--manifest"].asString();
+    int fd = openOutput(manifestName);
+    if (fd < 0) {
+      return 1;
+    }
+    BlockWriter out(fd);
+    for (auto const& line : manifestLines) {
+      out.append(line);
+      out.append('\n');
+    }
+    if (!closeOutput(fd, manifestName, out.flush())) {
+      return 1;
+    }
+  }
 
-  if (type == CSV) {
-    oute << "_key,_from,_to\n";
+  if (toStdout) {
+    return 0;
   }
-  for (long i = 1; i <= nrEdge; ++i) {
-    if (type == CSV) {
-      auto from = random() % nrVert + 1;
-      auto to = random() % nrVert + 1;
-      oute << '"' << i << "\",profiles/" << from << ",profiles/" << to << "\n";
-    } else {  // JSONL
-      auto from = random() % nrVert + 1;
-      auto to = random() % nrVert + 1;
-      oute << '{' << R"("_key":")" << i << "\","
-           << R"("_from":"profiles/)" << from << "\","
-           << R"("_to":"profiles/)" << to << "\"}\n";
+  *info << "\nYou might want to import the graph using the following:\n\n";
+  for (auto const* files : {&vfiles, &efiles}) {
+    for (auto const& f : *files) {
+      std::string const& file =
+          format == "smart" ? f.names[Smart] : f.names[Raw];
+      if (!file.empty()) {
+        *info << "  arangoimp --collection " << f.collection << " --file "
+              << file << " --type " << (type == CSV ? "csv" : "json")
+              << "\\\n        --separator ,\n";
+      }
     }
-    if (i % 1000000 == 0) {
-      std::cout << "Have written " << i << " edges out of " << nrEdge << " ..."
-                << std::endl;
-    }
-  }
-
-  std::cout << "\nYou might want to import the graph using the following:\n\n"
-            << "  arangoimp --collection profiles --file " << vname
-            << " --type " << (type == CSV ? "csv" : "json")
-            << "\\\n        --separator ,\n"
-            << "  arangoimp --collection relations --file " << ename
-            << " --type " << (type == CSV ? "csv" : "json")
-            << "\\\n        --separator ,\n\n"
-            << "but first create a vertex collection 'profiles' and an edge "
-               "collection\n'relations'. Use '--server.endpoint' to point "
-               "arangoimp to your DB endpoint."
-            << std::endl;
+  }
+  *info << "\nbut first create "
+        << (nrCollections == 1
+                ? std::string("a vertex collection 'profiles'")
+                : "the vertex collections 'profiles0' to 'profiles" +
+                      std::to_string(nrCollections - 1) + "'")
+        << " and an edge collection\n'relations'. Use '--server.endpoint' "
+           "to point arangoimp to your DB endpoint."
+        << std::endl;
   return 0;
 }
@@ -2,17 +2,23 @@
 // smart graph format. This is version 2 with slightly different (incompatible)
 // calling conventions and functionality.
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
 #include <deque>
+#include <filesystem>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
-#include <openssl/evp.h>
 #include <optional>
 #include <sstream>
 #include <string>
@@ -20,8 +26,18 @@
 #include <unordered_map>
 #include <vector>
 
+#include "AsyncIO.h"
+#include "BlockIO.h"
 #include "CommandLineParsing.h"
+#include "Compression.h"
+#include "CpuDispatch.h"
 #include "GraphUtilsConfig.h"
+#include "Kernels.h"
+#include "MemoryAccounting.h"
+#include "Metrics.h"
+#include "Profiling.h"
+#include "TaskPool.h"
+#include "Trace.h"
 #include "velocypack/Builder.h"
 #include "velocypack/Iterator.h"
 #include "velocypack/Parser.h"
@@ -31,40 +47,8 @@
 
 std::chrono::steady_clock::time_point startTime;
 
-std::string calculateSha1(const std::string &input) {
-  EVP_MD_CTX *context = EVP_MD_CTX_new();
-  if (context == nullptr) {
-    throw std::runtime_error("Failed to create EVP context");
-  }
-
-  if (EVP_DigestInit_ex(context, EVP_sha1(), nullptr) != 1) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("Failed to initialize digest");
-  }
-
-  if (EVP_DigestUpdate(context, input.c_str(), input.length()) != 1) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("Failed to update digest");
-  }
-
-  unsigned char hash[EVP_MAX_MD_SIZE];
-  unsigned int lengthOfHash = 0;
-
-  if (EVP_DigestFinal_ex(context, hash, &lengthOfHash) != 1) {
-    EVP_MD_CTX_free(context);
-    throw std::runtime_error("Failed to finalize digest");
-  }
-
-  EVP_MD_CTX_free(context);
-
-  std::stringstream ss;
-  for (unsigned int i = 0; i < lengthOfHash; i++) {
-    ss << std::hex << std::setw(2) << std::setfill('0')
-       << static_cast<int>(hash[i]);
-  }
-
-  return ss.str();
-}
+// Progress messages go here, std::cerr when the output goes to stdout:
+std::ostream *info = &std::cout;
 
 double elapsed() {
   auto now = std::chrono::steady_clock::now();
@@ -91,8 +75,14 @@ static const char USAGE[] =
                            [ --randomize-smart <nr> ]
                            [ --rename-column <nr>:<newname> ... ]
                            [ --key-value <name> ]
+                           [ --worker <k>/<n> ]
+                           [ --chunk-threads <n> ]
+                           [ --compress <codec> ]
+                           [ --compress-threads <n> ]
+                           [ --decompress-threads <n> ]
       smartifier2 edges --vertices <vertices>... 
                         --edges <edges>...
+                        [ --manifest <manifestfile> ]
                         [ --from-attribute <fromattribute> ]
                         [ --to-attribute <toattribute> ]
                         [ --type <type> ]
@@ -101,12 +91,36 @@ static const char USAGE[] =
                         [ --quote-char <quotechar> ]
                         [ --smart-index <index> ]
                         [ --threads <nrthreads> ]
+                        [ --index <indexfile> ]
+                        [ --worker <k>/<n> ]
+                        [ --worker-split <split> ]
+                        [ --io-depth <n> ]
+                        [ --double-buffer ]
+                        [ --chunk-threads <n> ]
+                        [ --compress <codec> ]
+                        [ --compress-threads <n> ]
+                        [ --decompress-threads <n> ]
+      smartifier2 index --vertices <vertices>...
+                        --index <indexfile>
+                        [ --manifest <manifestfile> ]
+                        [ --type <type> ]
+                        [ --memory <memory> ]
+                        [ --separator <separator> ]
+                        [ --quote-char <quotechar> ]
+                        [ --threads <nrthreads> ]
+                        [ --decompress-threads <n> ]
+      smartifier2 merge --output <outputfile>
+                        --parts <n>
+                        [ --type <type> ]
+                        [ --compress <codec> ]
+                        [ --compress-threads <n> ]
+                        [ --decompress-threads <n> ]
 
     Options:
       --help (-h)                   Show this screen.
       --version (-v)                Show version.
-      --input <input> (-i)          Input file for vertex mode.
-      --output <output> (-o)        Output file for vertex mode.
+      --input <input> (-i)          Input file for vertex mode, "-" is stdin.
+      --output <output> (-o)        Output file for vertex mode, "-" is stdout.
       --smart-graph-attribute <smartgraphattr>  
                                     Attribute name of the smart graph attribute.
       --type <type>                 Data type "csv" or "jsonl" [default: csv]
@@ -140,6 +154,13 @@ static const char USAGE[] =
                                     will be built using the smart graph
                                     attribute value, a colon and the value
                                     of the column/attribute named here.
+      --chunk-threads <n>           Transform each file in chunks of about
+                                    128 KiB on <n> threads, the chunks are
+                                    written in the order of the input
+                                    [default: 1]. In edge mode the files
+                                    are cut into chunks whenever the pool
+                                    has several threads, and it then has
+                                    at least <n> threads.
 
     And additionally for edge mode:
 
@@ -154,137 +175,466 @@ static const char USAGE[] =
                                      will be the first <index> characters
                                      of the key, so we can transform _from
                                      and _to locally.
-      --threads <nrthreads>          Number of threads to use, only relevant
-                                     when multiple edge files are given.
+      --threads <nrthreads>          Number of threads to use for loading
+                                     vertices and for the edge files and
+                                     their chunks [default: 1].
+      --index <indexfile>            Take the translation from an index file
+                                     written by the `index` subcommand instead
+                                     of reading the vertex collections.
+      --manifest <manifestfile>      A JSON file listing vertex and edge
+                                     collections in addition to those of
+                                     `--vertices` and `--edges`, see the
+                                     README.
+      --io-depth <n>                 Keep <n> reads and <n> writes of 4 MiB in
+                                     flight per edge file with io_uring, or
+                                     with pread and pwrite where io_uring is
+                                     not available. 0 reads and writes one
+                                     block at a time [default: 0].
+      --double-buffer                Split --memory into two buffers and
+                                     load the next batch of vertices while
+                                     the edges are transformed with the
+                                     current one.
+
+    And additionally for sharded execution:
+
+      --worker <k>/<n>               Only process the share of worker <k>
+                                     (0-based) out of <n>. The output is
+                                     written to <file>.part<k>, use the
+                                     `merge` subcommand to concatenate the
+                                     parts once all workers are done.
+      --worker-split <split>         How edge files are split between workers,
+                                     "files" (every <n>-th edge file, changed
+                                     in place) or "ranges" (a line range of
+                                     every edge file) [default: files]. In
+                                     vertex mode the input file is always
+                                     split into line ranges.
+      --parts <n>                    Number of part files to merge.
+
+    And additionally for compressed files, input files compressed with gzip
+    or zstd are always detected and decompressed. BGZF and seekable zstd
+    files consist of independently compressed blocks with an index, they
+    can be split between workers and decompressed on several threads:
+
+      --compress <codec>             Compress the output with "gzip", "bgzf",
+                                     "zstd" or "zstd-seekable", or "none".
+                                     "auto" takes the extension of the output
+                                     file in vertex and merge mode, .gz gives
+                                     "bgzf" and .zst "zstd-seekable", and
+                                     keeps the codec of the input for edge
+                                     files, which are changed in place
+                                     [default: auto].
+      --compress-threads <n>         Threads compressing the blocks of each
+                                     output file, 0 compresses in the thread
+                                     writing the file [default: 1].
+      --decompress-threads <n>       Threads decompressing the blocks of each
+                                     BGZF or seekable zstd input file ahead of
+                                     the reader, 0 decompresses in the thread
+                                     reading the file [default: 1].
+
+    And additionally for monitoring long running jobs:
+
+      --metrics <file>               Append live metrics as one JSON object
+                                     per line to <file> ("-" for stdout).
+      --metrics-prometheus <file>    Rewrite <file> with the live metrics in
+                                     the Prometheus textfile format.
+      --metrics-interval <seconds>   Interval of the metrics, 0 for only the
+                                     final report [default: 10].
+      --profile                      Print a breakdown of the time spent in
+                                     parsing, hashing, lookups and output per
+                                     thread at exit. Needs a build with
+                                     -DGRAPHUTILS_PROFILING=ON.
+      --profile-counters             Like --profile, but also read cycles,
+                                     instructions, cache and branch misses
+                                     with perf_event_open.
+      --trace <file>                 Write the activity of all threads in
+                                     the Chrome trace-event format to <file>,
+                                     to be inspected with Perfetto.
+      --memory-report                Print the memory used by the translation
+                                     tables (bytes per vertex, buckets, load
+                                     factors, probe lengths) after every batch
+                                     of vertices and the peak RSS per phase
+                                     at exit.
 )";
 
 enum DataType { CSV = 0, JSONL = 1 };
 
-std::vector<std::string> split(std::string const &line, char sep, char quo) {
-  size_t start = 0;
-  size_t pos = 0;
-  bool inQuote = false;
-  std::vector<std::string> res;
-  auto add = [&]() {
-    res.push_back(line.substr(start, pos - start));
-    start = ++pos;
+int findColPos(std::vector<std::string> const &colHeaders,
+               std::string const &header, std::string const &fileName) {
+  auto it = std::find(colHeaders.begin(), colHeaders.end(), header);
+  if (it == colHeaders.end()) {
+    std::cerr << "Did not find " << header << " in column headers in file '"
+              << fileName << "'" << std::endl;
+    return -1;
+  }
+  return static_cast<int>(it - colHeaders.begin());
+}
+
+// Worker specification for `--worker k/n`: this process is worker number
+// `k` (0-based) out of `n` and processes a deterministic subset of the input.
+struct WorkerSpec {
+  size_t k = 0;
+  size_t n = 1;
+};
+
+bool parseWorkerSpec(std::string const &s, WorkerSpec &w) {
+  auto pos = s.find('/');
+  if (pos == std::string::npos || pos == 0 || pos + 1 >= s.size()) {
+    return false;
+  }
+  char *end = nullptr;
+  w.k = strtoul(s.c_str(), &end, 10);
+  if (end != s.c_str() + pos) {
+    return false;
+  }
+  w.n = strtoul(s.c_str() + pos + 1, &end, 10);
+  if (*end != 0) {
+    return false;
+  }
+  return w.n > 0 && w.k < w.n;
+}
+
+// A byte range of a file. A line belongs to the range in which its first
+// byte lies, so the ranges of all workers cover every line exactly once.
+struct LineRange {
+  uint64_t start = 0;
+  uint64_t end = UINT64_MAX;
+};
+
+LineRange workerRange(uint64_t dataStart, uint64_t fileSize,
+                      WorkerSpec const &w) {
+  LineRange r;
+  if (fileSize <= dataStart) {
+    r.start = r.end = dataStart;
+    return r;
+  }
+  uint64_t len = fileSize - dataStart;
+  auto cut = [&](size_t i) -> uint64_t {
+    // dataStart + floor(len * i / n) without overflow:
+    return dataStart + len / w.n * i + len % w.n * i / w.n;
   };
-  while (pos < line.size()) {
-    if (!inQuote) {
-      if (line[pos] == quo) {
-        inQuote = true;
-        ++pos;
-        continue;
-      }
-      if (line[pos] == sep) {
-        add();
-        continue;
-      }
-      ++pos;
-    } else { // inQuote == true
-      if (line[pos] == quo) {
-        if (pos + 1 < line.size() && line[pos + 1] == quo) {
-          pos += 2;
-          continue;
-        }
-        inQuote = false;
-        ++pos;
-        continue;
-      }
-      ++pos;
+  r.start = cut(w.k);
+  r.end = cut(w.k + 1);
+  return r;
+}
+
+// Positions `in` at the first line which begins at or after `start` and
+// returns the offset of that line.
+uint64_t seekLineStart(std::istream &in, uint64_t start) {
+  if (start == 0) {
+    in.seekg(0);
+    return 0;
+  }
+  in.seekg(start - 1);
+  char c;
+  if (!in.get(c)) {
+    return start;
+  }
+  if (c == '\n') {
+    return start;
+  }
+  std::string rest;
+  getline(in, rest);
+  return start + rest.size() + 1;
+}
+
+// Restricts reading from `in`, whose data lines start at the current
+// position, to the range of worker `w`. Returns the range, whose start is
+// already aligned to the beginning of a line.
+LineRange restrictToWorker(std::istream &in, std::string const &fileName,
+                           WorkerSpec const &w) {
+  uint64_t dataStart = static_cast<uint64_t>(in.tellg());
+  std::error_code ec;
+  uint64_t fileSize = std::filesystem::file_size(fileName, ec);
+  if (ec) {
+    fileSize = dataStart;
+  }
+  LineRange r = workerRange(dataStart, fileSize, w);
+  r.start = seekLineStart(in, r.start);
+  return r;
+}
+
+// The same for a BlockReader on a regular file, which is uncompressed or
+// block-indexed, the ranges are in the decompressed data. If the size is
+// unknown the range is empty and in.failed() tells why.
+LineRange restrictToWorker(BlockReader &in, WorkerSpec const &w) {
+  uint64_t dataStart = in.offset();
+  uint64_t fileSize;
+  if (!in.dataSize(fileSize)) {
+    return LineRange{dataStart, dataStart};
+  }
+  LineRange r = workerRange(dataStart, fileSize, w);
+  if (r.start > 0) {
+    // The line which contains the byte before r.start belongs to the
+    // previous range:
+    std::string rest;
+    in.seek(r.start - 1);
+    if (in.getLine(rest)) {
+      r.start = in.offset();
     }
   }
-  add();
-  return res;
+  return r;
 }
 
-std::string unquote(std::string const &s, char quo) {
-  std::string res;
-  size_t pos = s.find(quo);
-  if (pos == std::string::npos) {
-    return s;
-  }
-
-  res.reserve(s.size());
-  ++pos; // now pointing to the first character after the quote
-  bool inQuote = true;
-  while (pos < s.size()) {
-    if (inQuote) {
-      if (s[pos] == quo) {
-        if (pos + 1 < s.size() && s[pos + 1] == quo) {
-          res.push_back(quo);
-          pos += 2;
-          continue;
-        }
-        inQuote = false;
-      } else {
-        res.push_back(s[pos]);
-      }
-    } else { // not in quote
-      if (s[pos] == quo) {
-        inQuote = true;
-      }
+// Opens `fileName` for reading, "-" is stdin. Returns -1 on errors.
+int openInput(std::string const &fileName) {
+  if (fileName == "-") {
+    return STDIN_FILENO;
+  }
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Could not open " << fileName << ": " << strerror(errno)
+              << ", giving up." << std::endl;
+  }
+  return fd;
+}
+
+// Opens `fileName` for writing, "-" is stdout. Returns -1 on errors.
+int openOutput(std::string const &fileName) {
+  if (fileName == "-") {
+    return STDOUT_FILENO;
+  }
+  int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Could not open " << fileName << ": " << strerror(errno)
+              << ", giving up." << std::endl;
+  }
+  return fd;
+}
+
+// Closes a file descriptor from openInput or openOutput, but not stdin or
+// stdout. Returns false on errors.
+bool closeFile(int fd) {
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO) {
+    return true;
+  }
+  return close(fd) == 0;
+}
+
+// How to compress the output and decompress the input, from `--compress`,
+// `--compress-threads` and `--decompress-threads`:
+struct CompressionOptions {
+  bool automatic = true;
+  Codec codec = Codec::None;
+  size_t threads = 1;
+  size_t decompressThreads = 1;
+
+  // The codec to use if "auto" means `automaticCodec`:
+  Codec codecFor(Codec automaticCodec) const {
+    return automatic ? automaticCodec : codec;
+  }
+};
+
+int parseCompressionOptions(Options const &options, CompressionOptions &c) {
+  auto it = options.find("--compress");
+  if (it != options.end() && it->second[0] != "auto") {
+    c.automatic = false;
+    if (!parseCodec(it->second[0], c.codec)) {
+      std::cerr << "Value for `--compress` must be `auto`, `none`, `gzip`, "
+                   "`bgzf`, `zstd` or `zstd-seekable`, giving up."
+                << std::endl;
+      return 1;
+    }
+    if (!codecSupported(c.codec)) {
+      std::cerr << "This build of smartifier2 cannot compress with "
+                << codecName(c.codec) << ", giving up." << std::endl;
+      return 1;
     }
-    ++pos;
   }
-  return res;
+  it = options.find("--compress-threads");
+  if (it != options.end()) {
+    c.threads = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
+  it = options.find("--decompress-threads");
+  if (it != options.end()) {
+    c.decompressThreads = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
+  return 0;
 }
 
-std::string quote(std::string const &s, char quo) {
-  size_t pos = s.find(quo);
-  if (pos == std::string::npos) {
-    return s;
-  }
-  std::string res;
-  res.reserve(s.size() + 2); // Usually enough
-  res.push_back(quo);
-  for (pos = 0; pos < s.size(); ++pos) {
-    if (s[pos] == quo) {
-      res.push_back(quo);
-      res.push_back(quo);
-    } else {
-      res.push_back(s[pos]);
+// An output file with optional compression. An uncompressed regular file
+// is written with `ioDepth` writes in flight if that is not 0.
+struct OutputStream {
+  BlockWriter writer;
+  std::unique_ptr<BlockCompressor> compressor;
+  std::unique_ptr<WriteBehind> writeBehind;
+
+  OutputStream(int fd, Codec codec, size_t threads, size_t ioDepth = 0)
+      : writer(fd, codec != Codec::None || ioDepth > 0
+                       ? BlockWriter::defaultCapacity
+                       : BlockWriter::plainCapacity) {
+    struct stat st;
+    if (codec != Codec::None) {
+      compressor = std::make_unique<BlockCompressor>(fd, codec, threads);
+      writer.compressInto(compressor.get());
+    } else if (ioDepth > 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      off_t start = lseek(fd, 0, SEEK_CUR);
+      writeBehind = std::make_unique<WriteBehind>(
+          fd, start > 0 ? static_cast<uint64_t>(start) : 0,
+          BlockWriter::defaultCapacity, ioDepth);
+      writer.writeBehind(writeBehind.get());
     }
   }
-  res.push_back(quo);
-  return res;
+
+  // Writes everything, returns false on errors:
+  bool finish() {
+    bool ok = writer.flush();
+    if (compressor != nullptr) {
+      ok = compressor->finish() && ok;
+    }
+    if (writeBehind != nullptr) {
+      ok = writeBehind->finish() && ok;
+    }
+    return ok;
+  }
+};
+
+// The OrderedWriter for `out` on `fd` with several threads per file:
+// pwrite() into an uncompressed regular file, otherwise appending to the
+// writer of `out`.
+std::unique_ptr<OrderedWriter> makeOrderedWriter(OutputStream &out, int fd,
+                                                 uint64_t sizeHint) {
+  struct stat st;
+  if (out.compressor == nullptr && fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode)) {
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    return std::make_unique<OrderedWriter>(
+        fd, start > 0 ? static_cast<uint64_t>(start) : 0, sizeHint);
+  }
+  return std::make_unique<OrderedWriter>(out.writer);
 }
 
-int findColPos(std::vector<std::string> const &colHeaders,
-               std::string const &header, std::string const &fileName) {
-  auto it = std::find(colHeaders.begin(), colHeaders.end(), header);
-  if (it == colHeaders.end()) {
-    std::cerr << "Did not find " << header << " in column headers in file '"
-              << fileName << "'" << std::endl;
-    return -1;
+// Counts of a chunk of edges for the metrics:
+struct LineStats {
+  uint64_t resolved = 0;
+  uint64_t unresolved = 0;
+};
+
+// Reads the lines of `in` up to `range.end` and formats each one into the
+// output with `transform(line, lineNr, writer, stats)`, lineNr counts from
+// 0. `progress(count)` is called after every line read. Without `ordered`
+// this happens right here into `out`. With it the lines are cut into chunks
+// of about 4 MiB, which are formatted by tasks in `pool` into buffers of
+// their own and put into the output by `ordered` in input order, after
+// what is already in `out` (the header). Idle threads of the pool steal
+// the chunks, and the reading thread runs tasks itself while too many
+// chunks are on the way. `transform` must be thread-safe then. Returns the
+// number of lines.
+template <typename Transform, typename Progress>
+uint64_t transformLines(BlockReader &in, LineRange const &range,
+                        BlockWriter &out, OrderedWriter *ordered,
+                        TaskPool *pool, Transform const &transform,
+                        Progress const &progress) {
+  uint64_t linePos = range.start;
+  uint64_t count = 0;
+  std::string line;
+  if (ordered == nullptr) {
+    LineStats stats;
+    while (linePos < range.end && in.getLine(line)) {
+      linePos += line.size() + 1;
+      transform(line, count, out, stats);
+      ++count;
+      progress(count);
+      if (count % 1000000 == 0) {
+        metrics.addEndpoints(stats.resolved, stats.unresolved);
+        stats = LineStats();
+      }
+    }
+    metrics.addEndpoints(stats.resolved, stats.unresolved);
+    return count;
+  }
+
+  // The header goes first:
+  std::string header(out.data(), out.size());
+  out.clear();
+  ordered->write(0, header);
+
+  // Small enough that the chunks on the way, at most two per thread for
+  // every file, do not matter next to `--memory`, and still thousands of
+  // lines. With larger chunks malloc keeps more of the freed buffers of
+  // the threads around:
+  constexpr size_t chunkSize = 128 << 10;
+  TaskGroup group(*pool);
+  uint64_t const maxAhead = 2 * pool->threads();
+  uint64_t seq = 1;
+  auto push = [&](std::string &&data, uint64_t firstLine) {
+    group.waitUntil([&] { return seq - ordered->placed() < maxAhead; });
+    group.run([&transform, ordered, seq, firstLine, data = std::move(data)] {
+      TraceSpan span("chunk");
+      // The buffer lives only as long as the chunk, so that nothing stays
+      // behind in the threads of the pool when the file is done:
+      BlockWriter buf;
+      std::string line;
+      LineStats stats;
+      uint64_t lineNr = firstLine;
+      size_t pos = 0;
+      while (pos < data.size()) {
+        size_t nl = data.find('\n', pos);
+        line.assign(data, pos, nl - pos);
+        transform(line, lineNr++, buf, stats);
+        pos = nl + 1;
+      }
+      metrics.addEndpoints(stats.resolved, stats.unresolved);
+      ordered->write(seq, std::string_view(buf.data(), buf.size()));
+    });
+    ++seq;
+  };
+  // A chunk is cut before the line which would not fit any more, so that
+  // its buffer does not grow beyond chunkSize:
+  std::string chunk;
+  chunk.reserve(chunkSize);
+  uint64_t firstLine = 0;
+  while (linePos < range.end && in.getLine(line)) {
+    linePos += line.size() + 1;
+    if (!chunk.empty() && chunk.size() + line.size() + 1 > chunkSize) {
+      push(std::move(chunk), firstLine);
+      chunk.clear();
+      chunk.reserve(chunkSize);
+      firstLine = count;
+    }
+    chunk.append(line);
+    chunk.push_back('\n');
+    ++count;
+    progress(count);
   }
-  return static_cast<int>(it - colHeaders.begin());
+  if (!chunk.empty()) {
+    push(std::move(chunk), firstLine);
+  }
+  group.wait();
+  return count;
 }
 
-struct Translation {
-  std::unordered_map<std::string, uint32_t> keyTab;
-  std::unordered_map<std::string, uint32_t> attTab;
-  std::vector<std::string> smartAttributes;
-  size_t memUsage = 0; // strings in map plus table size
-  void clear() {
-    keyTab.clear();
-    attTab.clear();
-    smartAttributes.clear();
-    memUsage = 0;
+// Number of bytes of `fileName` in `range`, 0 if the file is not there:
+uint64_t rangeSize(std::string const &fileName, LineRange const &range) {
+  std::error_code ec;
+  uint64_t end =
+      std::min(range.end, static_cast<uint64_t>(
+                              std::filesystem::file_size(fileName, ec)));
+  if (ec || end < range.start) {
+    return 0;
   }
-};
+  return end - range.start;
+}
+
+std::string partFileName(std::string const &fileName, size_t k) {
+  return fileName + ".part" + std::to_string(k);
+}
 
 struct EdgeCollection {
   std::string fileName;
   std::string fromVertColl;
   std::string toVertColl;
   std::vector<std::pair<int, std::string>> columnRenames;
+  // Only for `--worker-split ranges`: in the first pass, read the lines of
+  // worker `worker` in `sourceFile` instead of `fileName`, which is then
+  // created:
+  std::string sourceFile;
+  WorkerSpec worker;
 };
 
 void transformVertexCSV(std::string const &line, uint64_t count, char sep,
                         char quo, size_t ncols, int smartAttrPos,
                         int smartValuePos, int smartIndex, bool hashSmartValue,
-                        int keyPos, int keyValuePos, std::fstream &vout) {
+                        int keyPos, int keyValuePos, BlockWriter &vout) {
   std::vector<std::string> parts = split(line, sep, quo);
   // Extend with empty columns to get at least the right amount of cols:
   while (parts.size() < ncols) {
@@ -335,11 +685,13 @@ void transformVertexCSV(std::string const &line, uint64_t count, char sep,
   }
 
   // Write out the potentially modified line:
-  vout << parts[0];
+  PROFILE_SCOPE(Output);
+  vout.append(parts[0]);
   for (size_t i = 1; i < parts.size(); ++i) {
-    vout << sep << parts[i];
+    vout.append(sep);
+    vout.append(parts[i]);
   }
-  vout << '\n';
+  vout.append('\n');
 }
 
 std::string smartToString(VPackSlice attSlice, std::string const &smartDefault,
@@ -374,9 +726,13 @@ void transformVertexJSONL(std::string const &line, size_t count,
                           std::string const &smartAttr, std::string smartValue,
                           int smartIndex, bool hashSmartValue,
                           std::string const &smartDefault, bool writeKey,
-                          std::string const &keyValue, std::fstream &vout) {
+                          std::string const &keyValue, BlockWriter &vout) {
   // Parse line to VelocyPack:
-  std::shared_ptr<VPackBuilder> b = VPackParser::fromJson(line);
+  std::shared_ptr<VPackBuilder> b;
+  {
+    PROFILE_SCOPE(Parse);
+    b = VPackParser::fromJson(line);
+  }
   VPackSlice s = b->slice();
 
   // First derive the smart graph attribute value:
@@ -427,18 +783,27 @@ void transformVertexJSONL(std::string const &line, size_t count,
   }
 
   // Write out the potentially modified line:
-  vout << "{";
+  PROFILE_SCOPE(Output);
+  vout.append('{');
   if (writeKey || !newKey.empty()) {
-    vout << R"("_key":")" << newKey << R"(",")";
-  }
-  vout << smartAttr << R"(":")" << att << '"';
+    vout.append(R"("_key":")");
+    vout.append(newKey);
+    vout.append(R"(",")");
+  }
+  vout.append(smartAttr);
+  vout.append(R"(":")");
+  vout.append(att);
+  vout.append('"');
   for (auto const &p : VPackObjectIterator(s)) {
     std::string attrName = p.key.copyString();
     if (attrName != "_key" && attrName != smartAttr) {
-      vout << ",\"" << attrName << "\":" << p.value.toJson();
+      vout.append(",\"");
+      vout.append(attrName);
+      vout.append("\":");
+      vout.append(p.value.toJson());
     }
   }
-  vout << "}\n";
+  vout.append("}\n");
 }
 
 void renameColumns(Options const &options,
@@ -517,16 +882,64 @@ int doVertices(Options const &options) {
   if (it != options.end() && !it->second[0].empty()) {
     keyValue = it->second[0];
   }
+  bool haveWorker = false;
+  WorkerSpec worker;
+  it = options.find("--worker");
+  if (it != options.end()) {
+    if (!parseWorkerSpec(it->second[0], worker)) {
+      std::cerr << "Value for `--worker` option needs to be of the form "
+                   "<k>/<n> with 0 <= k < n, but is: "
+                << it->second[0] << " Giving up." << std::endl;
+      return 5;
+    }
+    if (inputFile == "-") {
+      std::cerr << "`--worker` needs a regular input file, not stdin, "
+                   "giving up."
+                << std::endl;
+      return 5;
+    }
+    haveWorker = true;
+    if (outputFile != "-") {
+      outputFile = partFileName(outputFile, worker.k);
+    }
+  }
+  CompressionOptions compression;
+  if (parseCompressionOptions(options, compression) != 0) {
+    return 6;
+  }
+  size_t chunkThreads = 1;
+  it = options.find("--chunk-threads");
+  if (it != options.end()) {
+    chunkThreads = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
 
   // Only for JSONL:
   std::string smartDefault = "";
 
   // Input file:
-  std::fstream vin(inputFile, std::ios_base::in);
+  std::optional<TraceSpan> openSpan;
+  openSpan.emplace("open", inputFile);
+  int inFd = openInput(inputFile);
+  if (inFd < 0) {
+    return 3;
+  }
+  BlockReader vin(inFd);
+  vin.setThreads(compression.decompressThreads);
   std::string line;
 
   // Prepare output file for vertices:
-  std::fstream vout(outputFile, std::ios_base::out);
+  int outFd = openOutput(outputFile);
+  if (outFd < 0) {
+    closeFile(inFd);
+    return 4;
+  }
+  // The part files of workers are compressed like the final file:
+  OutputStream out(
+      outFd,
+      compression.codecFor(codecForFileName((*output.value())[0])),
+      compression.threads);
+  BlockWriter &vout = out.writer;
+  openSpan.reset();
 
   size_t ncols = 0;
   int smartAttrPos = -1;
@@ -535,9 +948,11 @@ int doVertices(Options const &options) {
   int keyValuePos = -1;
   if (type == CSV) {
     // First get the header line:
-    if (!getline(vin, line)) {
+    if (!vin.getLine(line)) {
       std::cerr << "Could not read header line in vertex file " << inputFile
-                << std::endl;
+                << (vin.failed() ? ": " + vin.error() : "") << std::endl;
+      closeFile(inFd);
+      closeFile(outFd);
       return 3;
     }
     std::vector<std::string> colHeaders = split(line, sep, quo);
@@ -596,12 +1011,12 @@ int doVertices(Options const &options) {
     bool first = true;
     for (auto const &h : colHeaders) {
       if (!first) {
-        vout << sep;
+        vout.append(sep);
       }
-      vout << quote(h, quo);
+      vout.append(quote(h, quo));
       first = false;
     }
-    vout << "\n";
+    vout.append('\n');
   } else {
     it = options.find("--smart-default");
     if (it != options.end()) {
@@ -609,110 +1024,153 @@ int doVertices(Options const &options) {
     }
   }
 
-  size_t count = 1;
-  while (true) {
-    if (!getline(vin, line)) {
-      break;
-    }
-    if (type == CSV) {
-      transformVertexCSV(line, count + 1, sep, quo, ncols, smartAttrPos,
-                         smartValuePos, smartIndex, hashSmartValue, keyPos,
-                         keyValuePos, vout);
-    } else {
-      transformVertexJSONL(line, count, smartAttr, smartValue, smartIndex,
-                           hashSmartValue, smartDefault, writeKey, keyValue,
-                           vout);
+  LineRange range;
+  if (haveWorker) {
+    range = restrictToWorker(vin, worker);
+    if (vin.failed()) {
+      std::cerr << "Cannot split " << inputFile << " between workers: "
+                << vin.error() << ", giving up." << std::endl;
+      closeFile(inFd);
+      closeFile(outFd);
+      return 5;
     }
+  } else {
+    range.start = vin.offset();
+  }
+  uint64_t fileStart = vin.fileOffset();
+  uint64_t inputSize = rangeSize(inputFile, range);
+  metrics.setPass(1);
+  metrics.beginPhase("vertices", inputSize);
+  FileMetrics *fileMetrics = metrics.addFile(inputFile, inputSize);
+  TraceChunks traceChunks("transform", inputFile);
+
+  std::unique_ptr<TaskPool> pool;
+  std::unique_ptr<OrderedWriter> ordered;
+  if (chunkThreads > 1) {
+    pool = std::make_unique<TaskPool>(chunkThreads, [](size_t i) {
+      setTraceThreadName("chunk worker " + std::to_string(i));
+    });
+    ordered = makeOrderedWriter(out, outFd, inputSize);
+  }
+  transformLines(
+      vin, range, vout, ordered.get(), pool.get(),
+      [&](std::string const &line, uint64_t lineNr, BlockWriter &vout,
+          LineStats &) {
+        if (type == CSV) {
+          transformVertexCSV(line, lineNr + 2, sep, quo, ncols, smartAttrPos,
+                             smartValuePos, smartIndex, hashSmartValue,
+                             keyPos, keyValuePos, vout);
+        } else {
+          transformVertexJSONL(line, lineNr + 1, smartAttr, smartValue,
+                               smartIndex, hashSmartValue, smartDefault,
+                               writeKey, keyValue, vout);
+        }
+      },
+      [&](uint64_t count) {
+        traceChunks.tick();
+        fileMetrics->update(count, vin.fileOffset() - fileStart);
+        if ((count + 1) % 1000000 == 0) {
+          *info << elapsed() << " Have transformed " << count + 1
+                << " vertices." << std::endl;
+        }
+      });
+  fileMetrics->finish();
+  traceChunks.flush();
 
-    ++count;
-
-    if (count % 1000000 == 0) {
-      std::cout << elapsed() << " Have transformed " << count << " vertices."
-                << std::endl;
+  bool readOk = !vin.failed();
+  if (!readOk) {
+    std::cerr << "Could not read " << inputFile << ": " << vin.error()
+              << ", giving up." << std::endl;
+  }
+  closeFile(inFd);
+  bool ok;
+  {
+    TraceSpan span("close", outputFile);
+    ok = out.finish();
+    if (ordered != nullptr) {
+      ok = ordered->finish() && ok;
     }
+    ok = closeFile(outFd) && ok;
   }
 
-  vout.close();
-
-  if (!vout.good()) {
-    std::cerr << "An error happened at close time for " << outputFile << "."
-              << std::endl;
+  if (!ok) {
+    std::cerr << "An error happened at close time for " << outputFile << ": "
+              << strerror(errno) << "." << std::endl;
     return 4;
   }
-  return 0;
-}
-
-void learnSmartKey(Translation &trans, std::string const &key,
-                   std::string const &vertexCollName) {
-  size_t splitPos = key.find(':');
-  if (splitPos != std::string::npos) {
-    // Before the colon is the smart graph attribute, after the colon there is
-    // the unique key
-    std::string uniq = key.substr(splitPos + 1);
-    std::string att = key.substr(0, splitPos);
-    auto it = trans.attTab.find(att);
-    uint32_t pos;
-    if (it == trans.attTab.end()) {
-      trans.smartAttributes.emplace_back(att);
-      pos = static_cast<uint32_t>(trans.smartAttributes.size() - 1);
-      trans.attTab.insert(std::make_pair(att, pos));
-      trans.memUsage += sizeof(std::pair<std::string, uint32_t>) // attTab
-                        + att.size() + 1      // actual string
-                        + sizeof(std::string) // smartAttributes
-                        + att.size() + 1      // actual string
-                        + 32;                 // unordered_map overhead
-    } else {
-      pos = it->second;
-    }
-    uniq = vertexCollName + "/" + uniq;
-    auto it2 = trans.keyTab.find(uniq);
-    if (it2 == trans.keyTab.end()) {
-      trans.keyTab.insert(std::make_pair(uniq, pos));
-      trans.memUsage += sizeof(std::pair<std::string, uint32_t>) // keyTab
-                        + uniq.size() + 1 // actual string
-                        + 32;             // unordered_map overhead
-    }
-  }
+  return readOk ? 0 : 3;
 }
 
 void learnLineCSV(Translation &trans, std::string const &line, char sep,
-                  char quo, int keyPos, std::string const &vertexCollName) {
+                  char quo, int keyPos, std::string const &vertexCollName,
+                  AttributeCache *cache = nullptr) {
   std::vector<std::string> parts = split(line, sep, quo);
   std::string key = unquote(parts[keyPos], quo); // Copy here temporarily!
-  learnSmartKey(trans, key, vertexCollName);
+  learnSmartKey(trans, key, vertexCollName, cache);
 }
 
 void learnLineJSONL(Translation &trans, std::string const &line,
-                    std::string const &vertexCollName) {
+                    std::string const &vertexCollName,
+                    AttributeCache *cache = nullptr) {
   // Parse line to VelocyPack:
-  std::shared_ptr<VPackBuilder> b = VPackParser::fromJson(line);
+  std::shared_ptr<VPackBuilder> b;
+  {
+    PROFILE_SCOPE(Parse);
+    b = VPackParser::fromJson(line);
+  }
   VPackSlice s = b->slice();
   VPackSlice keySlice = s.get("_key");
   if (!keySlice.isString()) {
     return; // ignore line
   }
   std::string key = keySlice.copyString();
-  learnSmartKey(trans, key, vertexCollName);
+  learnSmartKey(trans, key, vertexCollName, cache);
 }
 
 int transformEdgesCSV(std::mutex &mutex, size_t id, Translation &translation,
                       EdgeCollection const &e, char sep, char quo,
-                      int smartIndex) {
+                      int smartIndex, CompressionOptions const &compression,
+                      size_t ioDepth, TaskPool *pool) {
   {
     std::lock_guard<std::mutex> guard(mutex);
     std::cout << "Transforming edges in " << e.fileName << " ..." << std::endl;
   }
-  std::fstream ein(e.fileName, std::ios_base::in);
-  std::fstream eout(e.fileName + ".out", std::ios_base::out);
+  TraceSpan fileSpan("edge file", e.fileName);
+  std::string const &inputFile =
+      e.sourceFile.empty() ? e.fileName : e.sourceFile;
+  std::optional<TraceSpan> openSpan;
+  openSpan.emplace("open", inputFile);
+  int inFd;
+  int outFd;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    inFd = openInput(inputFile);
+    outFd = inFd < 0 ? -1 : openOutput(e.fileName + ".out");
+  }
+  if (outFd < 0) {
+    closeFile(inFd);
+    return 3;
+  }
+  BlockReader ein(inFd);
+  ein.setThreads(compression.decompressThreads);
+  ein.setReadAhead(ioDepth);
+  // The file keeps its compression, unless `--compress` says otherwise:
+  // With several threads per file the chunks are written by themselves:
+  OutputStream out(outFd, compression.codecFor(ein.codec()),
+                   compression.threads, pool != nullptr ? 0 : ioDepth);
+  BlockWriter &eout = out.writer;
+  openSpan.reset();
   std::string line;
 
   // First get the header line:
-  if (!getline(ein, line)) {
+  if (!ein.getLine(line)) {
     {
       std::lock_guard<std::mutex> guard(mutex);
-      std::cerr << "Could not read header line in edge file " << e.fileName
-                << std::endl;
+      std::cerr << "Could not read header line in edge file " << inputFile
+                << (ein.failed() ? ": " + ein.error() : "") << std::endl;
     }
+    closeFile(inFd);
+    closeFile(outFd);
     return 1;
   }
   std::vector<std::string> colHeaders = split(line, sep, quo);
@@ -738,12 +1196,12 @@ int transformEdgesCSV(std::mutex &mutex, size_t id, Translation &translation,
   bool first = true;
   for (auto const &h : colHeaders) {
     if (!first) {
-      eout << sep;
+      eout.append(sep);
     }
-    eout << quote(h, quo);
+    eout.append(quote(h, quo));
     first = false;
   }
-  eout << "\n";
+  eout.append('\n');
 
   // Try to find the _key attribute:
   int keyPos = findColPos(colHeaders, "_key", e.fileName);
@@ -754,85 +1212,88 @@ int transformEdgesCSV(std::mutex &mutex, size_t id, Translation &translation,
       std::lock_guard<std::mutex> guard(mutex);
       std::cerr << id << " Did not find _from or _to field." << std::endl;
     }
+    closeFile(inFd);
+    closeFile(outFd);
     return 2;
   }
   // We tolerate -1 for the key pos, in which case we do not touch it!
 
-  size_t count = 0;
-
-  while (getline(ein, line)) {
-    std::vector<std::string> parts = split(line, sep, quo);
-    // Extend with empty columns to get at least the right amount of cols:
-    while (parts.size() < ncols) {
-      parts.emplace_back("");
+  LineRange range;
+  if (!e.sourceFile.empty()) {
+    range = restrictToWorker(ein, e.worker);
+  } else {
+    range.start = ein.offset();
+  }
+  if (ein.failed()) {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      std::cerr << id << " Cannot split " << inputFile
+                << " between workers: " << ein.error() << std::endl;
     }
-
-    auto translate = [&](int pos, std::string const &name,
-                         std::string const &vertexCollDefault) -> std::string {
-      std::string found = unquote(parts[pos], quo);
-      size_t slashpos = found.find('/');
-      if (slashpos == std::string::npos) {
-        // Prepend the default vertex collection name:
-        found = vertexCollDefault + "/" + found;
-        parts[pos] = quote(found, quo);
-        slashpos = vertexCollDefault.size();
-      }
-      size_t colPos = found.find(':', slashpos + 1);
-      if (colPos != std::string::npos) {
-        // already transformed
-        return found.substr(slashpos + 1, colPos - slashpos - 1);
-      }
-      if (smartIndex > 0) {
-        // Case of no vertex collections, just prepend a few characters
-        // of the key.
-        std::string att = found.substr(slashpos + 1, smartIndex);
-        parts[pos] = quote(found.substr(0, slashpos + 1) + att + ":" +
-                               found.substr(slashpos + 1),
-                           quo);
-        return att;
-      } else {
-        auto it = translation.keyTab.find(found);
-        if (it == translation.keyTab.end()) {
-          // Did not find key, simply go on
-          return "";
+    closeFile(inFd);
+    closeFile(outFd);
+    return 5;
+  }
+  uint64_t inputSize = rangeSize(inputFile, range);
+  // A whole file counts with its header, as in the total of the phase:
+  uint64_t fileStart = e.sourceFile.empty() ? 0 : ein.fileOffset();
+  FileMetrics *fileMetrics = metrics.addFile(
+      inputFile, e.sourceFile.empty() ? rangeSize(inputFile, LineRange())
+                                      : inputSize);
+  TraceChunks traceChunks("transform", inputFile);
+
+  std::unique_ptr<OrderedWriter> ordered;
+  if (pool != nullptr) {
+    ordered = makeOrderedWriter(out, outFd, inputSize);
+  }
+  uint64_t count = transformLines(
+      ein, range, eout, ordered.get(), pool,
+      [&](std::string const &line, uint64_t, BlockWriter &eout,
+          LineStats &stats) {
+        std::vector<std::string> parts = split(line, sep, quo);
+        // Extend with empty columns to get at least the right amount of
+        // cols:
+        while (parts.size() < ncols) {
+          parts.emplace_back("");
         }
-        std::string key = found.substr(slashpos + 1);
-        parts[pos] =
-            quote(found.substr(0, slashpos + 1) +
-                      translation.smartAttributes[it->second] + ":" + key,
-                  quo);
-        return translation.smartAttributes[it->second];
-      }
-    };
-
-    std::string fromAttr = translate(fromPos, "_from", e.fromVertColl);
-    std::string toAttr = translate(toPos, "_to", e.toVertColl);
-
-    if (keyPos >= 0 && !fromAttr.empty() && !toAttr.empty()) {
-      // See if we have to translate _key as well:
-      std::string found = unquote(parts[keyPos], quo);
-      size_t colPos1 = found.find(':');
-      if (colPos1 == std::string::npos) {
-        // both positions found, need to add both attributes:
-        parts[keyPos] = quote(fromAttr + ":" + found + ":" + toAttr, quo);
-      }
-    }
-
-    // Write out the potentially modified line:
-    eout << parts[0];
-    for (size_t i = 1; i < parts.size(); ++i) {
-      eout << sep << parts[i];
-    }
-    eout << '\n';
 
-    ++count;
+        std::string fromAttr = translateEndpointCSV(
+            translation, parts[fromPos], e.fromVertColl, quo, smartIndex);
+        std::string toAttr = translateEndpointCSV(
+            translation, parts[toPos], e.toVertColl, quo, smartIndex);
+        (fromAttr.empty() ? stats.unresolved : stats.resolved) += 1;
+        (toAttr.empty() ? stats.unresolved : stats.resolved) += 1;
+
+        if (keyPos >= 0 && !fromAttr.empty() && !toAttr.empty()) {
+          // See if we have to translate _key as well:
+          std::string found = unquote(parts[keyPos], quo);
+          size_t colPos1 = found.find(':');
+          if (colPos1 == std::string::npos) {
+            // both positions found, need to add both attributes:
+            parts[keyPos] = quote(fromAttr + ":" + found + ":" + toAttr, quo);
+          }
+        }
 
-    if (count % 1000000 == 0) {
-      std::lock_guard<std::mutex> guard(mutex);
-      std::cout << id << " " << elapsed() << " Have transformed " << count
-                << " edges in " << e.fileName << "..." << std::endl;
-    }
-  }
+        // Write out the potentially modified line:
+        PROFILE_SCOPE(Output);
+        eout.append(parts[0]);
+        for (size_t i = 1; i < parts.size(); ++i) {
+          eout.append(sep);
+          eout.append(parts[i]);
+        }
+        eout.append('\n');
+      },
+      [&](uint64_t count) {
+        traceChunks.tick();
+        fileMetrics->update(count, ein.fileOffset() - fileStart);
+        if (count % 1000000 == 0) {
+          std::lock_guard<std::mutex> guard(mutex);
+          std::cout << id << " " << elapsed() << " Have transformed " << count
+                    << " edges in " << e.fileName << "..." << std::endl;
+        }
+      });
+  fileMetrics->finish();
+  traceChunks.flush();
 
   {
     std::lock_guard<std::mutex> guard(mutex);
@@ -840,155 +1301,236 @@ int transformEdgesCSV(std::mutex &mutex, size_t id, Translation &translation,
               << " edges in " << e.fileName << ", finished." << std::endl;
   }
 
-  ein.close();
-  eout.close();
+  bool readOk = !ein.failed();
+  closeFile(inFd);
+  bool ok = out.finish();
+  if (ordered != nullptr) {
+    ok = ordered->finish() && ok;
+  }
+  ok = closeFile(outFd) && ok;
 
-  if (!eout.good()) {
-    std::cerr << "An error happened at close time for " << e.fileName + ".out"
-              << ", not renaming to the original name." << std::endl;
+  if (!readOk || !ok) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!readOk) {
+      std::cerr << "Could not read " << inputFile << ": " << ein.error()
+                << ", not renaming " << e.fileName + ".out"
+                << " to the original name." << std::endl;
+    } else {
+      std::cerr << "An error happened at close time for "
+                << e.fileName + ".out" << ": " << strerror(errno)
+                << ", not renaming to the original name." << std::endl;
+    }
     return 4;
   }
 
+  TraceSpan renameSpan("rename", e.fileName);
   ::unlink(e.fileName.c_str());
   ::rename((e.fileName + ".out").c_str(), e.fileName.c_str());
   return 0;
 }
 
 int transformEdgesJSONL(std::mutex &mutex, size_t id, Translation &translation,
-                        EdgeCollection const &e, int smartIndex) {
+                        EdgeCollection const &e, int smartIndex,
+                        CompressionOptions const &compression,
+                        size_t ioDepth, TaskPool *pool) {
   {
     std::lock_guard<std::mutex> guard(mutex);
     std::cout << id << " " << elapsed() << " Transforming edges in "
               << e.fileName << " ..." << std::endl;
   }
-  std::fstream ein(e.fileName, std::ios_base::in);
-  std::fstream eout(e.fileName + ".out", std::ios_base::out);
-  std::string line;
-
-  size_t count = 0;
-
-  while (getline(ein, line)) {
-    // Parse line to VelocyPack:
-    std::shared_ptr<VPackBuilder> b = VPackParser::fromJson(line);
-    VPackSlice s = b->slice();
-
-    auto translate =
-        [&](std::string const &name, std::string const &vertexCollDefault,
-            std::string &newValue, bool &foundFlag) -> std::string {
-      VPackSlice foundSlice = s.get(name);
-      if (!foundSlice.isString()) {
-        {
-          std::lock_guard<std::mutex> guard(mutex);
-          std::cerr << id << " Found " << name
-                    << " entry which is not a string:\n"
-                    << line << std::endl;
-        }
-        foundFlag = false;
-        return "";
-      }
-      foundFlag = true;
-      newValue = foundSlice.copyString();
-      size_t slashpos = newValue.find('/');
-      if (slashpos == std::string::npos) {
-        // Prepend the default vertex collection name:
-        newValue = vertexCollDefault + "/" + newValue;
-        slashpos = vertexCollDefault.size();
-      }
-      size_t colPos = newValue.find(':', slashpos + 1);
-      if (colPos != std::string::npos) {
-        // already transformed
-        return newValue.substr(slashpos + 1, colPos - slashpos - 1);
-      }
-      if (smartIndex > 0) {
-        // Case of no vertex collections, just prepend a few characters
-        // of the key.
-        std::string att = newValue.substr(slashpos + 1, smartIndex);
-        newValue = newValue.substr(0, slashpos + 1) + att + ":" +
-                   newValue.substr(slashpos + 1);
-        return att;
-
-      } else {
-        auto it = translation.keyTab.find(newValue);
-        if (it == translation.keyTab.end()) {
-          // Did not find key, simply go on
-          return "";
-        }
-        std::string key = newValue.substr(slashpos + 1);
-        newValue = newValue.substr(0, slashpos + 1) +
-                   translation.smartAttributes[it->second] + ":" + key;
-        return translation.smartAttributes[it->second];
-      }
-    };
-
-    bool foundFrom;
-    std::string newFrom;
-    std::string fromAttr =
-        translate("_from", e.fromVertColl, newFrom, foundFrom);
-    bool foundTo;
-    std::string newTo;
-    std::string toAttr = translate("_to", e.toVertColl, newTo, foundTo);
-
-    std::string newKey;
-    bool foundKey = false;
-    if (!fromAttr.empty() && !toAttr.empty()) {
-      // See if we have to translate _key as well:
-      VPackSlice keySlice = s.get("_key");
-      if (keySlice.isString()) {
-        foundKey = true;
-        std::string found = keySlice.copyString();
-        size_t colPos1 = found.find(':');
-        if (colPos1 == std::string::npos) {
-          // both positions found, need to add both attributes:
-          newKey = fromAttr + ":" + found + ":" + toAttr;
-        }
+  TraceSpan fileSpan("edge file", e.fileName);
+  std::string const &inputFile =
+      e.sourceFile.empty() ? e.fileName : e.sourceFile;
+  std::optional<TraceSpan> openSpan;
+  openSpan.emplace("open", inputFile);
+  int inFd;
+  int outFd;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    inFd = openInput(inputFile);
+    outFd = inFd < 0 ? -1 : openOutput(e.fileName + ".out");
+  }
+  if (outFd < 0) {
+    closeFile(inFd);
+    return 3;
+  }
+  BlockReader ein(inFd);
+  ein.setThreads(compression.decompressThreads);
+  ein.setReadAhead(ioDepth);
+  // The file keeps its compression, unless `--compress` says otherwise:
+  // With several threads per file the chunks are written by themselves:
+  OutputStream out(outFd, compression.codecFor(ein.codec()),
+                   compression.threads, pool != nullptr ? 0 : ioDepth);
+  BlockWriter &eout = out.writer;
+  openSpan.reset();
+
+  LineRange range;
+  if (!e.sourceFile.empty()) {
+    range = restrictToWorker(ein, e.worker);
+    if (ein.failed()) {
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        std::cerr << id << " Cannot split " << inputFile
+                  << " between workers: " << ein.error() << std::endl;
       }
+      closeFile(inFd);
+      closeFile(outFd);
+      return 5;
     }
-
-    // Write out the potentially modified line:
-    bool written = false;
-    auto output = [&](bool found, std::string const &name,
-                      std::string const &newVal) {
-      if (found) {
-        if (written) {
-          eout << ',';
-        } else {
-          written = true;
+  }
+  uint64_t fileStart = ein.fileOffset();
+  uint64_t inputSize = rangeSize(inputFile, range);
+  FileMetrics *fileMetrics = metrics.addFile(inputFile, inputSize);
+  TraceChunks traceChunks("transform", inputFile);
+
+  std::unique_ptr<OrderedWriter> ordered;
+  if (pool != nullptr) {
+    ordered = makeOrderedWriter(out, outFd, inputSize);
+  }
+  uint64_t count = transformLines(
+      ein, range, eout, ordered.get(), pool,
+      [&](std::string const &line, uint64_t, BlockWriter &eout,
+          LineStats &stats) {
+        // Parse line to VelocyPack:
+        std::shared_ptr<VPackBuilder> b;
+        {
+          PROFILE_SCOPE(Parse);
+          b = VPackParser::fromJson(line);
         }
-        eout << '"' << name << "\":";
-        if (!newVal.empty()) {
-          eout << '"' << newVal << '"';
-        } else {
-          eout << s.get(name).toJson();
+        VPackSlice s = b->slice();
+
+        auto translate =
+            [&](std::string const &name, std::string const &vertexCollDefault,
+                std::string &newValue, bool &foundFlag) -> std::string {
+          VPackSlice foundSlice = s.get(name);
+          if (!foundSlice.isString()) {
+            {
+              std::lock_guard<std::mutex> guard(mutex);
+              std::cerr << id << " Found " << name
+                        << " entry which is not a string:\n"
+                        << line << std::endl;
+            }
+            foundFlag = false;
+            return "";
+          }
+          foundFlag = true;
+          newValue = foundSlice.copyString();
+          size_t slashpos = newValue.find('/');
+          if (slashpos == std::string::npos) {
+            // Prepend the default vertex collection name:
+            newValue = vertexCollDefault + "/" + newValue;
+            slashpos = vertexCollDefault.size();
+          }
+          size_t colPos = newValue.find(':', slashpos + 1);
+          if (colPos != std::string::npos) {
+            // already transformed
+            return newValue.substr(slashpos + 1, colPos - slashpos - 1);
+          }
+          if (smartIndex > 0) {
+            // Case of no vertex collections, just prepend a few characters
+            // of the key.
+            std::string att = newValue.substr(slashpos + 1, smartIndex);
+            newValue = newValue.substr(0, slashpos + 1) + att + ":" +
+                       newValue.substr(slashpos + 1);
+            return att;
+
+          } else {
+            PROFILE_SCOPE(Lookup);
+            std::string const *att = translation.smartAttributeOf(newValue);
+            if (att == nullptr) {
+              // Did not find key, simply go on
+              return "";
+            }
+            std::string key = newValue.substr(slashpos + 1);
+            newValue = newValue.substr(0, slashpos + 1) + *att + ":" + key;
+            return *att;
+          }
+        };
+
+        bool foundFrom;
+        std::string newFrom;
+        std::string fromAttr =
+            translate("_from", e.fromVertColl, newFrom, foundFrom);
+        bool foundTo;
+        std::string newTo;
+        std::string toAttr = translate("_to", e.toVertColl, newTo, foundTo);
+        (fromAttr.empty() ? stats.unresolved : stats.resolved) += 1;
+        (toAttr.empty() ? stats.unresolved : stats.resolved) += 1;
+
+        std::string newKey;
+        bool foundKey = false;
+        if (!fromAttr.empty() && !toAttr.empty()) {
+          // See if we have to translate _key as well:
+          VPackSlice keySlice = s.get("_key");
+          if (keySlice.isString()) {
+            foundKey = true;
+            std::string found = keySlice.copyString();
+            size_t colPos1 = found.find(':');
+            if (colPos1 == std::string::npos) {
+              // both positions found, need to add both attributes:
+              newKey = fromAttr + ":" + found + ":" + toAttr;
+            }
+          }
         }
-      }
-    };
 
-    eout << '{';
-    output(foundKey, "_key", newKey);
-    output(foundFrom, "_from", newFrom);
-    output(foundTo, "_to", newTo);
+        // Write out the potentially modified line:
+        bool written = false;
+        auto output = [&](bool found, std::string const &name,
+                          std::string const &newVal) {
+          if (found) {
+            if (written) {
+              eout.append(',');
+            } else {
+              written = true;
+            }
+            eout.append('"');
+            eout.append(name);
+            eout.append("\":");
+            if (!newVal.empty()) {
+              eout.append('"');
+              eout.append(newVal);
+              eout.append('"');
+            } else {
+              eout.append(s.get(name).toJson());
+            }
+          }
+        };
 
-    for (auto const &p : VPackObjectIterator(s)) {
-      std::string attrName = p.key.copyString();
-      if (attrName != "_key" && attrName != "_from" && attrName != "_to") {
-        if (written) {
-          eout << ",";
-        } else {
-          written = true;
+        {
+          PROFILE_SCOPE(Output);
+          eout.append('{');
+          output(foundKey, "_key", newKey);
+          output(foundFrom, "_from", newFrom);
+          output(foundTo, "_to", newTo);
+
+          for (auto const &p : VPackObjectIterator(s)) {
+            std::string attrName = p.key.copyString();
+            if (attrName != "_key" && attrName != "_from" && attrName != "_to") {
+              if (written) {
+                eout.append(',');
+              } else {
+                written = true;
+              }
+              eout.append('"');
+              eout.append(attrName);
+              eout.append("\":");
+              eout.append(p.value.toJson());
+            }
+          }
+          eout.append("}\n");
         }
-        eout << "\"" << attrName << "\":" << p.value.toJson();
-      }
-    }
-    eout << "}\n";
-
-    ++count;
-
-    if (count % 1000000 == 0) {
-      std::lock_guard<std::mutex> guard(mutex);
-      std::cout << id << " " << elapsed() << " Have transformed " << count
-                << " edges in " << e.fileName << "..." << std::endl;
-    }
-  }
+      },
+      [&](uint64_t count) {
+        traceChunks.tick();
+        fileMetrics->update(count, ein.fileOffset() - fileStart);
+        if (count % 1000000 == 0) {
+          std::lock_guard<std::mutex> guard(mutex);
+          std::cout << id << " " << elapsed() << " Have transformed " << count
+                    << " edges in " << e.fileName << "..." << std::endl;
+        }
+      });
+  fileMetrics->finish();
+  traceChunks.flush();
 
   {
     std::lock_guard<std::mutex> guard(mutex);
@@ -996,76 +1538,367 @@ int transformEdgesJSONL(std::mutex &mutex, size_t id, Translation &translation,
               << " edges in " << e.fileName << ", finished." << std::endl;
   }
 
-  ein.close();
-  eout.close();
+  bool readOk = !ein.failed();
+  closeFile(inFd);
+  bool ok = out.finish();
+  if (ordered != nullptr) {
+    ok = ordered->finish() && ok;
+  }
+  ok = closeFile(outFd) && ok;
 
-  if (!eout.good()) {
+  if (!readOk || !ok) {
     std::lock_guard<std::mutex> guard(mutex);
-    std::cerr << id << " An error happened at close time for "
-              << e.fileName + ".out" << ", not renaming to the original name."
-              << std::endl;
+    if (!readOk) {
+      std::cerr << id << " Could not read " << inputFile << ": "
+                << ein.error() << ", not renaming " << e.fileName + ".out"
+                << " to the original name." << std::endl;
+    } else {
+      std::cerr << id << " An error happened at close time for "
+                << e.fileName + ".out" << ": " << strerror(errno)
+                << ", not renaming to the original name." << std::endl;
+    }
     return 1;
   }
 
+  TraceSpan renameSpan("rename", e.fileName);
   ::unlink(e.fileName.c_str());
   ::rename((e.fileName + ".out").c_str(), e.fileName.c_str());
   return 0;
 }
 
-struct VertexBuffer {
-public:
-  std::vector<std::string> _vertexCollNames;
-  std::vector<std::string> _vertexFiles;
+// A translation index, as written by the `index` subcommand, is a sequence
+// of batches, each of which respects the `--memory` limit. A batch is the
+// magic number, the number of smart graph attributes, the attributes, the
+// number of keys and then each key followed by the position of its smart
+// graph attribute. Strings are a 32-bit length followed by the bytes, all
+// numbers are in native byte order.
+constexpr uint32_t indexMagic = 0x58495547; // "GUIX"
+
+void writeIndexString(std::ostream &out, std::string const &s) {
+  uint32_t len = static_cast<uint32_t>(s.size());
+  out.write(reinterpret_cast<char const *>(&len), sizeof(len));
+  out.write(s.data(), len);
+}
 
-private:
-  Translation _trans;
-  size_t _filePos;
-  std::ifstream _currentInput;
+bool readIndexString(std::istream &in, std::string &s) {
+  uint32_t len;
+  if (!in.read(reinterpret_cast<char *>(&len), sizeof(len))) {
+    return false;
+  }
+  s.resize(len);
+  return static_cast<bool>(in.read(s.data(), len));
+}
+
+void writeIndexBatch(std::ostream &out, Translation const &trans) {
+  uint32_t magic = indexMagic;
+  out.write(reinterpret_cast<char const *>(&magic), sizeof(magic));
+  uint64_t n = trans.smartAttributes.size();
+  out.write(reinterpret_cast<char const *>(&n), sizeof(n));
+  for (auto const &att : trans.smartAttributes) {
+    writeIndexString(out, att);
+  }
+  n = trans.keyCount();
+  out.write(reinterpret_cast<char const *>(&n), sizeof(n));
+  for (auto const &shard : trans.keyShards) {
+    for (auto const &p : shard->tab) {
+      writeIndexString(out, p.first);
+      out.write(reinterpret_cast<char const *>(&p.second), sizeof(p.second));
+    }
+  }
+}
+
+// Returns 0 if a batch was read, 1 at the end of the index and 2 if the
+// index is corrupt.
+int readIndexBatch(std::istream &in, Translation &trans) {
+  uint32_t magic;
+  if (!in.read(reinterpret_cast<char *>(&magic), sizeof(magic))) {
+    return 1;
+  }
+  if (magic != indexMagic) {
+    return 2;
+  }
+  uint64_t n;
+  if (!in.read(reinterpret_cast<char *>(&n), sizeof(n))) {
+    return 2;
+  }
+  std::string s;
+  for (uint64_t i = 0; i < n; ++i) {
+    if (!readIndexString(in, s)) {
+      return 2;
+    }
+    trans.addSmartAttribute(s);
+  }
+  if (!in.read(reinterpret_cast<char *>(&n), sizeof(n))) {
+    return 2;
+  }
+  for (uint64_t i = 0; i < n; ++i) {
+    uint32_t pos;
+    if (!readIndexString(in, s) ||
+        !in.read(reinterpret_cast<char *>(&pos), sizeof(pos)) ||
+        pos >= trans.smartAttributes.size()) {
+      return 2;
+    }
+    trans.addKey(s, pos);
+  }
+  return 0;
+}
+
+struct VertexBuffer {
+public:
+  std::vector<std::string> _vertexCollNames;
+  std::vector<std::string> _vertexFiles;
+  size_t _decompressThreads = 1; // for BGZF and seekable zstd files
+
+private:
+  // The batch which is loaded and the one which is used by the edge
+  // passes. They are the same buffer unless double buffering is on:
+  Translation _buffers[2];
+  Translation *_trans = &_buffers[0];
+  Translation *_ready = &_buffers[0];
+  bool _doubleBuffer = false;
+  bool _background = false;   // readMore runs during an edge pass
+  FileMetrics _unreported;    // progress of background loads
+  std::future<int> _prefetch; // the background load
+  size_t _filePos;
+  int _currentFd = -1;
+  std::unique_ptr<BlockReader> _currentInput;
   bool _fileOpen;
   DataType _type;
   int _keyPos;
   char _separator;
   char _quoteChar;
   uint64_t _count;
+  std::ifstream _index; // only used with a prebuilt translation index
+  TaskPool *_pool = nullptr; // loads chunks of lines if set
+  bool _useIndex;
+  bool _indexDone;
+  // For the live metrics, positions are in bytes:
+  uint64_t _bytePos = 0;    // in the current file
+  uint64_t _fileSize = 0;   // of the current file
+  uint64_t _doneBytes = 0;  // of all completely read files
+  uint64_t _totalBytes = 0; // of all vertex files
 
 public:
   VertexBuffer(DataType type, char separator, char quoteChar)
       : _filePos(0), _fileOpen(false), _type(type), _keyPos(0),
-        _separator(separator), _quoteChar(quoteChar), _count(0) {}
+        _separator(separator), _quoteChar(quoteChar), _count(0),
+        _useIndex(false), _indexDone(false) {}
+
+  bool isDone() {
+    if (_useIndex) {
+      return _indexDone;
+    }
+    return _filePos >= _vertexFiles.size();
+  }
+
+  // Take the translation from an index written by the `index` subcommand
+  // instead of reading vertex files, one batch per call to `readMore`.
+  int useIndex(std::string const &indexFile) {
+    _index.open(indexFile, std::ios::in | std::ios::binary);
+    if (!_index.good()) {
+      std::cerr << "Could not open index file " << indexFile
+                << " for reading." << std::endl;
+      return 1;
+    }
+    _useIndex = true;
+    return 0;
+  }
+
+  // Learn the vertices in chunks on the threads of `pool`, into a sharded
+  // translation. Only before the first call to `readMore`.
+  void setPool(TaskPool *pool) {
+    _pool = pool;
+    for (auto &b : _buffers) {
+      b.setKeyShards(8 * pool->threads());
+    }
+  }
 
-  bool isDone() { return _filePos >= _vertexFiles.size(); }
+  // Load every batch into the other one of two buffers, so that the next
+  // batch can be loaded with `startReadMore` while the edge passes use the
+  // current one. Only before the first call to `readMore`.
+  void setDoubleBuffer() { _doubleBuffer = true; }
 
   // Note that an empty VertexBuffer will be `isDone` right from the beginning,
   // however, it is still possible to call `readMore` once. This is used in the
   // case of the edge transformation without vertex collections.
 
   int readMore(size_t memLimit) {
+    int res = load(memLimit);
+    makeReady();
+    return res;
+  }
+
+  // Starts `readMore` on a thread of its own while `translation()` is still
+  // in use. It reads line by line without the pool, which the edge pass
+  // keeps busy. The metrics show the edge pass meanwhile.
+  void startReadMore(size_t memLimit) {
+    _background = true;
+    _prefetch = std::async(std::launch::async, [this, memLimit] {
+      setTraceThreadName("vertex loader");
+      return load(memLimit);
+    });
+  }
+
+  // Waits for the batch of `startReadMore`, which `translation()` returns
+  // then. Returns the result of `readMore`.
+  int finishReadMore() {
+    int res = _prefetch.get();
+    _background = false;
+    makeReady();
+    publishTranslation(*_ready);
+    return res;
+  }
+
+  Translation &translation() { return *_ready; }
+
+private:
+  int load(size_t memLimit) {
+    TraceSpan span("readMore");
+    return _useIndex ? readIndex() : readFiles(memLimit);
+  }
+
+  // Hands the loaded batch to `translation()`. Only on the thread of the
+  // edge passes and never while a background load runs, since edge tasks
+  // may still use the previous batch until then:
+  void makeReady() {
+    _ready = _trans;
+    if (_doubleBuffer) {
+      _trans = _trans == &_buffers[0] ? &_buffers[1] : &_buffers[0];
+    }
+  }
+
+  int readFiles(size_t memLimit) {
     std::cout << elapsed() << " Reading vertices..." << std::endl;
     std::string line;
-    _trans.clear();
+    _trans->clear();
+    if (!_background) {
+      metrics.beginPhase("load", totalBytes(), _doneBytes + _bytePos);
+    }
+    FileMetrics *fileMetrics = nullptr;
+    uint64_t metricsBase = 0;
+    uint64_t metricsCount = 0;
+    std::optional<TraceSpan> readSpan;
+    if (_fileOpen) {
+      // Continue with the file from the previous batch:
+      fileMetrics = addFileMetrics(_vertexFiles[_filePos],
+                                   _fileSize - std::min(_fileSize, _bytePos));
+      metricsBase = _bytePos;
+      metricsCount = _count;
+      readSpan.emplace("read", _vertexFiles[_filePos]);
+    }
+    auto report = [&] {
+      publishTranslation(*_trans);
+      std::cout << elapsed() << " Have read " << _count << " vertices (needs "
+                << _trans->memUsage() / (1024 * 1024) << " MB of RAM)."
+                << std::endl;
+    };
+    // With a pool the lines are cut into chunks, which the threads learn at
+    // the same time. After a round of one chunk per thread all are waited
+    // for, then nothing changes the translation and the memory usage can be
+    // checked exactly. The chunks of a round are sized so that the round,
+    // its lines included, needs at most half of the memory which is left,
+    // going by the growth per input byte so far. The first lines of a
+    // batch, and all lines once the chunks would be smaller than minChunk,
+    // are learned by this thread one by one as without a pool, so that the
+    // limit is exceeded by at most one line there as well. A background
+    // load does not use the pool: its chunks would only queue behind the
+    // edge tasks of the pass and this thread would wait for them:
+    constexpr size_t minChunk = 64 << 10;
+    constexpr size_t maxChunk = 256 << 10;
+    TaskPool *pool = _background ? nullptr : _pool;
+    std::optional<TaskGroup> chunks;
+    if (pool != nullptr) {
+      chunks.emplace(*pool);
+    }
+    std::string chunk;
+    size_t chunkSize = 0; // 0 means line by line
+    size_t inFlight = 0;
+    uint64_t reported = _count / 1000000;
+    size_t const batchBase = _trans->memUsage();
+    uint64_t batchBytes = 0;
+    auto flush = [&] {
+      if (chunk.empty()) {
+        return;
+      }
+      chunks->run([this, data = std::move(chunk),
+                   collName = _vertexCollNames[_filePos], keyPos = _keyPos] {
+        AttributeCache cache;
+        std::string line;
+        size_t pos = 0;
+        while (pos < data.size()) {
+          size_t nl = data.find('\n', pos);
+          line.assign(data, pos, nl - pos);
+          if (_type == CSV) {
+            learnLineCSV(*_trans, line, _separator, _quoteChar, keyPos,
+                         collName, &cache);
+          } else {
+            learnLineJSONL(*_trans, line, collName, &cache);
+          }
+          pos = nl + 1;
+        }
+      });
+      chunk.clear();
+      if (++inFlight == pool->threads()) {
+        chunks->join();
+        inFlight = 0;
+        if (_count / 1000000 != reported) {
+          reported = _count / 1000000;
+          report();
+        }
+      }
+    };
     while (_filePos < _vertexFiles.size()) {
-      if (_trans.memUsage >= memLimit) {
-        break;
+      if (inFlight == 0 && chunk.empty()) {
+        size_t used = _trans->memUsage();
+        if (used >= memLimit) {
+          break;
+        }
+        chunkSize = 0;
+        if (pool != nullptr && batchBytes >= minChunk) {
+          double perByte =
+              static_cast<double>(std::max(used, batchBase) - batchBase + 1) /
+              batchBytes;
+          // The lines of the round are in memory as well:
+          double size =
+              (memLimit - used) / 2.0 / (perByte + 1) / pool->threads();
+          if (size >= minChunk) {
+            chunkSize = std::min(static_cast<size_t>(size), maxChunk);
+          }
+        }
       }
       if (!_fileOpen) {
         std::cout << elapsed() << " Opening vertex file "
                   << _vertexFiles[_filePos] << " ..." << std::endl;
-        _currentInput.open(_vertexFiles[_filePos].c_str(), std::ios::in);
+        readSpan.emplace("read", _vertexFiles[_filePos]);
+        _currentFd = openInput(_vertexFiles[_filePos]);
         _count = 0;
-        if (_currentInput.good()) {
-          _fileOpen = true;
-        } else {
-          std::cerr << "Could not open file " << _vertexFiles[_filePos]
-                    << " for reading." << std::endl;
+        _bytePos = 0;
+        std::error_code ec;
+        _fileSize = std::filesystem::file_size(_vertexFiles[_filePos], ec);
+        if (ec) {
+          _fileSize = 0;
+        }
+        fileMetrics = addFileMetrics(_vertexFiles[_filePos], _fileSize);
+        metricsBase = 0;
+        metricsCount = 0;
+        if (_currentFd < 0) {
           return 1;
         }
+        _currentInput = std::make_unique<BlockReader>(_currentFd);
+        _currentInput->setThreads(_decompressThreads);
+        _fileOpen = true;
         if (_type == CSV) {
           // Read header:
-          if (!getline(_currentInput, line)) {
+          if (!_currentInput->getLine(line)) {
             std::cerr << "Could not read header line in vertex file "
-                      << _vertexFiles[_filePos] << ", giving up." << std::endl;
+                      << _vertexFiles[_filePos]
+                      << (_currentInput->failed()
+                              ? ": " + _currentInput->error()
+                              : "")
+                      << ", giving up." << std::endl;
             return 2;
           }
+          _bytePos = _currentInput->fileOffset();
           std::vector<std::string> colHeaders =
               split(line, _separator, _quoteChar);
           for (auto &s : colHeaders) {
@@ -1081,33 +1914,236 @@ public:
           // ...
         }
       }
-      if (!getline(_currentInput, line)) {
-        _currentInput.close();
+      if (!_currentInput->getLine(line)) {
+        if (_currentInput->failed()) {
+          std::cerr << "Could not read vertex file " << _vertexFiles[_filePos]
+                    << ": " << _currentInput->error() << ", giving up."
+                    << std::endl;
+          return 5;
+        }
+        if (pool != nullptr) {
+          flush(); // the chunks know their collection
+        }
+        _currentInput.reset();
+        closeFile(_currentFd);
         ++_filePos;
         _fileOpen = false;
+        _doneBytes += _fileSize;
+        _bytePos = 0;
+        fileMetrics->finish();
+        readSpan.reset();
         continue; // will read more from next file
       }
       ++_count;
-      if (_type == CSV) {
-        learnLineCSV(_trans, line, _separator, _quoteChar, _keyPos,
+      _bytePos = _currentInput->fileOffset();
+      batchBytes += line.size() + 1;
+      if (chunkSize > 0) {
+        chunk.append(line);
+        chunk.push_back('\n');
+        if (chunk.size() >= chunkSize) {
+          flush();
+        }
+      } else if (_type == CSV) {
+        learnLineCSV(*_trans, line, _separator, _quoteChar, _keyPos,
                      _vertexCollNames[_filePos]);
       } else {
-        learnLineJSONL(_trans, line, _vertexCollNames[_filePos]);
+        learnLineJSONL(*_trans, line, _vertexCollNames[_filePos]);
       }
-      if (_count % 1000000 == 0) {
-        std::cout << elapsed() << " Have read " << _count << " vertices (needs "
-                  << _trans.memUsage / (1024 * 1024) << " MB of RAM)."
-                  << std::endl;
+      fileMetrics->update(_count - metricsCount, _bytePos - metricsBase);
+      if (chunkSize == 0 && _count % 1000000 == 0) {
+        reported = _count / 1000000;
+        report();
       }
     }
-    std::cout << elapsed() << " Have read " << _trans.memUsage / (1024 * 1024)
-              << " MB of vertex data." << std::endl;
+    if (chunks) {
+      chunks->join();
+    }
+    publishTranslation(*_trans);
+    std::cout << elapsed() << " Have read "
+              << _trans->memUsage() / (1024 * 1024) << " MB of vertex data."
+              << std::endl;
     return 0;
   }
 
-  Translation &translation() { return _trans; }
+  // Total size of all vertex files, for the progress estimate:
+  uint64_t totalBytes() {
+    if (_totalBytes == 0) {
+      for (auto const &f : _vertexFiles) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(f, ec);
+        _totalBytes += ec ? 0 : size;
+      }
+    }
+    return _totalBytes;
+  }
+
+  FileMetrics *addFileMetrics(std::string const &fileName, uint64_t size) {
+    if (_background) {
+      return &_unreported;
+    }
+    return metrics.addFile(fileName, size);
+  }
+
+  // The edge pass still uses the other buffer during a background load:
+  void publishTranslation(Translation const &t) {
+    if (!_background) {
+      metrics.setTranslation(t.keyCount(), t.smartAttributes.size(),
+                             t.keyBucketCount(), t.memUsage());
+    }
+  }
+
+  int readIndex() {
+    std::cout << elapsed() << " Reading translation index..." << std::endl;
+    _trans->clear();
+    int res = readIndexBatch(_index, *_trans);
+    publishTranslation(*_trans);
+    if (res == 2) {
+      std::cerr << "Translation index is corrupt, giving up." << std::endl;
+      _indexDone = true;
+      return 4;
+    }
+    _index.peek(); // detect the end of the index after the last batch
+    _indexDone = res != 0 || _index.eof();
+    std::cout << elapsed() << " Have read "
+              << _trans->memUsage() / (1024 * 1024)
+              << " MB of vertex data from index." << std::endl;
+    return 0;
+  }
 };
 
+int addVertexCollections(std::vector<std::string> const &specs,
+                         VertexBuffer &vertexBuffer) {
+  for (auto const &s : specs) {
+    auto pos = s.find(":");
+    if (pos == std::string::npos) {
+      std::cerr << "Value for `--vertices` option needs to be of the form "
+                   "<collname>:<collfile>, but is: "
+                << s << " Giving up." << std::endl;
+      return 2;
+    }
+    vertexBuffer._vertexCollNames.push_back(s.substr(0, pos));
+    vertexBuffer._vertexFiles.push_back(s.substr(pos + 1));
+  }
+  return 0;
+}
+
+// Adds the vertex and edge collections of the JSON manifest `fileName`
+// to `--vertices` and `--edges` in `options`. The manifest is an object
+// with the arrays "vertices" and "edges". Their entries are either strings
+// like the values of the options or objects like
+//   {"collection": "profiles", "file": "profiles.csv"} and
+//   {"file": "relations.csv", "from": "profiles", "to": "profiles",
+//    "renames": {"3": "name"}}
+// where "renames" is optional. Returns 0 on success.
+int readManifest(std::string const &fileName, Options &options) {
+  std::ifstream in(fileName, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    std::cerr << "Could not open manifest file " << fileName << ": "
+              << strerror(errno) << ", giving up." << std::endl;
+    return 1;
+  }
+  std::stringstream text;
+  text << in.rdbuf();
+  std::shared_ptr<VPackBuilder> b;
+  try {
+    b = VPackParser::fromJson(text.str());
+  } catch (std::exception const &e) {
+    std::cerr << "Manifest file " << fileName << " is not valid JSON ("
+              << e.what() << "), giving up." << std::endl;
+    return 2;
+  }
+  VPackSlice s = b->slice();
+  if (!s.isObject()) {
+    std::cerr << "Manifest file " << fileName
+              << " must contain a JSON object, giving up." << std::endl;
+    return 3;
+  }
+  // The fields of an entry, which must not contain a colon:
+  auto field = [&](VPackSlice entry, std::string const &name,
+                   std::string &value) -> bool {
+    VPackSlice f = entry.get(name);
+    if (!f.isString() || f.copyString().find(':') != std::string::npos) {
+      std::cerr << "Entry " << entry.toJson() << " in manifest file "
+                << fileName << " needs a string \"" << name
+                << "\" without colons, giving up." << std::endl;
+      return false;
+    }
+    value = f.copyString();
+    return true;
+  };
+  // "vertices" and "edges" are optional, but lists if they are there:
+  auto list = [&](std::string const &name) -> bool {
+    VPackSlice l = s.get(name);
+    if (!l.isNone() && !l.isArray()) {
+      std::cerr << "Manifest file " << fileName << " needs a list in \""
+                << name << "\", giving up." << std::endl;
+      return false;
+    }
+    return true;
+  };
+  if (!list("vertices") || !list("edges")) {
+    return 7;
+  }
+  VPackSlice vertices = s.get("vertices");
+  if (vertices.isArray()) {
+    for (auto const &v : VPackArrayIterator(vertices)) {
+      std::string spec;
+      if (v.isString()) {
+        spec = v.copyString();
+      } else {
+        std::string coll, file;
+        if (!field(v, "collection", coll) || !field(v, "file", file)) {
+          return 4;
+        }
+        spec = coll + ":" + file;
+      }
+      options["--vertices"].push_back(spec);
+    }
+  }
+  VPackSlice edges = s.get("edges");
+  if (edges.isArray()) {
+    for (auto const &e : VPackArrayIterator(edges)) {
+      std::string spec;
+      if (e.isString()) {
+        spec = e.copyString();
+      } else {
+        std::string file, from, to;
+        if (!field(e, "file", file) || !field(e, "from", from) ||
+            !field(e, "to", to)) {
+          return 5;
+        }
+        spec = file + ":" + from + ":" + to;
+        VPackSlice renames = e.get("renames");
+        if (!renames.isNone() && !renames.isObject()) {
+          std::cerr << "Entry " << e.toJson() << " in manifest file "
+                    << fileName << " needs an object in \"renames\", giving up."
+                    << std::endl;
+          return 6;
+        }
+        if (renames.isObject()) {
+          for (auto const &p : VPackObjectIterator(renames)) {
+            std::string name;
+            if (!field(renames, p.key.copyString(), name)) {
+              return 6;
+            }
+            spec += ":" + p.key.copyString() + ":" + name;
+          }
+        }
+      }
+      options["--edges"].push_back(spec);
+    }
+  }
+  return 0;
+}
+
+// Bytes which the transformation of `e` reads in its first pass:
+uint64_t inputSize(EdgeCollection const &e) {
+  if (e.sourceFile.empty()) {
+    return rangeSize(e.fileName, LineRange());
+  }
+  return rangeSize(e.sourceFile, LineRange()) / e.worker.n;
+}
+
 int doEdges(Options const &options) {
   // Check options, find vertex colls and edge colls
   DataType type = CSV;
@@ -1143,6 +2179,49 @@ int doEdges(Options const &options) {
   if (it != options.end()) {
     nrThreads = strtoul(it->second[0].c_str(), nullptr, 10);
   }
+  bool haveWorker = false;
+  WorkerSpec workerSpec;
+  it = options.find("--worker");
+  if (it != options.end()) {
+    if (!parseWorkerSpec(it->second[0], workerSpec)) {
+      std::cerr << "Value for `--worker` option needs to be of the form "
+                   "<k>/<n> with 0 <= k < n, but is: "
+                << it->second[0] << " Giving up." << std::endl;
+      return 8;
+    }
+    haveWorker = true;
+  }
+  bool splitRanges = false;
+  it = options.find("--worker-split");
+  if (it != options.end()) {
+    if (it->second[0] == "ranges") {
+      splitRanges = true;
+    } else if (it->second[0] != "files") {
+      std::cerr << "Value for `--worker-split` must be `files` or `ranges`, "
+                   "giving up."
+                << std::endl;
+      return 9;
+    }
+  }
+  CompressionOptions compression;
+  if (parseCompressionOptions(options, compression) != 0) {
+    return 12;
+  }
+  size_t ioDepth = 0;
+  it = options.find("--io-depth");
+  if (it != options.end()) {
+    ioDepth = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
+  size_t chunkThreads = 1;
+  it = options.find("--chunk-threads");
+  if (it != options.end()) {
+    chunkThreads = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
+  if (ioDepth > 0 && !ioUringAvailable()) {
+    std::cout << "io_uring is not available, reading and writing edge files "
+                 "with pread and pwrite."
+              << std::endl;
+  }
 
   // Set up translator and set up vertex reader object
   // while vertex reader object not done
@@ -1152,10 +2231,16 @@ int doEdges(Options const &options) {
   //   forget all vertex data
   //   read more vertex data
   VertexBuffer vertexBuffer(type, sep, quo);
+  vertexBuffer._decompressThreads = compression.decompressThreads;
 
   // Add vertex collections:
-  it = options.find("--vertices");
-  if (it == options.end()) {
+  it = options.find("--index");
+  if (it != options.end()) {
+    // Prebuilt translation index, possibly shared between workers:
+    if (vertexBuffer.useIndex(it->second[0]) != 0) {
+      return 10;
+    }
+  } else if ((it = options.find("--vertices")) == options.end()) {
     // Strange, no vertex collections, there is only one use case, namely,
     // that `--smart-value` is `_key` (implicit) and `--smart_index` is
     // set. Then the smart graph attribute is a prefix of the key and
@@ -1168,16 +2253,9 @@ int doEdges(Options const &options) {
       return 1;
     }
   } else {
-    for (auto const &s : it->second) {
-      auto pos = s.find(":");
-      if (pos == std::string::npos) {
-        std::cerr << "Value for `--vertices` option needs to be of the form "
-                     "<collname>:<collfile>, but is: "
-                  << s << " Giving up." << std::endl;
-        return 2;
-      }
-      vertexBuffer._vertexCollNames.push_back(s.substr(0, pos));
-      vertexBuffer._vertexFiles.push_back(s.substr(pos + 1));
+    int res = addVertexCollections(it->second, vertexBuffer);
+    if (res != 0) {
+      return res;
     }
   }
 
@@ -1225,50 +2303,307 @@ int doEdges(Options const &options) {
                        .columnRenames = std::move(renames)});
   }
 
-  // Main work:
+  if (haveWorker) {
+    // Either take every n-th edge file or a line range of every file:
+    std::vector<EdgeCollection> mine;
+    for (size_t i = 0; i < edgeCollections.size(); ++i) {
+      EdgeCollection &e = edgeCollections[i];
+      if (splitRanges) {
+        e.sourceFile = e.fileName;
+        e.fileName = partFileName(e.fileName, workerSpec.k);
+        e.worker = workerSpec;
+        mine.push_back(std::move(e));
+      } else if (i % workerSpec.n == workerSpec.k) {
+        mine.push_back(std::move(e));
+      }
+    }
+    edgeCollections = std::move(mine);
+  }
+
+  // Largest file first, the smaller ones then fill the gaps, so that the
+  // last file to finish is not a big one which started late:
+  std::vector<uint64_t> sizes;
+  for (auto const &e : edgeCollections) {
+    sizes.push_back(inputSize(e));
+  }
+  std::vector<size_t> order(edgeCollections.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sizes[a] > sizes[b];
+  });
+  {
+    std::vector<EdgeCollection> sorted;
+    for (size_t i : order) {
+      sorted.push_back(std::move(edgeCollections[i]));
+    }
+    edgeCollections = std::move(sorted);
+  }
+
+  // Main work, the edge files and their chunks are tasks of one pool with
+  // work stealing:
+  bool memoryReport =
+      (*getOption(options, "--memory-report").value())[0] == "true";
+  TaskPool pool(std::max(nrThreads, chunkThreads), [](size_t i) {
+    setTraceThreadName("edge worker " + std::to_string(i));
+  });
+  if (pool.threads() > 1) {
+    vertexBuffer.setPool(&pool);
+  }
+  // With double buffering every batch gets half of the memory and the
+  // next one is loaded during the edge pass of the current one:
+  bool doubleBuffer =
+      (*getOption(options, "--double-buffer").value())[0] == "true";
+  if (doubleBuffer) {
+    vertexBuffer.setDoubleBuffer();
+    memLimit /= 2;
+  }
+  size_t pass = 0;
+  bool lastPass;
   do {
-    vertexBuffer.readMore(memLimit);
-    std::deque<EdgeCollection> queue;
-    std::mutex mutex;
-    int error = 0;
+    metrics.setPass(++pass);
+    TraceSpan passSpan("pass");
+    if (memoryReport) {
+      beginMemoryPhase("load (pass " + std::to_string(pass) + ")");
+    }
+    if ((doubleBuffer && pass > 1 ? vertexBuffer.finishReadMore()
+                                  : vertexBuffer.readMore(memLimit)) != 0) {
+      return 11;
+    }
+    lastPass = vertexBuffer.isDone();
+    // The batch of this pass, taken before the next one starts loading:
+    Translation &trans = vertexBuffer.translation();
+    if (doubleBuffer && !lastPass) {
+      vertexBuffer.startReadMore(memLimit);
+    }
+    if (memoryReport) {
+      endMemoryPhase();
+      trans.printMemoryReport(std::cout);
+      beginMemoryPhase("edges (pass " + std::to_string(pass) + ")");
+    }
+    uint64_t edgeBytes = 0;
     for (auto const &e : edgeCollections) {
-      queue.push_back(e);
+      edgeBytes += inputSize(e);
     }
-    auto worker = [&](size_t id) {
-      while (true) { // left when queue empty
-        EdgeCollection e;
-        {
-          std::lock_guard<std::mutex> guard(mutex);
-          if (queue.size() == 0) {
-            break;
-          }
-          e = queue[0];
-          queue.pop_front();
-        }
+    metrics.beginPhase("edges", edgeBytes);
+    // Every edge file is a task of the pool, which cuts the file into
+    // chunks for the other threads if there are any. Tasks from outside
+    // start in order, so the largest file goes first:
+    std::mutex mutex;
+    std::atomic<int> error{0};
+    TaskGroup files(pool);
+    for (auto const &e : edgeCollections) {
+      files.run([&, e] {
+        size_t id = pool.currentIndex();
+        TaskPool *chunkPool = pool.threads() > 1 ? &pool : nullptr;
         if (type == CSV) {
-          if (transformEdgesCSV(mutex, id, vertexBuffer.translation(), e, sep,
-                                quo, smartIndex) != 0) {
+          if (transformEdgesCSV(mutex, id, trans, e, sep, quo, smartIndex,
+                                compression, ioDepth, chunkPool) != 0) {
             error = 6;
           }
         } else {
-          if (transformEdgesJSONL(mutex, id, vertexBuffer.translation(), e,
-                                  smartIndex) != 0) {
+          if (transformEdgesJSONL(mutex, id, trans, e, smartIndex,
+                                  compression, ioDepth, chunkPool) != 0) {
             error = 7;
           }
         }
-      }
-    };
-    std::vector<std::thread> threads;
-    for (size_t i = 0; i < nrThreads; ++i) {
-      threads.emplace_back(worker, i);
-    }
-    for (size_t i = 0; i < nrThreads; ++i) {
-      threads[i].join();
+      });
     }
+    files.join();
     if (error != 0) {
+      if (doubleBuffer && !lastPass) {
+        vertexBuffer.finishReadMore(); // it uses the other buffer
+      }
       return error;
     }
+    // Further passes work on the part files written in this pass:
+    for (auto &e : edgeCollections) {
+      e.sourceFile.clear();
+    }
+  } while (!lastPass);
+  return 0;
+}
+
+int doIndex(Options const &options) {
+  DataType type = CSV;
+  auto it = options.find("--type");
+  if (it != options.end()) {
+    if (it->second[0] == "jsonl" || it->second[0] == "JSONL") {
+      type = JSONL;
+    }
+  }
+  char sep = ',';
+  it = options.find("--separator");
+  if (it != options.end() && !it->second[0].empty()) {
+    sep = it->second[0][0];
+  }
+  char quo;
+  it = options.find("--quote-char");
+  if (it != options.end() && !it->second[0].empty()) {
+    quo = it->second[0][0];
+  }
+  it = options.find("--memory");
+  assert(it != options.end()); // there is a default
+  size_t memLimit =
+      strtoul(it->second[0].c_str(), nullptr, 10) * 1024 * 1024; // in MBs
+  it = options.find("--index");
+  if (it == options.end()) {
+    std::cerr << "Need index file with --index option, giving up."
+              << std::endl;
+    return 1;
+  }
+  std::string indexFile = it->second[0];
+  CompressionOptions compression;
+  if (parseCompressionOptions(options, compression) != 0) {
+    return 1;
+  }
+
+  VertexBuffer vertexBuffer(type, sep, quo);
+  vertexBuffer._decompressThreads = compression.decompressThreads;
+  it = options.find("--vertices");
+  if (it == options.end()) {
+    std::cerr << "Need at least one vertex collection with the `--vertices` "
+                 "option. Giving up."
+              << std::endl;
+    return 2;
+  }
+  int res = addVertexCollections(it->second, vertexBuffer);
+  if (res != 0) {
+    return res;
+  }
+  size_t nrThreads =
+      strtoul((*getOption(options, "--threads").value())[0].c_str(), nullptr,
+              10);
+  std::unique_ptr<TaskPool> pool;
+  if (nrThreads > 1) {
+    pool = std::make_unique<TaskPool>(nrThreads, [](size_t i) {
+      setTraceThreadName("load worker " + std::to_string(i));
+    });
+    vertexBuffer.setPool(pool.get());
+  }
+
+  bool memoryReport =
+      (*getOption(options, "--memory-report").value())[0] == "true";
+  std::ofstream out(indexFile, std::ios::out | std::ios::binary);
+  size_t batch = 0;
+  do {
+    if (memoryReport) {
+      beginMemoryPhase("load (batch " + std::to_string(++batch) + ")");
+    }
+    if (vertexBuffer.readMore(memLimit) != 0) {
+      return 3;
+    }
+    if (memoryReport) {
+      endMemoryPhase();
+      vertexBuffer.translation().printMemoryReport(std::cout);
+    }
+    writeIndexBatch(out, vertexBuffer.translation());
   } while (!vertexBuffer.isDone());
+  out.close();
+  if (!out.good()) {
+    std::cerr << "An error happened at close time for " << indexFile << "."
+              << std::endl;
+    return 4;
+  }
+  std::cout << elapsed() << " Have written translation index " << indexFile
+            << "." << std::endl;
+  return 0;
+}
+
+// Concatenates the part files written by `--worker k/n` in the order of the
+// workers. For CSV only the header line of the first part is kept.
+int doMerge(Options const &options) {
+  auto output = getOption(options, "--output");
+  if (!output) {
+    std::cerr << "Need output file with --output option, giving up."
+              << std::endl;
+    return 1;
+  }
+  std::string outputFile = (*output.value())[0];
+  auto it = options.find("--parts");
+  size_t nrParts = 0;
+  if (it != options.end()) {
+    nrParts = strtoul(it->second[0].c_str(), nullptr, 10);
+  }
+  if (nrParts == 0) {
+    std::cerr << "Need a positive number of parts with --parts option, "
+                 "giving up."
+              << std::endl;
+    return 2;
+  }
+  DataType type = CSV;
+  it = options.find("--type");
+  if (it != options.end()) {
+    if (it->second[0] == "jsonl" || it->second[0] == "JSONL") {
+      type = JSONL;
+    }
+  }
+
+  for (size_t k = 0; k < nrParts; ++k) {
+    if (!std::filesystem::exists(partFileName(outputFile, k))) {
+      std::cerr << "Did not find part file " << partFileName(outputFile, k)
+                << ", giving up." << std::endl;
+      return 3;
+    }
+  }
+
+  CompressionOptions compression;
+  if (parseCompressionOptions(options, compression) != 0) {
+    return 5;
+  }
+  int outFd = openOutput(outputFile + ".out");
+  if (outFd < 0) {
+    return 4;
+  }
+  // The parts are decompressed and the result compressed as a whole:
+  OutputStream out(outFd,
+                   compression.codecFor(codecForFileName(outputFile)),
+                   compression.threads);
+  bool readOk = true;
+  for (size_t k = 0; k < nrParts && readOk; ++k) {
+    int inFd = openInput(partFileName(outputFile, k));
+    if (inFd < 0) {
+      readOk = false;
+      break;
+    }
+    BlockReader in(inFd);
+    in.setThreads(compression.decompressThreads);
+    if (type == CSV && k > 0) {
+      std::string header;
+      in.getLine(header);
+    }
+    for (std::string_view block = in.readBlock(); !block.empty();
+         block = in.readBlock()) {
+      out.writer.append(block);
+    }
+    if (in.failed()) {
+      std::cerr << "Could not read " << partFileName(outputFile, k) << ": "
+                << in.error() << ", giving up." << std::endl;
+      readOk = false;
+    }
+    closeFile(inFd);
+  }
+  bool ok = out.finish();
+  ok = closeFile(outFd) && ok;
+
+  if (!readOk || !ok) {
+    if (readOk) {
+      std::cerr << "An error happened at close time for "
+                << outputFile + ".out" << ": " << strerror(errno)
+                << ", not renaming to the original name." << std::endl;
+    }
+    ::unlink((outputFile + ".out").c_str());
+    return 4;
+  }
+
+  ::unlink(outputFile.c_str());
+  ::rename((outputFile + ".out").c_str(), outputFile.c_str());
+  for (size_t k = 0; k < nrParts; ++k) {
+    ::unlink(partFileName(outputFile, k).c_str());
+  }
+  std::cout << elapsed() << " Have merged " << nrParts << " parts into "
+            << outputFile << "." << std::endl;
   return 0;
 }
 
@@ -1322,6 +2657,252 @@ void runTests() {
   MYASSERT(unquote(v[0], '"') == "aa");
   MYASSERT(v[1] == "b");
   MYASSERT(v[2] == "c");
+
+  WorkerSpec w;
+  MYASSERT(parseWorkerSpec("1/3", w));
+  MYASSERT(w.k == 1 && w.n == 3);
+  MYASSERT(!parseWorkerSpec("3/3", w));
+  MYASSERT(!parseWorkerSpec("1/0", w));
+  MYASSERT(!parseWorkerSpec("1", w));
+  MYASSERT(!parseWorkerSpec("x/2", w));
+
+  uint64_t last = 10;
+  for (size_t k = 0; k < 3; ++k) {
+    LineRange r = workerRange(10, 110, WorkerSpec{.k = k, .n = 3});
+    MYASSERT(r.start == last);
+    last = r.end;
+  }
+  MYASSERT(last == 110);
+
+  std::stringstream lines("ab\ncd\nef\n");
+  MYASSERT(seekLineStart(lines, 0) == 0);
+  MYASSERT(seekLineStart(lines, 1) == 3);
+  MYASSERT(seekLineStart(lines, 3) == 3);
+  std::string l;
+  getline(lines, l);
+  MYASSERT(l == "cd");
+
+  Translation trans;
+  learnSmartKey(trans, "a:1", "v");
+  learnSmartKey(trans, "a:2", "v");
+  learnSmartKey(trans, "b:a-key-which-does-not-fit-into-sso", "v");
+  MYASSERT(trans.keyCount() == 3);
+  MYASSERT(trans.smartAttributes.size() == 2);
+  MYASSERT(trans.keyStringBytes() > 0);
+  MYASSERT(trans.memUsage() > trans.keyTabAccount().chunkBytes);
+  HashTableStats stats = trans.keyTabStats();
+  size_t probed = 0;
+  for (size_t n : stats.probeLengths) {
+    probed += n;
+  }
+  MYASSERT(probed == 3);
+  size_t usedBefore = trans.memUsage();
+  trans.clear();
+  // What is left, if anything, are the containers themselves:
+  MYASSERT(trans.memUsage() < usedBefore);
+  MYASSERT(trans.keyStringBytes() == 0);
+  MYASSERT(trans.memUsage() == trans.keyTabAccount().chunkBytes +
+                                   trans.attTabAccount.chunkBytes +
+                                   trans.smartAttributesAccount.chunkBytes);
+
+  // Learning on several threads into shards gives the same translation and
+  // memory usage as learning on one thread:
+  {
+    Translation serial;
+    Translation sharded;
+    sharded.setKeyShards(8);
+    for (int i = 0; i < 4000; ++i) {
+      learnSmartKey(serial, std::to_string(i % 7) + ":" + std::to_string(i),
+                    "v");
+    }
+    TaskPool pool(4);
+    TaskGroup group(pool);
+    for (int t = 0; t < 4; ++t) {
+      group.run([&sharded, t] {
+        AttributeCache cache;
+        for (int i = t; i < 4000; i += 4) {
+          learnSmartKey(sharded,
+                        std::to_string(i % 7) + ":" + std::to_string(i), "v",
+                        &cache);
+        }
+      });
+    }
+    group.join();
+    MYASSERT(sharded.keyCount() == 4000);
+    MYASSERT(sharded.smartAttributes.size() == 7);
+    MYASSERT(sharded.keyStringBytes() == serial.keyStringBytes());
+    for (int i = 0; i < 4000; i += 97) {
+      std::string const *att = sharded.smartAttributeOf("v/" +
+                                                        std::to_string(i));
+      MYASSERT(att != nullptr && *att == std::to_string(i % 7));
+    }
+    MYASSERT(sharded.smartAttributeOf("v/4000") == nullptr);
+  }
+
+  MYASSERT(calculateSha1("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+  Sha1Stream digest;
+  digest.update("ab", 2);
+  digest.update("c", 1);
+  MYASSERT(digest.hexDigest() == calculateSha1("abc"));
+  MYASSERT(split("a,b\",\"c", ',', '"').size() == 2);
+
+  // Lines across block boundaries and a last line without newline:
+  int fds[2];
+  MYASSERT(pipe(fds) == 0);
+  MYASSERT(writeAll(fds[1], "abcd\n\nxyz", 9));
+  close(fds[1]);
+  {
+    BlockReader reader(fds[0], 3);
+    std::string l;
+    MYASSERT(reader.getLine(l) && l == "abcd");
+    MYASSERT(reader.getLine(l) && l.empty());
+    MYASSERT(reader.getLine(l) && l == "xyz" && reader.offset() == 9);
+    MYASSERT(!reader.getLine(l) && !reader.failed());
+  }
+  close(fds[0]);
+
+  // The same written and read with several requests in flight, more blocks
+  // than requests:
+  FILE *tmp = tmpfile();
+  MYASSERT(tmp != nullptr);
+  {
+    WriteBehind writer(fileno(tmp), 0, 4, 2);
+    MYASSERT(writer.write("abcd\n", 5) && writer.write("\nxyz", 4));
+    MYASSERT(writer.finish());
+    BlockReader reader(fileno(tmp), 3);
+    reader.setReadAhead(2);
+    std::string l;
+    MYASSERT(reader.getLine(l) && l == "abcd");
+    MYASSERT(reader.getLine(l) && l.empty());
+    MYASSERT(reader.getLine(l) && l == "xyz" && reader.offset() == 9);
+    MYASSERT(!reader.getLine(l) && !reader.failed());
+    MYASSERT(reader.seek(1) && reader.getLine(l) && l == "bcd");
+  }
+  fclose(tmp);
+
+  // Block-indexed files: the index, seek() and dataSize(), with the blocks
+  // decompressed while reading and on several threads, with and without
+  // read-ahead:
+  std::string data;
+  std::vector<uint64_t> lineStarts;
+  for (int i = 0; data.size() < (300 << 10); ++i) {
+    lineStarts.push_back(data.size());
+    data += "line " + std::to_string(i) + "\n";
+  }
+  for (Codec codec : {Codec::Bgzf, Codec::ZstdSeekable}) {
+    if (!codecSupported(codec)) {
+      continue;
+    }
+    tmp = tmpfile();
+    MYASSERT(tmp != nullptr);
+    {
+      BlockCompressor compressor(fileno(tmp), codec, 2);
+      for (size_t pos = 0; pos < data.size(); pos += 100 << 10) {
+        MYASSERT(compressor.write(data.data() + pos,
+                                  std::min<size_t>(100 << 10,
+                                                   data.size() - pos)));
+      }
+      MYASSERT(compressor.finish());
+    }
+    BlockIndex index;
+    MYASSERT(readBlockIndex(fileno(tmp), codec, index).empty());
+    MYASSERT(index.nrBlocks() >= 3 &&
+             index.uncompressed.back() == data.size());
+    for (size_t threads : {0, 3}) {
+      for (size_t depth : {0, 2}) {
+        MYASSERT(lseek(fileno(tmp), 0, SEEK_SET) == 0);
+        BlockReader reader(fileno(tmp));
+        reader.setThreads(threads);
+        reader.setReadAhead(depth);
+        uint64_t size = 0;
+        MYASSERT(reader.codec() == codec);
+        MYASSERT(reader.dataSize(size) && size == data.size());
+        std::string all, l;
+        while (reader.getLine(l)) {
+          all += l + "\n";
+        }
+        MYASSERT(!reader.failed() && all == data);
+        // Into the middle of a later block and back to the first one:
+        size_t n = lineStarts.size() * 2 / 3;
+        MYASSERT(reader.seek(lineStarts[n]) && reader.getLine(l) &&
+                 l == "line " + std::to_string(n));
+        MYASSERT(reader.offset() == lineStarts[n + 1]);
+        MYASSERT(reader.seek(lineStarts[1]) && reader.getLine(l) &&
+                 l == "line 1");
+      }
+    }
+    fclose(tmp);
+  }
+
+  // Chunks written out of order on several threads end up in order:
+  tmp = tmpfile();
+  MYASSERT(tmp != nullptr);
+  {
+    OrderedWriter ordered(fileno(tmp), 0, 4);
+    std::vector<std::thread> writers;
+    for (uint64_t seq = 4; seq-- > 0;) {
+      writers.emplace_back([&ordered, seq] {
+        std::string chunk(seq, static_cast<char>('a' + seq));
+        MYASSERT(ordered.write(seq, chunk));
+      });
+    }
+    for (auto &t : writers) {
+      t.join();
+    }
+    MYASSERT(ordered.finish());
+    char buf[16];
+    MYASSERT(pread(fileno(tmp), buf, sizeof(buf), 0) == 6);
+    MYASSERT(std::string(buf, 6) == "bccddd");
+  }
+  fclose(tmp);
+
+  // Tasks which wait for tasks they submitted do not block the pool, even
+  // with more of them than threads:
+  {
+    TaskPool pool(2);
+    std::atomic<int> done{0};
+    TaskGroup outer(pool);
+    for (int i = 0; i < 4; ++i) {
+      outer.run([&pool, &done] {
+        TaskGroup inner(pool);
+        for (int j = 0; j < 10; ++j) {
+          inner.run([&done] { ++done; });
+        }
+        inner.wait();
+      });
+    }
+    outer.join();
+    MYASSERT(done == 40);
+  }
+
+  // Every supported variant of the dispatched kernels must agree with the
+  // generic one, at all lengths around the vector widths:
+  CpuKernels generic = cpuKernelsFor(CpuLevel::Generic);
+  std::string text;
+  std::vector<unsigned char> bytes;
+  for (size_t i = 0; i < 200; ++i) {
+    text.push_back("ab,\"\n"[(i * 7) % 5]);
+    bytes.push_back(static_cast<unsigned char>(i * 37));
+  }
+  std::string hex1(2 * bytes.size(), ' ');
+  std::string hex2(2 * bytes.size(), ' ');
+  for (CpuLevel level : supportedCpuLevels()) {
+    CpuKernels k = cpuKernelsFor(level);
+    for (size_t start = 0; start < 3; ++start) {
+      for (size_t n = 0; start + n <= text.size(); ++n) {
+        MYASSERT(k.findFirstOf2(text.data() + start, n, ',', '"') ==
+                 generic.findFirstOf2(text.data() + start, n, ',', '"'));
+        MYASSERT(k.findFirstOf2(text.data() + start, n, 'x', 'y') == n);
+        MYASSERT(k.countNewlines(text.data() + start, n) ==
+                 generic.countNewlines(text.data() + start, n));
+      }
+    }
+    for (size_t n = 0; n <= bytes.size(); ++n) {
+      k.hexEncode(bytes.data(), n, &hex1[0]);
+      generic.hexEncode(bytes.data(), n, &hex2[0]);
+      MYASSERT(hex1.compare(0, 2 * n, hex2, 0, 2 * n) == 0);
+    }
+  }
 }
 
 int main(int argc, char *argv[]) {
@@ -1347,10 +2928,28 @@ int main(int argc, char *argv[]) {
       {"--to-attribute", OptionConfigItem(ArgType::StringOnce, "_to")},
       {"--vertices", OptionConfigItem(ArgType::StringMultiple)},
       {"--edges", OptionConfigItem(ArgType::StringMultiple)},
+      {"--manifest", OptionConfigItem(ArgType::StringOnce)},
       {"--rename-column", OptionConfigItem(ArgType::StringMultiple)},
       {"--smart-default", OptionConfigItem(ArgType::StringOnce)},
       {"--threads", OptionConfigItem(ArgType::StringOnce, "1")},
       {"--key-value", OptionConfigItem(ArgType::StringOnce)},
+      {"--worker", OptionConfigItem(ArgType::StringOnce)},
+      {"--worker-split", OptionConfigItem(ArgType::StringOnce, "files")},
+      {"--index", OptionConfigItem(ArgType::StringOnce)},
+      {"--parts", OptionConfigItem(ArgType::StringOnce)},
+      {"--metrics", OptionConfigItem(ArgType::StringOnce)},
+      {"--metrics-prometheus", OptionConfigItem(ArgType::StringOnce)},
+      {"--metrics-interval", OptionConfigItem(ArgType::StringOnce, "10")},
+      {"--profile", OptionConfigItem(ArgType::Bool, "false")},
+      {"--profile-counters", OptionConfigItem(ArgType::Bool, "false")},
+      {"--trace", OptionConfigItem(ArgType::StringOnce)},
+      {"--memory-report", OptionConfigItem(ArgType::Bool, "false")},
+      {"--compress", OptionConfigItem(ArgType::StringOnce, "auto")},
+      {"--compress-threads", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--decompress-threads", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--io-depth", OptionConfigItem(ArgType::StringOnce, "0")},
+      {"--chunk-threads", OptionConfigItem(ArgType::StringOnce, "1")},
+      {"--double-buffer", OptionConfigItem(ArgType::Bool, "false")},
   };
 
   Options options;
@@ -1367,7 +2966,9 @@ int main(int argc, char *argv[]) {
   it = options.find("--version");
   if (it != options.end() && it->second[0] == "true") {
     std::cout << "smartifier2: Version " GRAPHUTILS_VERSION_MAJOR
-                 "." GRAPHUTILS_VERSION_MINOR; // version string
+                 "." GRAPHUTILS_VERSION_MINOR // version string
+              << "\n"
+              << cpuDispatchReport();
     return 0;
   }
   it = options.find("--test");
@@ -1384,16 +2985,86 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  if (args.size() != 1 || (args[0] != "vertices" && args[0] != "edges")) {
-    std::cerr << "Need exactly one subcommand 'vertices' or 'edges'.\n";
+  if (args.size() != 1 || (args[0] != "vertices" && args[0] != "edges" &&
+                            args[0] != "index" && args[0] != "merge")) {
+    std::cerr << "Need exactly one subcommand 'vertices', 'edges', 'index' "
+                 "or 'merge'.\n";
     return -2;
   }
 
+  it = options.find("--manifest");
+  if (it != options.end() && readManifest(it->second[0], options) != 0) {
+    return -4;
+  }
+
+  auto metricsFile = getOption(options, "--metrics");
+  auto promFile = getOption(options, "--metrics-prometheus");
+  // With `--output -` the vertices go to stdout and everything else to
+  // stderr:
   if (args[0] == "vertices") {
-    return doVertices(options);
+    auto output = getOption(options, "--output");
+    if (output && (*output.value())[0] == "-") {
+      if (metricsFile && (*metricsFile.value())[0] == "-") {
+        std::cerr << "`--metrics -` and `--output -` cannot both use stdout, "
+                     "giving up."
+                  << std::endl;
+        return -3;
+      }
+      info = &std::cerr;
+    }
+  }
+
+  if (metricsFile || promFile) {
+    double interval =
+        strtod((*getOption(options, "--metrics-interval").value())[0].c_str(),
+               nullptr);
+    if (interval < 0) {
+      std::cerr << "--metrics-interval must not be negative, giving up."
+                << std::endl;
+      return -3;
+    }
+    size_t memLimit =
+        strtoul((*getOption(options, "--memory").value())[0].c_str(), nullptr,
+                10) *
+        1024 * 1024;
+    if (!metrics.start(metricsFile ? (*metricsFile.value())[0] : "",
+                       promFile ? (*promFile.value())[0] : "", interval,
+                       memLimit, startTime)) {
+      return -3;
+    }
+  }
+
+  bool profile = (*getOption(options, "--profile").value())[0] == "true";
+  bool profileCounters =
+      (*getOption(options, "--profile-counters").value())[0] == "true";
+  if ((profile || profileCounters) && !startProfiling(profileCounters)) {
+    std::cerr << "Warning: profiling is not compiled in, configure with "
+                 "-DGRAPHUTILS_PROFILING=ON."
+              << std::endl;
+  }
+
+  auto traceFile = getOption(options, "--trace");
+  if (traceFile) {
+    startTracing(startTime);
+    setTraceThreadName("main");
+  }
+
+  int res = 0;
+  if (args[0] == "vertices") {
+    res = doVertices(options);
   } else if (args[0] == "edges") {
-    return doEdges(options);
+    res = doEdges(options);
+  } else if (args[0] == "index") {
+    res = doIndex(options);
+  } else if (args[0] == "merge") {
+    res = doMerge(options);
   }
 
-  return 0;
+  metrics.stop();
+  printProfile(*info, elapsed());
+  printMemoryPhases(*info);
+  if (traceFile && !writeTrace((*traceFile.value())[0]) && res == 0) {
+    res = -4;
+  }
+  return res;
 }
@@ -26,4 +26,33 @@ if ! cmp e2_smart.csv e2_expected.csv ; then
     exit 4
 fi
 
-rm v1_smart.csv v2_smart.csv e1_smart.csv e2_smart.csv
+# The same collections from a manifest, in both forms:
+cp e1.csv e1_smart.csv
+cp e2.csv e2_smart.csv
+cat > manifest.json <<MANIFEST
+{
+  "vertices": ["v1:v1_smart.csv", {"collection": "v2", "file": "v2_smart.csv"}],
+  "edges": [{"file": "e1_smart.csv", "from": "v1", "to": "v2"}, "e2_smart.csv:v2:v1"]
+}
+MANIFEST
+../../build/smartifier2 edges --type csv --manifest manifest.json --separator "|"
+
+if ! cmp e1_smart.csv e1_expected.csv ; then
+    echo Error in e1_smart.csv with manifest!
+    exit 5
+fi
+if ! cmp e2_smart.csv e2_expected.csv ; then
+    echo Error in e2_smart.csv with manifest!
+    exit 6
+fi
+
+# A single edge collection which is not in a list is an error:
+cat > manifest.json <<MANIFEST
+{"vertices": ["v1:v1_smart.csv"], "edges": "e1_smart.csv:v1:v2"}
+MANIFEST
+if ../../build/smartifier2 edges --type csv --manifest manifest.json --separator "|" > /dev/null 2>&1 ; then
+    echo Error: manifest without a list of edges accepted!
+    exit 7
+fi
+
+rm v1_smart.csv v2_smart.csv e1_smart.csv e2_smart.csv manifest.json
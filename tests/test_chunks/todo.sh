@@ -0,0 +1,22 @@
+#!/bin/sh
+
+# One large edge file is cut into chunks for all threads of the pool with
+# --threads alone, the result is the same as with one thread:
+for t in csv jsonl ; do
+    ../../build/sampleGraphMaker --type $t --rng counter ch 20000 200000 3 > /dev/null
+    ../../build/smartifier2 vertices --type $t --input ch_profiles.$t --output ch_smart.$t --smart-graph-attribute country > /dev/null
+    cp ch_relations.$t ch_relations1.$t
+    mv ch_relations.$t ch_relations4.$t
+    ../../build/smartifier2 edges --type $t --vertices profiles:ch_smart.$t --edges ch_relations1.$t:profiles:profiles --threads 1 > /dev/null
+    ../../build/smartifier2 edges --type $t --vertices profiles:ch_smart.$t --edges ch_relations4.$t:profiles:profiles --threads 4 --trace ch_trace.json > /dev/null
+
+    if ! cmp ch_relations1.$t ch_relations4.$t ; then
+        echo Error in ch_relations4.$t with 4 threads!
+        exit 1
+    fi
+    if [ "$(grep '"name":"chunk"' ch_trace.json | sed 's/.*"tid":\([0-9]*\).*/\1/' | sort -u | wc -l)" -lt 2 ] ; then
+        echo Error: the chunks of ch_relations4.$t were not spread over the threads!
+        exit 2
+    fi
+    rm ch_profiles.$t ch_smart.$t ch_relations1.$t ch_relations4.$t ch_trace.json
+done
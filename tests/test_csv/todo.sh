@@ -7,6 +7,24 @@ if ! cmp profiles_smart.csv profiles_expected.csv ; then
     exit 1
 fi
 
+# The same through a pipe, with stdin and stdout:
+cat profiles.csv | ../../build/smartifier2 vertices --type csv --input - --output - --smart-graph-attribute country > profiles_pipe.csv
+
+if ! cmp profiles_pipe.csv profiles_expected.csv ; then
+    echo Error in profiles_pipe.csv!
+    exit 3
+fi
+rm profiles_pipe.csv
+
+# Several threads per file:
+../../build/smartifier2 vertices --type csv --input profiles.csv --output profiles_chunks.csv --smart-graph-attribute country --chunk-threads 3 > /dev/null
+
+if ! cmp profiles_chunks.csv profiles_expected.csv ; then
+    echo Error in profiles_chunks.csv!
+    exit 8
+fi
+rm profiles_chunks.csv
+
 cp relations.csv relations_smart.csv
 ../../build/smartifier2 edges --type csv --vertices profiles:profiles_smart.csv --edges relations_smart.csv:profiles:profiles
 
@@ -15,4 +33,93 @@ if ! cmp relations_smart.csv relations_expected.csv ; then
     exit 2
 fi
 
-rm profiles_smart.csv relations_smart.csv
+# The same with io_uring, or pread and pwrite where it is not available:
+cp relations.csv relations_smart.csv
+../../build/smartifier2 edges --type csv --vertices profiles:profiles_smart.csv --edges relations_smart.csv:profiles:profiles --io-depth 4 > /dev/null
+
+if ! cmp relations_smart.csv relations_expected.csv ; then
+    echo Error in relations.csv with --io-depth!
+    exit 7
+fi
+
+# The same with double buffered vertex batches loaded on two threads:
+cp relations.csv relations_smart.csv
+../../build/smartifier2 edges --type csv --vertices profiles:profiles_smart.csv --edges relations_smart.csv:profiles:profiles --double-buffer --threads 2 > /dev/null
+
+if ! cmp relations_smart.csv relations_expected.csv ; then
+    echo Error in relations.csv with --double-buffer!
+    exit 9
+fi
+
+# Compressed input and output, the edge file stays compressed:
+gzip -c profiles.csv | ../../build/smartifier2 vertices --type csv --input - --output profiles_smart.csv.gz --smart-graph-attribute country --compress-threads 2 > /dev/null
+gzip -c relations.csv > relations_smart.csv.gz
+../../build/smartifier2 edges --type csv --vertices profiles:profiles_smart.csv.gz --edges relations_smart.csv.gz:profiles:profiles > /dev/null
+
+if ! gzip -dc profiles_smart.csv.gz | cmp - profiles_expected.csv ; then
+    echo Error in profiles_smart.csv.gz!
+    exit 4
+fi
+if ! gzip -dc relations_smart.csv.gz | cmp - relations_expected.csv ; then
+    echo Error in relations_smart.csv.gz!
+    exit 5
+fi
+
+# BGZF input, made by merging a single part, can be split between workers:
+cp profiles.csv profiles_bgzf.csv.gz.part0
+../../build/smartifier2 merge --output profiles_bgzf.csv.gz --parts 1 > /dev/null
+for k in 0 1 ; do
+    ../../build/smartifier2 vertices --type csv --input profiles_bgzf.csv.gz --output profiles_workers.csv --smart-graph-attribute country --worker $k/2 --decompress-threads 2 > /dev/null
+done
+../../build/smartifier2 merge --output profiles_workers.csv --parts 2 > /dev/null
+
+if ! cmp profiles_workers.csv profiles_expected.csv ; then
+    echo Error in profiles_workers.csv!
+    exit 6
+fi
+
+# The same with zstd, if the zstd tool is there and smartifier2 is built
+# with zstd. Seekable zstd can be split between workers like BGZF:
+if command -v zstd > /dev/null && ../../build/smartifier2 vertices --type csv --input profiles.csv --output profiles_zstd.csv --smart-graph-attribute country --compress zstd > /dev/null 2>&1 ; then
+    zstd -q -c profiles.csv | ../../build/smartifier2 vertices --type csv --input - --output profiles_smart.csv.zst --smart-graph-attribute country --compress zstd --compress-threads 2 > /dev/null
+    zstd -q -c relations.csv > relations_smart.csv.zst
+    ../../build/smartifier2 edges --type csv --vertices profiles:profiles_smart.csv.zst --edges relations_smart.csv.zst:profiles:profiles > /dev/null
+
+    if ! zstd -q -dc profiles_smart.csv.zst | cmp - profiles_expected.csv ; then
+        echo Error in profiles_smart.csv.zst!
+        exit 10
+    fi
+    if ! zstd -q -dc relations_smart.csv.zst | cmp - relations_expected.csv ; then
+        echo Error in relations_smart.csv.zst!
+        exit 11
+    fi
+
+    ../../build/smartifier2 vertices --type csv --input profiles.csv --output profiles_seekable.csv.zst --smart-graph-attribute country --compress zstd-seekable > /dev/null
+    for k in 0 1 ; do
+        ../../build/smartifier2 vertices --type csv --input profiles_seekable.csv.zst --output profiles_workers.csv --smart-graph-attribute country --worker $k/2 --decompress-threads 2 > /dev/null
+    done
+    ../../build/smartifier2 merge --output profiles_workers.csv --parts 2 > /dev/null
+
+    if ! zstd -q -dc profiles_seekable.csv.zst | cmp - profiles_expected.csv ; then
+        echo Error in profiles_seekable.csv.zst!
+        exit 12
+    fi
+    if ! cmp profiles_workers.csv profiles_expected.csv ; then
+        echo Error in profiles_workers.csv from seekable zstd!
+        exit 13
+    fi
+
+    zstd -q -c relations.csv > relations_seekable.csv.zst
+    ../../build/smartifier2 edges --type csv --vertices profiles:profiles_seekable.csv.zst --edges relations_seekable.csv.zst:profiles:profiles --compress zstd-seekable --decompress-threads 2 > /dev/null
+
+    if ! zstd -q -dc relations_seekable.csv.zst | cmp - relations_expected.csv ; then
+        echo Error in relations_seekable.csv.zst!
+        exit 14
+    fi
+    rm -f profiles_zstd.csv profiles_smart.csv.zst relations_smart.csv.zst profiles_seekable.csv.zst relations_seekable.csv.zst profiles_workers.csv*
+else
+    echo zstd is not available, skipping the zstd tests.
+    rm -f profiles_zstd.csv
+fi
+
+rm -f profiles_smart.csv relations_smart.csv profiles_smart.csv.gz relations_smart.csv.gz profiles_bgzf.csv.gz* profiles_workers.csv*
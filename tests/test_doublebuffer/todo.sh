@@ -0,0 +1,31 @@
+#!/bin/sh
+
+# Double buffered vertex batches with many edge files and several passes
+# on two threads, the same result as without:
+../../build/sampleGraphMaker --type csv --rng counter db 150000 400000 3 > /dev/null
+../../build/smartifier2 vertices --type csv --input db_profiles.csv --output db_smart.csv --smart-graph-attribute country > /dev/null
+tail -n +2 db_relations.csv | split -l 25000 - db_part_
+parts=$(ls db_part_??)
+single=""
+double=""
+for p in $parts ; do
+    (head -n 1 db_relations.csv ; cat $p) > ${p}.csv
+    cp ${p}.csv ${p}_double.csv
+    single="$single --edges ${p}.csv:profiles:profiles"
+    double="$double --edges ${p}_double.csv:profiles:profiles"
+done
+../../build/smartifier2 edges --type csv --vertices profiles:db_smart.csv $single --memory 1 --threads 2 > db_single.log
+../../build/smartifier2 edges --type csv --vertices profiles:db_smart.csv $double --memory 1 --threads 2 --double-buffer > db_double.log
+if [ "$(grep -c 'Reading vertices' db_double.log)" -lt 3 ] ; then
+    echo Error: --double-buffer test needs several passes!
+    exit 1
+fi
+for p in $parts ; do
+    if ! cmp ${p}.csv ${p}_double.csv ; then
+        echo Error in ${p}.csv with --double-buffer!
+        exit 2
+    fi
+    rm $p ${p}.csv ${p}_double.csv
+done
+
+rm db_profiles.csv db_relations.csv db_smart.csv db_single.log db_double.log
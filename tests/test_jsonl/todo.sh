@@ -7,6 +7,15 @@ if ! cmp profiles_smart.jsonl profiles_expected.jsonl ; then
     exit 1
 fi
 
+# The same through a pipe, with stdin and stdout:
+cat profiles.jsonl | ../../build/smartifier2 vertices --type jsonl --input - --output - --smart-graph-attribute country > profiles_pipe.jsonl
+
+if ! cmp profiles_pipe.jsonl profiles_expected.jsonl ; then
+    echo Error in profiles_pipe.jsonl!
+    exit 3
+fi
+rm profiles_pipe.jsonl
+
 cp relations.jsonl relations_smart.jsonl
 ../../build/smartifier2 edges --type jsonl --vertices profiles:profiles_smart.jsonl --edges relations_smart.jsonl:profiles:profiles
 
@@ -15,4 +24,13 @@ if ! cmp relations_smart.jsonl relations_expected.jsonl ; then
     exit 2
 fi
 
+# The same with several threads per file:
+cp relations.jsonl relations_smart.jsonl
+../../build/smartifier2 edges --type jsonl --vertices profiles:profiles_smart.jsonl --edges relations_smart.jsonl:profiles:profiles --chunk-threads 3 > /dev/null
+
+if ! cmp relations_smart.jsonl relations_expected.jsonl ; then
+    echo Error in relations.jsonl with --chunk-threads!
+    exit 4
+fi
+
 rm profiles_smart.jsonl relations_smart.jsonl
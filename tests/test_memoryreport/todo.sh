@@ -0,0 +1,54 @@
+#!/bin/sh
+
+# The memory report of a run with several passes under --memory 1:
+../../build/sampleGraphMaker --type csv --rng counter mr 20000 100000 3 > /dev/null
+../../build/smartifier2 vertices --type csv --input mr_profiles.csv --output mr_smart.csv --smart-graph-attribute country > /dev/null
+../../build/smartifier2 edges --type csv --vertices profiles:mr_smart.csv --edges mr_relations.csv:profiles:profiles --memory 1 --memory-report > mr.log
+
+# One report per pass, and the load and edge phase of every pass once in
+# the table at the end:
+passes=$(grep -c 'Reading vertices' mr.log)
+if [ "$passes" -lt 2 ] || [ "$(grep -c '^Memory report of the translation' mr.log)" != "$passes" ] ; then
+    echo Error: expected one memory report in each of several passes!
+    exit 1
+fi
+for p in $(seq 1 $passes) ; do
+    if [ "$(grep -c "^load (pass $p) " mr.log)" != 1 ] || [ "$(grep -c "^edges (pass $p) " mr.log)" != 1 ] ; then
+        echo Error: phases of pass $p missing in the table!
+        exit 2
+    fi
+done
+
+# Every batch fits into --memory, and all 20000 vertices are in one of
+# them:
+if ! awk '/^Memory report of the translation/ { if ($6 > 1.0) exit 1; n += $9 } END { exit n != 20000 }' mr.log ; then
+    echo Error in the sizes of the batches!
+    exit 3
+fi
+
+# Load factors within (0, max], probe lengths of at least 1, and the
+# histogram counts every entry:
+if ! awk '/^  (keyTab|attTab):/ {
+            entries = $2; lf = $10; max = $12; sub(/\),/, "", max)
+            mean = $16; sub(/,/, "", mean)
+            if (entries == 0 || lf <= 0 || lf > max || mean < 1) exit 1
+            getline; getline
+            sum = 0
+            for (i = 3; i <= NF; ++i) { split($i, c, ":"); sum += c[2] }
+            if (sum != entries) exit 1
+            ++tables
+          }
+          END { exit tables == 0 }' mr.log ; then
+    echo Error in the statistics of the hash tables!
+    exit 4
+fi
+
+# The peak RSS of a phase is at least the RSS before and after it, and
+# below 1 GB:
+if ! awk '/^(load|edges) \(pass/ { if ($5 < $4 || $5 < $6 || $4 <= 0 || $5 > 1024) exit 1; ++rows }
+          END { exit rows != 2 * '"$passes"' }' mr.log ; then
+    echo Error in the RSS by phase!
+    exit 5
+fi
+
+rm mr_profiles.csv mr_relations.csv mr_smart.csv mr.log
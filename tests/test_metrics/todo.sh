@@ -0,0 +1,73 @@
+#!/bin/sh
+
+# The metrics of a run with several passes, reported every 10 ms:
+../../build/sampleGraphMaker --type csv --rng counter mt 20000 200000 3 > /dev/null
+../../build/smartifier2 vertices --type csv --input mt_profiles.csv --output mt_smart.csv --smart-graph-attribute country > /dev/null
+../../build/smartifier2 edges --type csv --vertices profiles:mt_smart.csv --edges mt_relations.csv:profiles:profiles --memory 1 --metrics mt.jsonl --metrics-prometheus mt.prom --metrics-interval 0.01 > /dev/null
+
+# Periodic lines and one final line, all with the documented fields:
+lines=$(wc -l < mt.jsonl)
+if [ "$lines" -lt 2 ] || [ "$(grep -c '"final":false' mt.jsonl)" != $((lines - 1)) ] || ! tail -n 1 mt.jsonl | grep -q '"final":true' ; then
+    echo Error: expected periodic metrics and one final line!
+    exit 1
+fi
+for f in '"pass":[1-9]' '"loadFactor":[0-9]' '"rss":[1-9]' '"resolved":[0-9]' '"unresolved":[0-9]' '"etaSeconds":-*[0-9]' ; do
+    if [ "$(grep -c "$f" mt.jsonl)" != "$lines" ] ; then
+        echo Error: $f is missing in the metrics!
+        exit 2
+    fi
+done
+if command -v python3 > /dev/null && ! python3 -c 'import json, sys
+for l in open(sys.argv[1]): json.loads(l)' mt.jsonl ; then
+    echo Error: the metrics are not valid JSON!
+    exit 3
+fi
+
+# All 200000 edges are resolved at both ends, in the last of several
+# passes, and the load factor is below 1:
+final=$(tail -n 1 mt.jsonl)
+pass=$(echo "$final" | sed 's/.*"pass":\([0-9]*\).*/\1/')
+resolved=$(echo "$final" | sed 's/.*"resolved":\([0-9]*\).*/\1/')
+unresolved=$(echo "$final" | sed 's/.*"unresolved":\([0-9]*\).*/\1/')
+if [ "$pass" -lt 2 ] || [ "$resolved" != 400000 ] || [ "$unresolved" != 0 ] ; then
+    echo Error in the final metrics: pass $pass, resolved $resolved, unresolved $unresolved!
+    exit 4
+fi
+if ! echo "$final" | grep -q '"loadFactor":0\.' ; then
+    echo Error in the load factor!
+    exit 5
+fi
+# At the end the whole input of the phase is read and nothing remains:
+if ! echo "$final" | grep -q '"bytes":\([0-9]*\),"totalBytes":\1,.*"etaSeconds":0,' ; then
+    echo Error in the final progress: $final
+    exit 9
+fi
+
+# The textfile has the same final values, and every sample line has a
+# name, optional labels and a number:
+for m in "smartifier2_pass $pass" "smartifier2_endpoints_resolved $resolved" "smartifier2_endpoints_unresolved 0" "smartifier2_finished 1" ; do
+    if ! grep -q "^$m\$" mt.prom ; then
+        echo Error: $m is missing in the Prometheus textfile!
+        exit 6
+    fi
+done
+for m in smartifier2_rss_bytes smartifier2_translation_load_factor smartifier2_eta_seconds ; do
+    if ! grep -q "^# TYPE $m gauge\$" mt.prom || ! grep -q "^$m -*[0-9]" mt.prom ; then
+        echo Error: $m is missing in the Prometheus textfile!
+        exit 7
+    fi
+done
+if grep -v '^#' mt.prom | grep -v -q '^smartifier2_[a-z_]*\({[^}]*}\)* -*[0-9][0-9.e+-]*$' ; then
+    echo Error: malformed line in the Prometheus textfile!
+    exit 8
+fi
+
+# With an interval of 0 there is only the final report:
+rm mt.jsonl
+../../build/smartifier2 edges --type csv --vertices profiles:mt_smart.csv --edges mt_relations.csv:profiles:profiles --memory 1 --metrics mt.jsonl --metrics-interval 0 > /dev/null
+if [ "$(wc -l < mt.jsonl)" -ne 1 ] || ! grep -q '"final":true' mt.jsonl ; then
+    echo Error: --metrics-interval 0 did not write only the final report!
+    exit 10
+fi
+
+rm mt_profiles.csv mt_relations.csv mt_smart.csv mt.jsonl mt.prom
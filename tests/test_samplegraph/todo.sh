@@ -0,0 +1,101 @@
+#!/bin/sh
+
+../../build/sampleGraphMaker --type csv small 100 200 7 > /dev/null
+if ! cmp small_profiles.csv profiles_expected.csv || ! cmp small_relations.csv relations_expected.csv ; then
+    echo Error in the output with mt19937!
+    exit 1
+fi
+
+../../build/sampleGraphMaker --type jsonl --rng counter small 100 200 7 > /dev/null
+if ! cmp small_profiles.jsonl profiles_counter_expected.jsonl || ! cmp small_relations.jsonl relations_counter_expected.jsonl ; then
+    echo Error in the output with the counter-based generator!
+    exit 2
+fi
+
+# Several rounds of segments, the output must not depend on the threads:
+../../build/sampleGraphMaker --type csv --rng counter --threads 1 one 150000 400000 3 > /dev/null
+../../build/sampleGraphMaker --type csv --rng counter --threads 3 three 150000 400000 3 > /dev/null
+if ! cmp one_profiles.csv three_profiles.csv || ! cmp one_relations.csv three_relations.csv ; then
+    echo Error: the output depends on the number of threads!
+    exit 3
+fi
+
+# All edges within the communities, the country follows the community:
+../../build/sampleGraphMaker --type csv --rng counter --topology community --communities 7 --intra 1 --country-by-community comm 7000 20000 5 > /dev/null
+if ! awk -F'[,/]' 'NR > 1 && int(($3 - 1) / 1000) != int(($5 - 1) / 1000) { exit 1 }' comm_relations.csv ; then
+    echo Error: edge between communities!
+    exit 4
+fi
+if [ "$(awk -F, 'NR > 1 { print int(($3 - 1) / 1000), $4 }' comm_profiles.csv | sort -u | wc -l)" != 7 ] ; then
+    echo Error: country does not follow the community!
+    exit 5
+fi
+
+for t in rmat chunglu ; do
+    ../../build/sampleGraphMaker --type csv --rng counter --topology $t $t 1000 5000 5 > /dev/null
+    if ! awk -F'[,/]' 'NR > 1 && ($3 < 1 || $3 > 1000 || $5 < 1 || $5 > 1000) { exit 1 }' ${t}_relations.csv ; then
+        echo Error: vertex out of range with topology $t!
+        exit 6
+    fi
+    rm ${t}_profiles.csv ${t}_relations.csv
+done
+
+# Countries from a histogram, the other attributes stay the same:
+../../build/sampleGraphMaker --type csv --country-distribution histogram:histogram.txt --attribute-distribution zipf:1.5 hist 1000 10 7 > /dev/null
+if [ "$(awk -F, 'NR > 1 { print $4 }' hist_profiles.csv | sort -u | tr '\n' ' ')" != "XX YY " ] ; then
+    echo Error in the countries from the histogram!
+    exit 7
+fi
+../../build/sampleGraphMaker --type csv --countries 50 --country-distribution zipf:1 zipf 100 10 7 > /dev/null
+cut -d, -f1-3,5- zipf_profiles.csv > zipf_rest.csv
+cut -d, -f1-3,5- profiles_expected.csv > expected_rest.csv
+if ! cmp zipf_rest.csv expected_rest.csv ; then
+    echo Error: the country distribution changes other attributes!
+    exit 8
+fi
+
+# Shards are the single file cut into pieces, stdout is the single file:
+../../build/sampleGraphMaker --type csv --shards 3 shard 100 200 7 > /dev/null
+for f in shard_profiles_0.csv shard_profiles_1.csv shard_profiles_2.csv ; do
+    tail -n +2 $f
+done > shard_all.csv
+tail -n +2 profiles_expected.csv | cmp - shard_all.csv || exit 9
+../../build/sampleGraphMaker --type csv --only edges - 100 200 7 2> /dev/null | cmp - relations_expected.csv || exit 10
+
+# Edges between several vertex collections:
+../../build/sampleGraphMaker --type csv --collections 2 coll 100 200 7 > /dev/null
+if [ "$(tail -n +2 coll_relations.csv | cut -d, -f2 | cut -d/ -f1 | sort -u | tr '\n' ' ')" != "profiles0 profiles1 " ] ; then
+    echo Error in the collections of the edges!
+    exit 11
+fi
+
+# The expected files are what smartifier2 makes, the manifest fits:
+for t in csv jsonl ; do
+    ../../build/sampleGraphMaker --type $t --rng counter --threads 2 --format both --manifest smart.sha1 smart 1000 3000 7 > /dev/null
+    if ! sha1sum -c --quiet smart.sha1 ; then
+        echo Error in the manifest!
+        exit 12
+    fi
+    ../../build/smartifier2 vertices --type $t --input smart_profiles.$t --output smart_v.$t --smart-graph-attribute country > /dev/null
+    cmp smart_v.$t smart_profiles_expected.$t || exit 13
+    cp smart_relations.$t smart_e.$t
+    ../../build/smartifier2 edges --type $t --vertices profiles:smart_v.$t --edges smart_e.$t:profiles:profiles > /dev/null
+    cmp smart_e.$t smart_relations_expected.$t || exit 14
+    # Only the checksums of the expected files:
+    ../../build/sampleGraphMaker --type $t --rng counter --format manifest --manifest check.sha1 check 1000 3000 7 > /dev/null
+    mv smart_v.$t check_profiles_expected.$t
+    mv smart_e.$t check_relations_expected.$t
+    if ! sha1sum -c --quiet check.sha1 ; then
+        echo Error in the manifest without expected files!
+        exit 15
+    fi
+    rm smart_profiles.$t smart_relations.$t smart_profiles_expected.$t smart_relations_expected.$t smart.sha1
+    rm check_profiles.$t check_relations.$t check_profiles_expected.$t check_relations_expected.$t check.sha1
+done
+
+rm shard_profiles_?.csv shard_relations_?.csv shard_all.csv
+rm coll_profiles0.csv coll_profiles1.csv coll_relations.csv
+rm comm_profiles.csv comm_relations.csv hist_profiles.csv hist_relations.csv
+rm zipf_profiles.csv zipf_relations.csv zipf_rest.csv expected_rest.csv
+rm small_profiles.csv small_relations.csv small_profiles.jsonl small_relations.jsonl
+rm one_profiles.csv one_relations.csv three_profiles.csv three_relations.csv
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# A trace of two edge threads over eight edge files in several passes:
+../../build/sampleGraphMaker --type csv --rng counter tr 20000 100000 3 > /dev/null
+../../build/smartifier2 vertices --type csv --input tr_profiles.csv --output tr_smart.csv --smart-graph-attribute country > /dev/null
+tail -n +2 tr_relations.csv | split -l 12500 - tr_part_
+edges=""
+for p in tr_part_?? ; do
+    (head -n 1 tr_relations.csv ; cat $p) > ${p}.csv
+    rm $p
+    edges="$edges --edges ${p}.csv:profiles:profiles"
+done
+../../build/smartifier2 edges --type csv --vertices profiles:tr_smart.csv $edges --memory 1 --threads 2 --trace tr.json > /dev/null
+
+# The trace-event format, one event per line:
+if [ "$(head -n 1 tr.json)" != '{"displayTimeUnit":"ms","traceEvents":[' ] || [ "$(tail -n 1 tr.json)" != ']}' ] ; then
+    echo Error: tr.json is not a trace-event file!
+    exit 1
+fi
+if sed '1d;$d' tr.json | grep -v -q '^{"name":".*"ph":"[MX]","pid":1,"tid":[0-9]*,.*},*$' || grep -q '"dur":-' tr.json ; then
+    echo Error: malformed event in tr.json!
+    exit 2
+fi
+if command -v python3 > /dev/null && ! python3 -c 'import json, sys; json.load(open(sys.argv[1]))' tr.json ; then
+    echo Error: tr.json is not valid JSON!
+    exit 3
+fi
+
+# The threads are named, the vertices are read by the main thread in
+# every pass and both edge threads open and rename files:
+for n in main "edge worker 0" "edge worker 1" ; do
+    if ! grep -q "\"thread_name\".*\"args\":{\"name\":\"$n\"}" tr.json ; then
+        echo Error: thread $n is missing in tr.json!
+        exit 4
+    fi
+done
+tids() {
+    grep "\"name\":\"$1\"" tr.json | sed 's/.*"tid":\([0-9]*\).*/\1/' | sort -u | wc -l
+}
+passes=$(grep -c '"name":"pass"' tr.json)
+if [ "$passes" -lt 2 ] || [ "$(grep -c '"name":"readMore"' tr.json)" != "$passes" ] || [ "$(grep -c '"name":"read"' tr.json)" -lt "$passes" ] || [ "$(tids readMore)" != 1 ] ; then
+    echo Error: expected readMore and read spans in every pass!
+    exit 5
+fi
+for n in open rename ; do
+    if [ "$(grep -c "\"name\":\"$n\"" tr.json)" != $((8 * passes)) ] || [ "$(tids $n)" != 2 ] ; then
+        echo Error: expected $n spans of every file on both edge threads!
+        exit 6
+    fi
+done
+
+rm tr_profiles.csv tr_relations.csv tr_smart.csv tr_part_??.csv tr.json
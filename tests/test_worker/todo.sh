@@ -0,0 +1,41 @@
+#!/bin/sh
+
+for k in 0 1 2 ; do
+    ../../build/smartifier2 vertices --type csv --input profiles.csv --output profiles_smart.csv --smart-graph-attribute country --worker $k/3
+done
+../../build/smartifier2 merge --type csv --output profiles_smart.csv --parts 3
+
+if ! cmp profiles_smart.csv profiles_expected.csv ; then
+    echo Error in profiles_smart.csv!
+    exit 1
+fi
+
+../../build/smartifier2 index --type csv --vertices profiles:profiles_smart.csv --index profiles.idx
+
+cp relations.csv relations_smart.csv
+for k in 0 1 2 ; do
+    ../../build/smartifier2 edges --type csv --index profiles.idx --edges relations_smart.csv:profiles:profiles --worker $k/3 --worker-split ranges
+done
+../../build/smartifier2 merge --type csv --output relations_smart.csv --parts 3
+
+if ! cmp relations_smart.csv relations_expected.csv ; then
+    echo Error in relations.csv with ranges!
+    exit 2
+fi
+
+cp relations.csv relations_smart.csv
+cp relations.csv relations_smart2.csv
+for k in 0 1 ; do
+    ../../build/smartifier2 edges --type csv --index profiles.idx --edges relations_smart.csv:profiles:profiles --edges relations_smart2.csv:profiles:profiles --worker $k/2
+done
+
+if ! cmp relations_smart.csv relations_expected.csv ; then
+    echo Error in relations.csv with files!
+    exit 3
+fi
+if ! cmp relations_smart2.csv relations_expected.csv ; then
+    echo Error in relations_smart2.csv with files!
+    exit 4
+fi
+
+rm profiles_smart.csv relations_smart.csv relations_smart2.csv profiles.idx